@@ -13,15 +13,26 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //
 
+#include <algorithm>
+#include <cmath>
 #include <cstring>
 #include <filesystem>
+#include <limits>
 #include <string>
+#include <vector>
 #include <jansson.h>
 #include "plugin.hpp"
 #include "osdialog.h"
 #include "components.hpp"
 #include "widget/display.hpp"
+#include "state_library.hpp"
+#include "rom_bank.hpp"
+#include "nes/movie.hpp"
+#include "nes/capture.hpp"
+#include "nes/shared_export.hpp"
 #include "nes/emulator.hpp"
+#include "nes/apu_oscillator.hpp"
+#include "nes/apu_poly_oscillator.hpp"
 #include "theme.hpp"
 
 /// a trigger for a button with a CV input.
@@ -43,6 +54,24 @@ struct CVButtonTrigger {
         return buttonPress or cvGate;
     }
 
+    /// Process the button signal.
+    ///
+    /// @param button the value of the button signal [0, 1]
+    /// @returns true if the button crossed a rising edge
+    ///
+    inline bool processButton(float button) {
+        return buttonTrigger.process(button);
+    }
+
+    /// Process the CV signal.
+    ///
+    /// @param cv the value of the CV signal [-10, 10]
+    /// @returns true if the CV crossed a rising edge
+    ///
+    inline bool processCV(float cv) {
+        return cvTrigger.process(rescale(cv, 0.1, 2.0f, 0.f, 1.f));
+    }
+
     /// Return a boolean determining if either the button or CV gate is high.
     inline bool isHigh() {
         return buttonTrigger.isHigh() or cvTrigger.isHigh();
@@ -84,11 +113,74 @@ struct RackNES : Module {
     enum LightIds {
         NUM_LIGHTS
     };
+    /// the modes of operation for the module
+    enum Mode {
+        /// emulate the entire console running a ROM
+        MODE_EMULATOR,
+        /// drive the APU registers directly from CV (no ROM, CPU, or PPU)
+        MODE_OSCILLATOR,
+        /// drive one APU per channel of polyphonic CV
+        MODE_POLYPHONIC,
+        NUM_MODES
+    };
 
-    /// the NES emulator
-    NES::Emulator emulator;
-    /// the RGBA pixels on the screen in binary representation
-    uint8_t screen[NES::Emulator::SCREEN_BYTES];
+    /// the names of the player inputs in each mode of operation
+    static constexpr const char* PLAYER_INPUT_NAMES[NUM_MODES][16] = {
+        {
+            "Player 1 \"A\" gate",      "Player 1 \"B\" gate",
+            "Player 1 \"Select\" gate", "Player 1 \"Start\" gate",
+            "Player 1 \"Up\" gate",     "Player 1 \"Down\" gate",
+            "Player 1 \"Left\" gate",   "Player 1 \"Right\" gate",
+            "Player 2 \"A\" gate",      "Player 2 \"B\" gate",
+            "Player 2 \"Select\" gate", "Player 2 \"Start\" gate",
+            "Player 2 \"Up\" gate",     "Player 2 \"Down\" gate",
+            "Player 2 \"Left\" gate",   "Player 2 \"Right\" gate"
+        }, {
+            "Square 1 gate",            "Square 2 gate",
+            "Triangle gate",            "Noise gate",
+            "Square 1 V/oct",           "Square 2 V/oct",
+            "Triangle V/oct",           "Noise V/oct",
+            "Square 1 volume",          "Square 2 volume",
+            "DMC level",                "Noise volume",
+            "Square 1 duty cycle",      "Square 2 duty cycle",
+            "Unused",                   "Noise mode (short/long)"
+        }, {
+            "Square 1 gate",            "Square 2 gate",
+            "Triangle gate",            "Noise gate",
+            "Square 1 V/oct",           "Square 2 V/oct",
+            "Triangle V/oct",           "Noise V/oct",
+            "Square 1 volume",          "Square 2 volume",
+            "DMC level",                "Noise volume",
+            "Square 1 duty cycle",      "Square 2 duty cycle",
+            "Unused",                   "Noise mode (short/long)"
+        }
+    };
+
+    /// the mode of operation for the module
+    Mode mode = MODE_EMULATOR;
+    /// the mode that the channels of the outputs were last set for
+    Mode outputMode = MODE_EMULATOR;
+    /// the bank of emulators with preloaded games
+    ROMBank bank;
+    /// the slot of the bank that is running
+    int bankSlot = 0;
+    /// a signal from the widget to switch to a slot of the bank (-1 for none)
+    int bank_slot_signal = -1;
+    /// the NES emulator of the running game (the emulator in the running
+    /// slot of the bank)
+    NES::Emulator* emulator = nullptr;
+    /// the APU for driving the sound hardware directly in oscillator mode
+    NES::APUOscillator oscillator;
+    /// the bank of APUs for driving the sound hardware in polyphonic mode
+    NES::APUPolyOscillator polyOscillator;
+    /// the control parameters for the voices in polyphonic mode
+    NES::APUPolyOscillator::Controls polyControls = {};
+    /// the channel levels that were last applied to the polyphonic oscillator
+    float polyLevels[NES::APU::NUM_CHANNELS] = {1.f, 1.f, 1.f, 1.f, 1.f};
+    /// Schmitt Triggers for the gates of each voice in polyphonic mode
+    dsp::SchmittTrigger polyGateTriggers[4][NES::APUPolyOscillator::MAX_VOICES];
+    /// the frames of RGBA pixels handed from the engine to the display
+    DisplayBuffer screen{NES::Emulator::WIDTH * sizeof(NES::NES_Pixel), NES::Emulator::HEIGHT};
     /// a pulse generator for generating pulses every frame event
     dsp::PulseGenerator clockGenerator;
 
@@ -105,8 +197,61 @@ struct RackNES : Module {
     CVButtonTrigger hangButton;
     /// triggers for handling button presses and CV inputs for the reset input
     CVButtonTrigger resetButton;
+    /// triggers for the channels of a polyphonic reset input, which switch
+    /// to the slots of the bank
+    dsp::SchmittTrigger resetChannels[ROMBank::NUM_SLOTS];
     /// the NES emulator backup state
     json_t* backup = nullptr;
+    /// the slot of the bank that the backup state was saved from
+    int backupSlot = 0;
+
+    /// the number of channels of the save and load inputs that select slots
+    static constexpr int NUM_STATE_CHANNELS = 16;
+    /// the library of save states on disk for the game
+    StateLibrary library;
+    /// the target of the save and load buttons (0 for the backup, i for the
+    /// slot i - 1 of the library)
+    int stateSlot = 0;
+    /// triggers for the channels of polyphonic save and load inputs
+    dsp::SchmittTrigger saveChannels[NUM_STATE_CHANNELS];
+    dsp::SchmittTrigger loadChannels[NUM_STATE_CHANNELS];
+    /// the bitmask of the slots of the library that saved states wait to be
+    /// handed to while the library is busy
+    uint32_t pendingSaves = 0;
+    static_assert(StateLibrary::NUM_SLOTS <= 32, "the pending saves are a bitmask of the slots");
+    /// the slot of the library that waits to be loaded (-1 for none) while
+    /// the library is busy
+    int pendingLoad = -1;
+    /// the buffers that the states of each slot are written to before they
+    /// go to the library
+    std::vector<uint8_t> stateBuffers[StateLibrary::NUM_SLOTS];
+    /// the snapshot that states are staged in
+    NES::Emulator::Snapshot stateSnapshot;
+
+    /// the states of the movie of the inputs
+    enum MovieState {
+        MOVIE_STOPPED,
+        MOVIE_RECORDING,
+        MOVIE_PLAYING
+    };
+    /// the state of the movie of the inputs
+    MovieState movieState = MOVIE_STOPPED;
+    /// the movie of the inputs that is recorded and played back
+    NES::Movie movie;
+    /// the recorder of the inputs to the emulator into the movie
+    NES::MovieRecorder movieRecorder;
+    /// the player of the movie into the emulator
+    NES::MoviePlayer moviePlayer;
+    /// a signal from the widget to change the state of the movie (-1 for
+    /// none)
+    int movie_signal = -1;
+    /// a flag for telling the widget that a movie of another game was played
+    bool movie_game_signal = false;
+    /// the capture of the frames and audio of the emulator to disk
+    NES::Capture capture;
+    /// the export of the frames, RAM, and audio of the emulator to other
+    /// processes through shared memory
+    NES::SharedExport sharedExport;
 
     /// a data signal from the widget for when the user selects a new ROM
     std::string rom_path_signal = "";
@@ -119,9 +264,39 @@ struct RackNES : Module {
     /// a flag for telling the widget that a ROM file load (from JSON) failed
     bool rom_reload_failed_signal = false;
 
+    /// the largest number of samples between CV acquisitions
+    static constexpr int MAX_CV_DIVISION = 64;
     /// a clock divider for running CV acquisition slower than audio rate
     dsp::ClockDivider cvDivider;
 
+    /// the most frames that the emulator can run ahead of the controllers
+    static constexpr int MAX_RUN_AHEAD = 3;
+    /// the number of frames that the emulator runs ahead of the controllers
+    int runAhead = 0;
+    /// snapshots of the emulator at the end of the last frames
+    std::vector<NES::Emulator::Snapshot> runAheadSnapshots =
+        std::vector<NES::Emulator::Snapshot>(MAX_RUN_AHEAD);
+    /// the index of the next snapshot to save
+    int runAheadHead = 0;
+    /// the number of snapshots that are saved
+    int runAheadCount = 0;
+    /// whether the emulator rewound for a change of the controllers in the
+    /// frame that it is running
+    bool isRunAheadRewound = false;
+    /// the controllers that were last written to the emulator
+    NES::NES_Byte lastPlayer1 = 0;
+    NES::NES_Byte lastPlayer2 = 0;
+
+    /// whether the widget shows the profiling counters over the screen
+    bool showProfile = false;
+    /// the timeline of host blocks, frames, and loads that is being recorded
+    NES::Tracer tracer;
+    /// the engine block that the last traced sample belongs to
+    int64_t traceBlock = -1;
+    /// the times that the current engine block started and last ended at
+    uint64_t traceBlockStart = 0;
+    uint64_t traceBlockEnd = 0;
+
     /// messages from CV Genie expander
     uint16_t rightMessages[2][8][2] = {};
 
@@ -157,22 +332,8 @@ struct RackNES : Module {
         configButton(PARAM_PLAYER2_LEFT,   "Player 2 Left");
         configButton(PARAM_PLAYER2_RIGHT,  "Player 2 Right");
         // Configure metadata for the input and output ports
-        configInput(INPUT_PLAYER1_A,       "Player 1 \"A\" gate");
-        configInput(INPUT_PLAYER1_B,       "Player 1 \"B\" gate");
-        configInput(INPUT_PLAYER1_SELECT,  "Player 1 \"Select\" gate");
-        configInput(INPUT_PLAYER1_START,   "Player 1 \"Start\" gate");
-        configInput(INPUT_PLAYER1_UP,      "Player 1 \"Up\" gate");
-        configInput(INPUT_PLAYER1_DOWN,    "Player 1 \"Down\" gate");
-        configInput(INPUT_PLAYER1_LEFT,    "Player 1 \"Left\" gate");
-        configInput(INPUT_PLAYER1_RIGHT,   "Player 1 \"Right\" gate");
-        configInput(INPUT_PLAYER2_A,       "Player 2 \"A\" gate");
-        configInput(INPUT_PLAYER2_B,       "Player 2 \"B\" gate");
-        configInput(INPUT_PLAYER2_SELECT,  "Player 2 \"Select\" gate");
-        configInput(INPUT_PLAYER2_START,   "Player 2 \"Start\" gate");
-        configInput(INPUT_PLAYER2_UP,      "Player 2 \"Up\" gate");
-        configInput(INPUT_PLAYER2_DOWN,    "Player 2 \"Down\" gate");
-        configInput(INPUT_PLAYER2_LEFT,    "Player 2 \"Left\" gate");
-        configInput(INPUT_PLAYER2_RIGHT,   "Player 2 \"Right\" gate");
+        for (std::size_t i = 0; i < 16; i++)
+            configInput(INPUT_PLAYER1_A + i, PLAYER_INPUT_NAMES[mode][i]);
         configInput(INPUT_CLOCK,           "CPU clock speed");
         configInput(INPUT_SAVE,            "Save state trigger");
         configInput(INPUT_LOAD,            "Load state trigger");
@@ -189,12 +350,126 @@ struct RackNES : Module {
         cvDivider.setDivision(16);
         // draw the initial screen
         initalizeScreen();
-        // set the emulator's clock rate to the Rack rate
-        emulator.set_clock_rate(768000);
-        emulator.set_sample_rate(APP->engine->getSampleRate());
+        // the first slot of the bank runs until another one is selected
+        bank.install(0, createEmulator());
+        emulator = bank.get(0);
+        oscillator.set_sample_rate(APP->engine->getSampleRate());
+        polyOscillator.set_sample_rate(APP->engine->getSampleRate());
         // initialize expander messages
         rightExpander.producerMessage = rightMessages[0];
         rightExpander.consumerMessage = rightMessages[1];
+        // reserve the buffers of states so saving does not allocate
+        for (auto& buffer : stateBuffers) buffer.reserve(StateLibrary::STATE_CAPACITY);
+    }
+
+    /// Create an emulator for the module.
+    ///
+    /// @returns a new emulator with the rates and the timeline of the module
+    ///
+    NES::Emulator* createEmulator() {
+        auto nes = new NES::Emulator;
+        // set the emulator's clock rate to the Rack rate
+        nes->set_clock_rate(768000);
+        // record the frames of the emulator to the module's timeline
+        nes->set_tracer(&tracer);
+        nes->set_sample_rate(APP->engine->getSampleRate());
+        return nes;
+    }
+
+    /// Load a ROM into a slot of the bank from the UI thread.
+    ///
+    /// @param slot the index of the slot to load the ROM into
+    /// @param path the path to the ROM to load
+    /// @details
+    /// The ROM is read and the emulator is set up on the calling thread, so
+    /// the engine only switches to the emulator.
+    ///
+    void loadBank(int slot, const std::string& path) {
+        if (!NES::Cartridge::is_valid_rom(path)) {
+            rom_load_failed_signal = true;
+            return;
+        }
+        auto nes = createEmulator();
+        if (!nes->load_game(path)) {
+            delete nes;
+            mapper_not_found_signal = true;
+            return;
+        }
+        bank.load(slot, nes);
+    }
+
+    /// Switch to the game in a slot of the bank.
+    ///
+    /// @param slot the index of the slot to switch to
+    /// @details
+    /// The game that was running stays in its slot as it was.
+    ///
+    void switchBank(int slot) {
+        if (bank.get(slot) == nullptr) return;
+        // the movie belongs to the emulator of the last game
+        setMovieState(MOVIE_STOPPED);
+        bankSlot = slot;
+        emulator = bank.get(slot);
+        // the snapshots of run-ahead belong to the last game
+        runAheadCount = 0;
+        openStateLibrary();
+        if (emulator->has_game())
+            copyScreen();
+        else
+            initalizeScreen();
+    }
+
+    /// Install the emulators from the UI thread and switch slots.
+    void updateBank() {
+        const unsigned changed = bank.update(bankSlot);
+        // the backup of a game that was replaced does not belong to the slot
+        if ((changed & (1u << backupSlot)) && backup != nullptr) {
+            json_decref(backup);
+            backup = nullptr;
+        }
+        if (bank_slot_signal >= 0) {
+            switchBank(bank_slot_signal);
+            bank_slot_signal = -1;
+        } else if (changed & (1u << bankSlot)) {
+            // the running slot was loaded with a new game
+            switchBank(bankSlot);
+        }
+    }
+
+    /// Start or stop recording or playing the movie of the inputs.
+    ///
+    /// @param value the new state of the movie
+    /// @details
+    /// Recording replaces the movie and starts it from the present state of
+    /// the emulator. Playing starts the movie from its first keyframe. A
+    /// movie of another game does not play.
+    ///
+    void setMovieState(MovieState value) {
+        movieRecorder.stop();
+        moviePlayer.stop();
+        movieState = MOVIE_STOPPED;
+        // the inputs of a movie reach the emulator on the cycle they were
+        // recorded at, so run-ahead does not rewind it while there is one
+        runAheadCount = 0;
+        if (value == MOVIE_RECORDING) {
+            if (movieRecorder.start(movie, *emulator)) movieState = MOVIE_RECORDING;
+        } else if (value == MOVIE_PLAYING) {
+            if (moviePlayer.start(movie, *emulator))
+                movieState = MOVIE_PLAYING;
+            else
+                movie_game_signal = true;
+        }
+    }
+
+    /// Set the mode of operation for the module.
+    ///
+    /// @param value the new mode of operation for the module
+    ///
+    void setMode(Mode value) {
+        mode = value;
+        // update the names of the player inputs to reflect the new mode
+        for (std::size_t i = 0; i < 16; i++)
+            inputInfos[INPUT_PLAYER1_A + i]->name = PLAYER_INPUT_NAMES[mode][i];
     }
 
     /// Handle a new ROM being loaded into the emulator.
@@ -202,10 +477,15 @@ struct RackNES : Module {
         // create a new emulator with the specified ROM and reset it
         if (NES::Cartridge::is_valid_rom(rom_path_signal)) {  // ROM file valid
             // if load game returns true, the load succeeded
-            if (emulator.load_game(rom_path_signal)) {
+            const uint64_t start = NES::Tracer::now();
+            setMovieState(MOVIE_STOPPED);
+            const bool is_loaded = emulator->load_game(rom_path_signal);
+            tracer.record("rom_load", NES::Tracer::EMULATOR_TRACK, start);
+            if (is_loaded) {
                 // remove the existing backup if there is one
                 if (backup != nullptr) delete backup;
                 backup = nullptr;
+                openStateLibrary();
                 // done loading, return to caller
                 return;
             }
@@ -222,14 +502,72 @@ struct RackNES : Module {
         }
     }
 
+    /// Save a snapshot of the emulator at the end of a frame for run-ahead.
+    inline void saveRunAhead() {
+        isRunAheadRewound = false;
+        if (runAhead == 0) {
+            runAheadCount = 0;
+            return;
+        }
+        emulator->save(runAheadSnapshots[runAheadHead]);
+        runAheadHead = (runAheadHead + 1) % MAX_RUN_AHEAD;
+        runAheadCount = std::min(runAheadCount + 1, static_cast<int>(MAX_RUN_AHEAD));
+    }
+
+    /// Write the controllers to the emulator.
+    ///
+    /// @param player1 the button bitmap of the player 1 controller
+    /// @param player2 the button bitmap of the player 2 controller
+    /// @details
+    /// With run-ahead, a change of the controllers rewinds the emulator to
+    /// the end of an earlier frame, applies the controllers there, and runs
+    /// back to the present without rendering (see Emulator::rewind). The
+    /// effects of the input then appear that many frames sooner. The
+    /// emulator rewinds at most once per frame, and later changes in the
+    /// same frame are applied in the present, so a press and a release in
+    /// one frame both reach the game and fast CV costs at most one rewind
+    /// per frame. The rest of the time, run-ahead costs a snapshot per frame.
+    ///
+    void setControllers(NES::NES_Byte player1, NES::NES_Byte player2) {
+        // the movie plays the controllers back
+        if (movieState == MOVIE_PLAYING) return;
+        const bool is_changed = player1 != lastPlayer1 || player2 != lastPlayer2;
+        lastPlayer1 = player1;
+        lastPlayer2 = player2;
+        movieRecorder.set_controllers(player1, player2);
+        if (!is_changed || isRunAheadRewound || runAhead == 0 || runAheadCount == 0 || movieState != MOVIE_STOPPED) {
+            emulator->set_controllers(player1, player2);
+            return;
+        }
+        const int frames = std::min(runAhead, runAheadCount);
+        const int index = (runAheadHead - frames + MAX_RUN_AHEAD) % MAX_RUN_AHEAD;
+        const uint64_t cycles = (frames - 1) * NES::CYCLES_PER_FRAME + emulator->get_frame_cycles();
+        // the snapshots after the loaded one are saved again on the way back
+        runAheadHead = (index + 1) % MAX_RUN_AHEAD;
+        runAheadCount -= frames - 1;
+        if (!emulator->rewind(runAheadSnapshots[index], player1, player2, cycles, [&]() { saveRunAhead(); })) {
+            runAheadCount = 0;
+            emulator->set_controllers(player1, player2);
+            return;
+        }
+        isRunAheadRewound = true;
+    }
+
     /// Initialize the screen with empty pixels.
     inline void initalizeScreen() {
-        std::memset(screen, 0, NES::Emulator::SCREEN_BYTES);
+        screen.clear();
     }
 
-    /// Copy the RGBA screen buffer from the NES to the local screen buffer.
+    /// Hand the RGBA screen buffer from the NES to the display.
     inline void copyScreen() {
-        std::memcpy(screen, emulator.get_screen_buffer(), NES::Emulator::SCREEN_BYTES);
+        screen.write(reinterpret_cast<const uint8_t*>(emulator->get_screen_buffer()));
+    }
+
+    /// Hand the palette indexes of the frame from the NES to the capture and
+    /// the shared memory export.
+    inline void exportFrame() {
+        capture.push_frame(emulator->get_ppu().get_pixels());
+        sharedExport.write_frame(emulator->get_ppu().get_pixels(), emulator->get_memory_buffer());
     }
 
     /// Return the clock speed of the NES.
@@ -244,6 +582,94 @@ struct RackNES : Module {
         return NES::CLOCK_RATE * powf(2.f, clamp(param + cv, -4.f, 4.f));
     }
 
+    /// Open the library of save states of the game in the emulator.
+    void openStateLibrary() {
+        pendingSaves = 0;
+        pendingLoad = -1;
+        if (!emulator->has_game()) {
+            library.open("", 0);
+            return;
+        }
+        // the directory is named by the ROM and its checksum, so renamed or
+        // patched ROMs do not share states
+        char checksum[9];
+        std::snprintf(checksum, sizeof checksum, "%08x", emulator->get_rom_checksum());
+        const auto name = rack::system::getStem(emulator->get_rom_path()) + "-" + checksum;
+        library.open(asset::user("RackNES/states/" + name), emulator->get_rom_checksum());
+    }
+
+    /// Save the state of the emulator to a target.
+    ///
+    /// @param slot the target to save to (0 for the backup, i for the slot
+    /// i - 1 of the library)
+    ///
+    void saveState(int slot) {
+        const uint64_t start = NES::Tracer::now();
+        if (slot == 0) {
+            // delete existing save
+            if (backup != nullptr) delete backup;
+            // create a new save of the NES state
+            backup = emulator->dataToJson();
+            backupSlot = bankSlot;
+        } else if (emulator->save_state(stateSnapshot, stateBuffers[slot - 1])) {
+            // the state is handed to the library by handlePendingStates
+            pendingSaves |= 1u << (slot - 1);
+        }
+        movieRecorder.save(*emulator, slot);
+        tracer.record("state_save", NES::Tracer::EMULATOR_TRACK, start);
+    }
+
+    /// Load the state of the emulator from a target.
+    ///
+    /// @param slot the target to load from (0 for the backup, i for the slot
+    /// i - 1 of the library)
+    ///
+    void loadState(int slot) {
+        // the movie plays the loads back
+        if (movieState == MOVIE_PLAYING) return;
+        if (slot == 0) {
+            // the backup only belongs to the game it was saved from
+            if (backup == nullptr || backupSlot != bankSlot) return;
+            const uint64_t start = NES::Tracer::now();
+            emulator->dataFromJson(backup);
+            movieRecorder.load(*emulator, 0);
+            runAheadCount = 0;
+            tracer.record("state_load", NES::Tracer::EMULATOR_TRACK, start);
+        } else {
+            // the state is read from the library by handlePendingStates
+            pendingLoad = slot - 1;
+        }
+    }
+
+    /// Hand saved states to the library and load states from it.
+    ///
+    /// @details
+    /// The library is never waited on; a request that finds it busy stays
+    /// pending until the next time the CV is processed. The saved states
+    /// are handed over one at a time, from the first slot.
+    ///
+    void handlePendingStates() {
+        if (pendingSaves != 0) {
+            int slot = 0;
+            while (!(pendingSaves & (1u << slot))) slot++;
+            if (library.save(slot, stateBuffers[slot]))
+                pendingSaves &= ~(1u << slot);
+        }
+        if (pendingLoad < 0) return;
+        const uint64_t start = NES::Tracer::now();
+        bool is_loaded = false;
+        const auto status = library.read(pendingLoad, [&](const uint8_t* data, std::size_t size) {
+            is_loaded = emulator->load_state(stateSnapshot, data, size);
+        });
+        if (status == StateLibrary::BUSY) return;
+        const int slot = pendingLoad + 1;
+        pendingLoad = -1;
+        if (!is_loaded) return;
+        movieRecorder.load(*emulator, slot);
+        runAheadCount = 0;
+        tracer.record("state_load", NES::Tracer::EMULATOR_TRACK, start);
+    }
+
     /// Process the inputs from the panel.
     void processCV() {
         // process the hang input for hanging the emulation
@@ -254,55 +680,198 @@ struct RackNES : Module {
 
         // NOTE: process the save, reset, restore in given order to ensure
         // that when all go high on the same frame, the emulator stays in its
-        // current state
+        // current state. A polyphonic save or load input targets the slot of
+        // the library of each channel instead of the selected target.
+        const int saveChannelCount = inputs[INPUT_SAVE].getChannels();
+        const int loadChannelCount = inputs[INPUT_LOAD].getChannels();
+        const int resetChannelCount = std::min(inputs[INPUT_RESET].getChannels(), static_cast<int>(ROMBank::NUM_SLOTS));
         // handle inputs to the save button and CV
         if (saveButton.process(
             params[PARAM_SAVE].getValue(),
-            inputs[INPUT_SAVE].getVoltage()
-        )) {
-            // delete existing save
-            if (backup != nullptr) delete backup;
-            // create a new save of the NES state
-            backup = emulator.dataToJson();
+            saveChannelCount > 1 ? 0.f : inputs[INPUT_SAVE].getVoltage()
+        )) saveState(stateSlot);
+        for (int channel = 0; saveChannelCount > 1 && channel < saveChannelCount; channel++) {
+            const float cv = inputs[INPUT_SAVE].getVoltage(channel);
+            if (saveChannels[channel].process(rescale(cv, 0.1, 2.0f, 0.f, 1.f))) saveState(channel + 1);
         }
         // handle inputs to the reset button and CV
         if (resetButton.process(
             params[PARAM_RESET].getValue(),
-            inputs[INPUT_RESET].getVoltage()
-        )) emulator.reset();
+            resetChannelCount > 1 ? 0.f : inputs[INPUT_RESET].getVoltage()
+        )) {
+            // a reset while the movie plays starts it over
+            if (movieState == MOVIE_PLAYING) {
+                moviePlayer.seek(*emulator, 0);
+            } else {
+                emulator->reset();
+                movieRecorder.reset();
+            }
+            runAheadCount = 0;
+        }
+        // a polyphonic reset cable switches to the slot of the bank of the
+        // channel that triggers
+        for (int channel = 0; resetChannelCount > 1 && channel < resetChannelCount; channel++) {
+            const float cv = inputs[INPUT_RESET].getVoltage(channel);
+            if (resetChannels[channel].process(rescale(cv, 0.1, 2.0f, 0.f, 1.f))) switchBank(channel);
+        }
         // handle inputs to the load button and CV
         if (loadButton.process(
             params[PARAM_LOAD].getValue(),
-            inputs[INPUT_LOAD].getVoltage()
-        ) && backup != nullptr) emulator.dataFromJson(backup);
+            loadChannelCount > 1 ? 0.f : inputs[INPUT_LOAD].getVoltage()
+        )) loadState(stateSlot);
+        for (int channel = 0; loadChannelCount > 1 && channel < loadChannelCount; channel++) {
+            const float cv = inputs[INPUT_LOAD].getVoltage(channel);
+            if (loadChannels[channel].process(rescale(cv, 0.1, 2.0f, 0.f, 1.f))) loadState(channel + 1);
+        }
+        handlePendingStates();
+
+        // the buttons on the panel are polled at the control rate, the gates
+        // of the player inputs are polled every sample by processControllers
+        for (std::size_t button = 0; button < 8; button++) {
+            player1Triggers[button].processButton(params[PARAM_PLAYER1_A + button].getValue());
+            player2Triggers[button].processButton(params[PARAM_PLAYER2_A + button].getValue());
+        }
+    }
 
+    /// Process the gates of the player inputs and write the controllers.
+    ///
+    /// @details
+    /// This runs every sample before the cycles of the sample, so an edge on
+    /// a gate reaches the emulator at the first CPU cycle of the sample it
+    /// occurs on, regardless of the control rate.
+    ///
+    void processControllers() {
         // get the controller for both players as a byte where each bit
         // represents the gate signal for whether one of the 8 buttons are
         // held
         NES::NES_Byte player1 = 0;
         NES::NES_Byte player2 = 0;
-        // iterate over the buttons
         for (std::size_t button = 0; button < 8; button++) {
-            {  // player 1 scope
-                // process the voltage with the Schmitt Trigger
-                player1Triggers[button].process(
-                    params[PARAM_PLAYER1_A + button].getValue(),
-                    inputs[INPUT_PLAYER1_A + button].getVoltage()
-                );
-                // the position for the current button's index
-                player1 += player1Triggers[button].isHigh() << button;
-            } {  // player 2 scope
-                // process the voltage with the Schmitt Trigger
-                player2Triggers[button].process(
-                    params[PARAM_PLAYER2_A + button].getValue(),
-                    inputs[INPUT_PLAYER2_A + button].getVoltage()
-                );
-                // the position for the current button's index
-                player2 += player2Triggers[button].isHigh() << button;
+            player1Triggers[button].processCV(inputs[INPUT_PLAYER1_A + button].getVoltage());
+            player1 |= player1Triggers[button].isHigh() << button;
+            player2Triggers[button].processCV(inputs[INPUT_PLAYER2_A + button].getVoltage());
+            player2 |= player2Triggers[button].isHigh() << button;
+        }
+        setControllers(player1, player2);
+    }
+
+    /// Process the inputs from the panel in oscillator mode.
+    void processOscillatorCV() {
+        // process the hang input for hanging the oscillator
+        hangButton.process(
+            params[PARAM_HANG].getValue(),
+            inputs[INPUT_HANG].getVoltage()
+        );
+        // handle inputs to the reset button and CV
+        if (resetButton.process(
+            params[PARAM_RESET].getValue(),
+            inputs[INPUT_RESET].getVoltage()
+        )) oscillator.reset();
+        // the clock speed acts as a master tune by scaling every frequency
+        const float tune = getClockSpeed() / static_cast<float>(NES::CLOCK_RATE);
+        // player 1 A, B, Select, and Start are the gates for the channels
+        // and Up, Down, Left, and Right are the V/oct inputs for them
+        bool gates[4];
+        float frequencies[4];
+        for (std::size_t i = 0; i < 4; i++) {
+            player1Triggers[i].process(
+                params[PARAM_PLAYER1_A + i].getValue(),
+                inputs[INPUT_PLAYER1_A + i].getVoltage()
+            );
+            gates[i] = player1Triggers[i].isHigh();
+            auto pitch = clamp(inputs[INPUT_PLAYER1_UP + i].getVoltage(), -10.f, 10.f);
+            frequencies[i] = tune * dsp::FREQ_C4 * powf(2.f, pitch);
+        }
+        // player 2 A, B, and Start are the volumes in [0V, 10V] -> [0, 15]
+        auto volume = [&](std::size_t input) {
+            auto voltage = inputs[input].getNormalVoltage(10.f);
+            return clamp(static_cast<int>(std::lround(1.5f * voltage)), 0, 15);
+        };
+        // player 2 Up and Down are the duty cycles in [0V, 10V] -> [0, 3]
+        auto duty = [&](std::size_t input) {
+            auto voltage = inputs[input].getNormalVoltage(5.f);
+            return clamp(static_cast<int>(voltage / 2.5f), 0, 3);
+        };
+        oscillator.set_square(NES::APUOscillator::SQUARE1, frequencies[0],
+            duty(INPUT_PLAYER2_UP), volume(INPUT_PLAYER2_A), gates[0]);
+        oscillator.set_square(NES::APUOscillator::SQUARE2, frequencies[1],
+            duty(INPUT_PLAYER2_DOWN), volume(INPUT_PLAYER2_B), gates[1]);
+        oscillator.set_triangle(frequencies[2], gates[2]);
+        // player 2 Right selects the short noise sequence when high
+        bool is_short = inputs[INPUT_PLAYER2_RIGHT].getVoltage() >= 1.f;
+        oscillator.set_noise(frequencies[3], is_short, volume(INPUT_PLAYER2_START), gates[3]);
+        // player 2 Select is the level of the DMC DAC in [0V, 10V] -> [0, 127]
+        auto level = inputs[INPUT_PLAYER2_SELECT].getVoltage();
+        oscillator.set_dmc(clamp(static_cast<int>(12.7f * level), 0, 127));
+    }
+
+    /// Process the inputs from the panel in polyphonic mode.
+    void processPolyphonicCV() {
+        // process the hang input for hanging the oscillators
+        hangButton.process(
+            params[PARAM_HANG].getValue(),
+            inputs[INPUT_HANG].getVoltage()
+        );
+        // handle inputs to the reset button and CV
+        if (resetButton.process(
+            params[PARAM_RESET].getValue(),
+            inputs[INPUT_RESET].getVoltage()
+        )) polyOscillator.reset();
+        // the clock speed acts as a master tune by scaling every frequency
+        const float tune = getClockSpeed() / static_cast<float>(NES::CLOCK_RATE);
+        // the number of voices is the most channels on a gate or V/oct input
+        int channels = 1;
+        for (std::size_t i = 0; i < 4; i++) {
+            channels = std::max(channels, inputs[INPUT_PLAYER1_A + i].getChannels());
+            channels = std::max(channels, inputs[INPUT_PLAYER1_UP + i].getChannels());
+        }
+        polyOscillator.set_num_voices(channels);
+        for (std::size_t i = 0; i < 4; i++) {
+            // the panel buttons hold the gates of every voice
+            const bool button = params[PARAM_PLAYER1_A + i].getValue();
+            auto& input = inputs[INPUT_PLAYER1_A + i];
+            for (int c = 0; c < channels; c++) {
+                polyGateTriggers[i][c].process(rescale(input.getPolyVoltage(c), 0.1, 2.f, 0.f, 1.f));
+                polyControls.gate[i][c] = button || polyGateTriggers[i][c].isHigh();
+            }
+            // convert the pitches to frequencies four voices at a time
+            for (int c = 0; c < channels; c += 4) {
+                auto pitch = inputs[INPUT_PLAYER1_UP + i].getPolyVoltageSimd<simd::float_4>(c);
+                pitch = simd::clamp(pitch, -10.f, 10.f);
+                auto frequency = tune * dsp::FREQ_C4 * dsp::exp2_taylor5(pitch);
+                frequency.store(&polyControls.frequency[i][c]);
+            }
+        }
+        // player 2 A, B, and Start are the volumes in [0V, 10V] -> [0, 15]
+        // and player 2 Up and Down are the duty cycles in [0V, 10V] -> [0, 3]
+        static constexpr InputIds VOLUMES[3] = {INPUT_PLAYER2_A, INPUT_PLAYER2_B, INPUT_PLAYER2_START};
+        static constexpr InputIds DUTIES[2] = {INPUT_PLAYER2_UP, INPUT_PLAYER2_DOWN};
+        for (int c = 0; c < channels; c++) {
+            for (std::size_t i = 0; i < 3; i++) {
+                auto voltage = inputs[VOLUMES[i]].getNormalPolyVoltage(10.f, c);
+                polyControls.volume[i][c] = clamp(static_cast<int>(std::lround(1.5f * voltage)), 0, 15);
+            }
+            for (std::size_t i = 0; i < 2; i++) {
+                auto voltage = inputs[DUTIES[i]].getNormalPolyVoltage(5.f, c);
+                polyControls.duty[i][c] = clamp(static_cast<int>(voltage / 2.5f), 0, 3);
             }
+            // player 2 Right selects the short noise sequence when high
+            polyControls.is_short[c] = inputs[INPUT_PLAYER2_RIGHT].getPolyVoltage(c) >= 1.f;
+            // player 2 Select is the level of the DMC DAC in [0V, 10V] -> [0, 127]
+            auto level = inputs[INPUT_PLAYER2_SELECT].getPolyVoltage(c);
+            polyControls.dmc[c] = clamp(static_cast<int>(12.7f * level), 0, 127);
+        }
+        polyOscillator.update(polyControls);
+        // the channel knobs set the level of each channel in the voice mix.
+        // only update the synthesizers when a level changes
+        float levels[NES::APU::NUM_CHANNELS];
+        bool is_changed = false;
+        for (std::size_t i = 0; i < NES::APU::NUM_CHANNELS; i++) {
+            levels[i] = params[PARAM_CH + i].getValue();
+            is_changed |= levels[i] != polyLevels[i];
+            polyLevels[i] = levels[i];
         }
-        // set the controller values
-        emulator.set_controllers(player1, player2);
+        if (is_changed) polyOscillator.set_levels(levels);
     }
 
     /// Process messages to/from expander modules.
@@ -316,7 +885,7 @@ struct RackNES : Module {
                 for (int i = 0; i < 16; i += 2) {
                     if (message[i] != 0) {  // data available for consumption
                         // write the address, data tuple to the emulator
-                        emulator.get_memory_buffer()[message[i]] = message[i + 1];
+                        emulator->get_memory_buffer()[message[i]] = message[i + 1];
                         // consume the data by setting the address to 0
                         message[i] = 0;
                     }
@@ -336,8 +905,41 @@ struct RackNES : Module {
         }
     }
 
+    /// @brief Record the time of a sample to the block of the host engine
+    /// that it belongs to.
+    ///
+    /// @param start the time that the sample started processing at
+    /// @param end the time that the sample finished processing at
+    ///
+    /// @details
+    /// The host calls process() once per sample in blocks; a block ends
+    /// when the engine moves to the next one, and only the time between the
+    /// first and last sample of the block is recorded.
+    ///
+    void traceSample(uint64_t start, uint64_t end) {
+        const int64_t block = APP->engine->getBlock();
+        if (block != traceBlock) {
+            if (traceBlock != -1)
+                tracer.record("process", NES::Tracer::HOST_TRACK, traceBlockStart, traceBlockEnd);
+            traceBlock = block;
+            traceBlockStart = start;
+        }
+        traceBlockEnd = end;
+    }
+
     /// Process a sample.
     void process(const ProcessArgs &args) override {
+        if (!tracer.is_active()) {
+            traceBlock = -1;
+            return processSample(args);
+        }
+        const uint64_t start = NES::Tracer::now();
+        processSample(args);
+        traceSample(start, NES::Tracer::now());
+    }
+
+    /// Process a sample of the emulator.
+    void processSample(const ProcessArgs &args) {
         // check for a new ROM to load
         if (!rom_path_signal.empty()) {
             handleNewROM();
@@ -346,31 +948,84 @@ struct RackNES : Module {
             // set the sample rate of the emulator
             // onSampleRateChange();
         }
+        // check for a change of the state of the movie
+        if (movie_signal >= 0) {
+            setMovieState(static_cast<MovieState>(movie_signal));
+            movie_signal = -1;
+        }
 
         // process CV if the CV clock divider is high
-        if (cvDivider.process())
-            processCV();
+        if (cvDivider.process()) {
+            updateBank();
+            if (mode == MODE_OSCILLATOR)
+                processOscillatorCV();
+            else if (mode == MODE_POLYPHONIC)
+                processPolyphonicCV();
+            else
+                processCV();
+        }
+        // process the player gates at every sample step
+        if (mode == MODE_EMULATOR) processControllers();
         // process expanders at every sample step
         processExpanders();
 
         // stop processing if the hang button is high
         if (hangButton.isHigh()) return;
 
-        // run the number of cycles through the NES that are required. pass a
-        // callback to copy the screen every time a new frame renders
-        for (std::size_t i = 0; i < getClockSpeed() / args.sampleRate; i++)
-            emulator.cycle([&]() { copyScreen(); });
+        // the polyphonic mode changes the channels of the outputs, which
+        // setVoltage leaves alone, so they are set back when the mode changes
+        if (mode != outputMode) {
+            for (std::size_t i = 0; i < NES::APU::NUM_CHANNELS; i++)
+                outputs[OUTPUT_CH + i].setChannels(1);
+            outputs[OUTPUT_MIX].setChannels(1);
+            outputMode = mode;
+        }
 
-        // set the clock output based on the NES frame-rate
-        outputs[OUTPUT_CLOCK].setVoltage(10.f * emulator.is_clock_high());
+        if (mode == MODE_POLYPHONIC) {
+            // run the voices for one sample and output them as one cable
+            polyOscillator.process();
+            outputs[OUTPUT_CLOCK].setVoltage(0.f);
+            for (std::size_t i = 0; i < NES::APU::NUM_CHANNELS; i++)
+                outputs[OUTPUT_CH + i].setChannels(0);
+            float voltages[NES::APUPolyOscillator::MAX_VOICES];
+            polyOscillator.get_voltages(voltages, params[PARAM_MIX].getValue());
+            outputs[OUTPUT_MIX].setChannels(polyOscillator.get_num_voices());
+            outputs[OUTPUT_MIX].writeVoltages(voltages);
+            return;
+        } else if (mode == MODE_OSCILLATOR) {
+            // run the APU for one sample, there is no frame clock to output
+            oscillator.process();
+            outputs[OUTPUT_CLOCK].setVoltage(0.f);
+        } else {
+            // run the number of cycles through the NES that are required.
+            // pass a callback to copy the screen every time a frame renders
+            const uint64_t cycles = getClockSpeed() / args.sampleRate;
+            if (movieState == MOVIE_PLAYING) {
+                // the movie stops at its end and the game plays on
+                if (!moviePlayer.run(*emulator, cycles, [&]() { copyScreen(); exportFrame(); }))
+                    movieState = MOVIE_STOPPED;
+            } else {
+                for (uint64_t i = 0; i < cycles; i++)
+                    emulator->cycle([&]() { copyScreen(); exportFrame(); saveRunAhead(); });
+                movieRecorder.advance(*emulator, cycles);
+            }
+            // set the clock output based on the NES frame-rate
+            outputs[OUTPUT_CLOCK].setVoltage(10.f * emulator->is_clock_high());
+        }
         // create a placeholder for the mix output
         float mix = 0.f;
+        // the 16-bit samples of the channels for the capture
+        int16_t samples[NES::APU::NUM_CHANNELS];
         // iterate over the synthesis channels on the NES
         for (std::size_t i = 0; i < NES::APU::NUM_CHANNELS; i++) {
             // get the level of the channel from the knob's position
             auto level = params[PARAM_CH + i].getValue();
+            // get the voltage of the channel before its level
+            const float output = mode == MODE_OSCILLATOR ?
+                oscillator.get_voltage(i) : emulator->get_audio_voltage(i);
+            samples[i] = std::lround(output * (std::numeric_limits<int16_t>::max() / 10.f));
             // get the voltage for this channel
-            auto voltage = level * emulator.get_audio_voltage(i);
+            auto voltage = level * output;
             // integrate the voltage to the mix if the channel is not connected
             if (!outputs[OUTPUT_CH + i].isConnected()) mix += voltage;
             // set the output voltage for the channel
@@ -378,27 +1033,81 @@ struct RackNES : Module {
         }
         // set the output voltage for the channel mix
         outputs[OUTPUT_MIX].setVoltage(params[PARAM_MIX].getValue() * mix);
+        // the capture and the export follow the frames of the emulator
+        if (mode == MODE_EMULATOR) {
+            capture.push_sample(samples);
+            sharedExport.write_sample(samples);
+        }
     }
 
     /// @brief Respond to sample rate of the host environment changing.
     void onSampleRateChange() override {
-        emulator.set_sample_rate(APP->engine->getSampleRate());
+        for (int i = 0; i < ROMBank::NUM_SLOTS; i++)
+            if (bank.get(i) != nullptr) bank.get(i)->set_sample_rate(APP->engine->getSampleRate());
+        oscillator.set_sample_rate(APP->engine->getSampleRate());
+        polyOscillator.set_sample_rate(APP->engine->getSampleRate());
+        sharedExport.set_sample_rate(APP->engine->getSampleRate());
     }
 
     /// @brief Respond to the module being reset by the host environment.
     void onReset() override {
-        emulator.remove_game();
+        setMovieState(MOVIE_STOPPED);
+        setMode(MODE_EMULATOR);
+        oscillator.reset();
+        polyOscillator.reset();
+        emulator->remove_game();
+        // empty the other slots of the bank
+        for (int i = 0; i < ROMBank::NUM_SLOTS; i++)
+            if (i != bankSlot) bank.load(i, nullptr);
+        runAhead = 0;
+        runAheadCount = 0;
+        cvDivider.setDivision(16);
         if (backup != nullptr) { delete backup; backup = nullptr; }
+        stateSlot = 0;
+        openStateLibrary();
         initalizeScreen();
     }
 
+    /// @brief Convert the state of an emulator to a JSON object for the patch.
+    ///
+    /// @param nes the emulator to convert
+    /// @returns a pointer to a new json_t object with the emulator's state
+    /// @details
+    /// The RAM of a game with a battery is kept in its save file, so the
+    /// patch leaves it out and does not overwrite the save file when it is
+    /// opened again.
+    ///
+    static json_t* emulatorToJson(const NES::Emulator* nes) {
+        json_t* rootJ = nes->dataToJson();
+        if (nes->has_save_file())
+            json_object_del(json_object_get(rootJ, "bus"), "extended_ram");
+        return rootJ;
+    }
+
     /// @brief Convert the module's state to a JSON object.
     ///
     /// @returns a pointer to a new json_t object with the module's state
     ///
     json_t* dataToJson() override {
         json_t* rootJ = json_object();
-        json_object_set_new(rootJ, "emulator", emulator.dataToJson());
+        json_object_set_new(rootJ, "mode", json_integer(mode));
+        json_object_set_new(rootJ, "show_profile", json_boolean(showProfile));
+        json_object_set_new(rootJ, "run_ahead", json_integer(runAhead));
+        json_object_set_new(rootJ, "cv_division", json_integer(cvDivider.getDivision()));
+        json_object_set_new(rootJ, "state_slot", json_integer(stateSlot));
+        json_object_set_new(rootJ, "emulator", emulatorToJson(emulator));
+        json_object_set_new(rootJ, "bank_slot", json_integer(bankSlot));
+        // the games of the other slots of the bank (null for empty slots)
+        json_t* bankJ = json_array();
+        for (int i = 0; i < ROMBank::NUM_SLOTS; i++) {
+            NES::Emulator* nes = bank.get(i);
+            if (i == bankSlot || nes == nullptr)
+                json_array_append_new(bankJ, json_null());
+            else
+                json_array_append_new(bankJ, emulatorToJson(nes));
+        }
+        json_object_set_new(rootJ, "bank", bankJ);
+        json_object_set_new(rootJ, "backup_slot", json_integer(backupSlot));
         // make sure there is a backup JSON before trying to save it
         if (backup != nullptr) {
             json_object_set_new(rootJ, "backup", json_deep_copy(backup));
@@ -411,14 +1120,70 @@ struct RackNES : Module {
     /// @param rootJ a pointer to a json_t with state data for this module
     ///
     void dataFromJson(json_t* rootJ) override {
+        setMovieState(MOVIE_STOPPED);
+        // load mode
+        {
+            json_t* json_data = json_object_get(rootJ, "mode");
+            if (json_data)
+                setMode(static_cast<Mode>(clamp(static_cast<int>(json_integer_value(json_data)), 0, NUM_MODES - 1)));
+        }
+        // load show_profile
+        {
+            json_t* json_data = json_object_get(rootJ, "show_profile");
+            if (json_data) showProfile = json_boolean_value(json_data);
+        }
+        // load run_ahead
+        {
+            json_t* json_data = json_object_get(rootJ, "run_ahead");
+            if (json_data)
+                runAhead = clamp(static_cast<int>(json_integer_value(json_data)), 0, MAX_RUN_AHEAD);
+        }
+        runAheadCount = 0;
+        // load cv_division
+        {
+            json_t* json_data = json_object_get(rootJ, "cv_division");
+            if (json_data)
+                cvDivider.setDivision(clamp(static_cast<int>(json_integer_value(json_data)), 1, MAX_CV_DIVISION));
+        }
+        // load state_slot
+        {
+            json_t* json_data = json_object_get(rootJ, "state_slot");
+            if (json_data)
+                stateSlot = clamp(static_cast<int>(json_integer_value(json_data)), 0, StateLibrary::NUM_SLOTS);
+        }
+        // load bank (the engine is not running, so the slots are replaced
+        // directly)
+        {
+            json_t* json_data = json_object_get(rootJ, "bank_slot");
+            if (json_data)
+                bankSlot = clamp(static_cast<int>(json_integer_value(json_data)), 0, ROMBank::NUM_SLOTS - 1);
+            json_t* bankJ = json_object_get(rootJ, "bank");
+            for (int i = 0; i < ROMBank::NUM_SLOTS; i++) {
+                json_t* slotJ = bankJ ? json_array_get(bankJ, i) : nullptr;
+                NES::Emulator* nes = nullptr;
+                if (i == bankSlot || (slotJ && !json_is_null(slotJ))) nes = createEmulator();
+                if (nes != nullptr && i != bankSlot && !nes->dataFromJson(slotJ)) {
+                    delete nes;
+                    nes = nullptr;
+                }
+                bank.install(i, nes);
+            }
+            emulator = bank.get(bankSlot);
+        }
+        // load backup_slot
+        {
+            json_t* json_data = json_object_get(rootJ, "backup_slot");
+            backupSlot = json_data ? clamp(static_cast<int>(json_integer_value(json_data)), 0, ROMBank::NUM_SLOTS - 1) : bankSlot;
+        }
         json_t* emulator_data = json_object_get(rootJ, "emulator");
         // load emulator
         if (emulator_data) {
             // set the reload signal based on whether the reload from JSON
             // succeeded. dataFromJson returns true for success, false for fail
-            rom_reload_failed_signal = !emulator.dataFromJson(emulator_data);
+            rom_reload_failed_signal = !emulator->dataFromJson(emulator_data);
             // if the reload failed, get out of here
             if (rom_reload_failed_signal) return;
+            openStateLibrary();
         }
         // load backup
         json_t* backup_data = json_object_get(rootJ, "backup");
@@ -432,6 +1197,9 @@ struct RackNES : Module {
     }
 };
 
+// the table is indexed at run time, so it needs a definition before C++17
+constexpr const char* RackNES::PLAYER_INPUT_NAMES[RackNES::NUM_MODES][16];
+
 // ---------------------------------------------------------------------------
 // MARK: Widget
 // ---------------------------------------------------------------------------
@@ -444,7 +1212,7 @@ struct ROMMenuItem : MenuItem {
     /// Respond to an action on the menu item.
     void onAction(const event::Action &e) override {
         // check for a ROM path to use as an existing directory
-        auto rom_path = module->emulator.get_rom_path();
+        auto rom_path = module->emulator->get_rom_path();
         // if the ROM path is empty, fall back on the user's home directory
         auto dir = rom_path.empty() ?
             asset::user("") : rack::system::getDirectory(rom_path);
@@ -459,6 +1227,397 @@ struct ROMMenuItem : MenuItem {
     }
 };
 
+/// A menu item for switching to a slot of the bank.
+struct BankPlayMenuItem : MenuItem {
+    /// the module associated with the menu item
+    RackNES* module = nullptr;
+    /// the slot of the bank for this menu item
+    int slot = 0;
+
+    /// Respond to an action on the menu item.
+    void onAction(const event::Action &e) override { module->bank_slot_signal = slot; }
+};
+
+/// A menu item for loading a ROM into a slot of the bank.
+struct BankLoadMenuItem : MenuItem {
+    /// the module associated with the menu item
+    RackNES* module = nullptr;
+    /// the slot of the bank for this menu item
+    int slot = 0;
+
+    /// Respond to an action on the menu item.
+    void onAction(const event::Action &e) override {
+        auto rom_path = module->emulator->get_rom_path();
+        auto dir = rom_path.empty() ?
+            asset::user("") : rack::system::getDirectory(rom_path);
+        auto filter = osdialog_filters_parse("NES ROM:nes,NES");
+        auto path = osdialog_file(OSDIALOG_OPEN, dir.c_str(), NULL, filter);
+        osdialog_filters_free(filter);
+        if (path) {  // the user selected a path
+            module->loadBank(slot, path);
+            free(path);
+        }
+    }
+};
+
+/// A menu item for removing the game from a slot of the bank.
+struct BankEmptyMenuItem : MenuItem {
+    /// the module associated with the menu item
+    RackNES* module = nullptr;
+    /// the slot of the bank for this menu item
+    int slot = 0;
+
+    /// Respond to an action on the menu item.
+    void onAction(const event::Action &e) override { module->bank.load(slot, nullptr); }
+};
+
+/// A menu item with a submenu of the actions on a slot of the bank.
+struct BankSlotMenuItem : MenuItem {
+    /// the module associated with the menu item
+    RackNES* module = nullptr;
+    /// the slot of the bank for this menu item
+    int slot = 0;
+
+    /// Create the submenu of actions.
+    ui::Menu* createChildMenu() override {
+        auto menu = new ui::Menu;
+        const bool is_empty = module->bank.get(slot) == nullptr;
+        auto play = createMenuItem<BankPlayMenuItem>("Play");
+        play->module = module;
+        play->slot = slot;
+        play->disabled = is_empty || slot == module->bankSlot;
+        menu->addChild(play);
+        auto load = createMenuItem<BankLoadMenuItem>("Load ROM...");
+        load->module = module;
+        load->slot = slot;
+        menu->addChild(load);
+        auto empty = createMenuItem<BankEmptyMenuItem>("Empty");
+        empty->module = module;
+        empty->slot = slot;
+        empty->disabled = is_empty || slot == module->bankSlot;
+        menu->addChild(empty);
+        return menu;
+    }
+};
+
+/// A menu item for selecting the mode of operation of the module.
+struct ModeMenuItem : MenuItem {
+    /// the module associated with the menu item
+    RackNES* module = nullptr;
+    /// the mode of operation for this menu item
+    RackNES::Mode mode = RackNES::MODE_EMULATOR;
+
+    /// Respond to an action on the menu item.
+    void onAction(const event::Action &e) override { module->setMode(mode); }
+};
+
+/// A menu item for selecting the number of frames to run ahead.
+struct RunAheadMenuItem : MenuItem {
+    /// the module associated with the menu item
+    RackNES* module = nullptr;
+    /// the number of frames to run ahead for this menu item
+    int frames = 0;
+
+    /// Respond to an action on the menu item.
+    void onAction(const event::Action &e) override { module->runAhead = frames; }
+};
+
+/// A menu item for selecting the number of samples between CV acquisitions.
+struct ControlRateMenuItem : MenuItem {
+    /// the module associated with the menu item
+    RackNES* module = nullptr;
+    /// the number of samples between CV acquisitions for this menu item
+    int division = 16;
+
+    /// Respond to an action on the menu item.
+    void onAction(const event::Action &e) override {
+        module->cvDivider.setDivision(division);
+    }
+};
+
+/// A menu item for selecting the target of the save and load inputs.
+struct StateSlotMenuItem : MenuItem {
+    /// the module associated with the menu item
+    RackNES* module = nullptr;
+    /// the target for this menu item (0 for the backup, i for the slot i - 1
+    /// of the library)
+    int slot = 0;
+
+    /// Respond to an action on the menu item.
+    void onAction(const event::Action &e) override { module->stateSlot = slot; }
+};
+
+/// A menu item with a submenu of the targets of the save and load inputs.
+struct StateTargetMenuItem : MenuItem {
+    /// the module associated with the menu item
+    RackNES* module = nullptr;
+
+    /// Create the submenu of targets.
+    ui::Menu* createChildMenu() override {
+        auto menu = new ui::Menu;
+        auto backup = createMenuItem<StateSlotMenuItem>("Backup (in patch)", CHECKMARK(module->stateSlot == 0));
+        backup->module = module;
+        menu->addChild(backup);
+        for (int i = 0; i < StateLibrary::NUM_SLOTS; i++) {
+            auto name = module->library.get_name(i);
+            if (name.empty()) name = "State " + std::to_string(i + 1);
+            name = std::to_string(i + 1) + ": " + name;
+            auto item = createMenuItem<StateSlotMenuItem>(name, CHECKMARK(module->stateSlot == i + 1));
+            // show which slots are empty
+            if (!module->library.has_state(i)) item->rightText = "empty " + item->rightText;
+            item->module = module;
+            item->slot = i + 1;
+            menu->addChild(item);
+        }
+        return menu;
+    }
+};
+
+/// A text field for naming the selected slot of the library.
+struct StateNameField : ui::TextField {
+    /// the module associated with the text field
+    RackNES* module = nullptr;
+    /// the index of the slot that the text field names
+    int slot = 0;
+
+    /// Respond to a change of the text.
+    void onChange(const event::Change& e) override {
+        if (text != module->library.get_name(slot)) module->library.set_name(slot, text);
+    }
+};
+
+/// A menu item for removing the state of the selected slot of the library.
+struct ClearStateMenuItem : MenuItem {
+    /// the module associated with the menu item
+    RackNES* module = nullptr;
+
+    /// Respond to an action on the menu item.
+    void onAction(const event::Action &e) override {
+        module->library.clear(module->stateSlot - 1);
+    }
+};
+
+/// A menu item for changing the state of the movie of the inputs.
+struct MovieStateMenuItem : MenuItem {
+    /// the module associated with the menu item
+    RackNES* module = nullptr;
+    /// the state of the movie for this menu item
+    RackNES::MovieState state = RackNES::MOVIE_STOPPED;
+
+    /// Respond to an action on the menu item.
+    void onAction(const event::Action &e) override {
+        // choosing the present state again stops the movie
+        module->movie_signal = module->movieState == state ? RackNES::MOVIE_STOPPED : state;
+    }
+};
+
+/// A menu item for writing the movie of the inputs to a file.
+struct SaveMovieMenuItem : MenuItem {
+    /// the module associated with the menu item
+    RackNES* module = nullptr;
+
+    /// Respond to an action on the menu item.
+    void onAction(const event::Action &e) override {
+        auto name = rack::system::getStem(module->emulator->get_rom_path()) + ".nesm";
+        auto filter = osdialog_filters_parse("NES movie:nesm");
+        auto path = osdialog_file(OSDIALOG_SAVE, asset::user("").c_str(), name.c_str(), filter);
+        osdialog_filters_free(filter);
+        if (path) {  // the user selected a path
+            if (!module->movie.save(path))
+                osdialog_message(OSDIALOG_ERROR, OSDIALOG_OK, "Movie file failed to save!");
+            free(path);
+        }
+    }
+};
+
+/// A menu item for reading the movie of the inputs from a file.
+struct OpenMovieMenuItem : MenuItem {
+    /// the module associated with the menu item
+    RackNES* module = nullptr;
+
+    /// Respond to an action on the menu item.
+    void onAction(const event::Action &e) override {
+        auto filter = osdialog_filters_parse("NES movie:nesm");
+        auto path = osdialog_file(OSDIALOG_OPEN, asset::user("").c_str(), NULL, filter);
+        osdialog_filters_free(filter);
+        if (path) {  // the user selected a path
+            // the engine does not touch the movie while it is stopped
+            if (!module->movie.load(path))
+                osdialog_message(OSDIALOG_ERROR, OSDIALOG_OK, "Movie file failed to load!");
+            free(path);
+        }
+    }
+};
+
+/// A menu item for starting and stopping a capture of the frames and audio.
+struct CaptureMenuItem : MenuItem {
+    /// the module associated with the menu item
+    RackNES* module = nullptr;
+
+    /// Respond to an action on the menu item.
+    void onAction(const event::Action &e) override {
+        if (module->capture.is_active()) {  // finish the current capture
+            module->capture.stop();
+            return;
+        }
+        auto name = rack::system::getStem(module->emulator->get_rom_path()) + ".y4m";
+        auto filter = osdialog_filters_parse("YUV4MPEG2 video:y4m");
+        auto path = osdialog_file(OSDIALOG_SAVE, asset::user("").c_str(), name.c_str(), filter);
+        osdialog_filters_free(filter);
+        if (path) {  // the user selected a path
+            // the audio is written next to the video
+            auto audio = rack::system::join(rack::system::getDirectory(path), rack::system::getStem(path) + ".wav");
+            if (!module->capture.start(path, audio, APP->engine->getSampleRate()))
+                osdialog_message(OSDIALOG_ERROR, OSDIALOG_OK, "Capture files failed to open!");
+            free(path);
+        }
+    }
+};
+
+/// A menu item for sharing the frames, RAM, and audio with other processes.
+struct SharedExportMenuItem : MenuItem {
+    /// the module associated with the menu item
+    RackNES* module = nullptr;
+
+    /// Respond to an action on the menu item.
+    void onAction(const event::Action &e) override {
+        if (module->sharedExport.is_active()) {  // remove the shared memory
+            module->sharedExport.close();
+            return;
+        }
+        const auto name = NES::SharedExport::get_default_name(module->id);
+        if (!module->sharedExport.open(name, APP->engine->getSampleRate()))
+            osdialog_message(OSDIALOG_ERROR, OSDIALOG_OK, "Shared memory failed to open!");
+    }
+};
+
+/// A menu item for showing the profiling counters over the screen.
+struct ShowProfileMenuItem : MenuItem {
+    /// the module associated with the menu item
+    RackNES* module = nullptr;
+
+    /// Respond to an action on the menu item.
+    void onAction(const event::Action &e) override {
+        module->showProfile = !module->showProfile;
+    }
+};
+
+/// A menu item for exporting the profiling counters to a JSON file.
+struct ExportProfileMenuItem : MenuItem {
+    /// the module associated with the menu item
+    RackNES* module = nullptr;
+
+    /// Respond to an action on the menu item.
+    void onAction(const event::Action &e) override {
+        auto filter = osdialog_filters_parse("JSON:json");
+        auto path = osdialog_file(OSDIALOG_SAVE, asset::user("").c_str(), "RackNES-profile.json", filter);
+        osdialog_filters_free(filter);
+        if (path) {  // the user selected a path
+            json_t* rootJ = module->emulator->get_profile().dataToJson();
+            json_dump_file(rootJ, path, JSON_INDENT(2));
+            json_decref(rootJ);
+            free(path);
+        }
+    }
+};
+
+/// A menu item for starting and stopping a timeline trace recording.
+struct TraceMenuItem : MenuItem {
+    /// the module associated with the menu item
+    RackNES* module = nullptr;
+
+    /// Respond to an action on the menu item.
+    void onAction(const event::Action &e) override {
+        if (module->tracer.is_active()) {  // finish the current recording
+            module->tracer.stop();
+            return;
+        }
+        auto filter = osdialog_filters_parse("JSON:json");
+        auto path = osdialog_file(OSDIALOG_SAVE, asset::user("").c_str(), "RackNES-trace.json", filter);
+        osdialog_filters_free(filter);
+        if (path) {  // the user selected a path
+            module->tracer.start(path);
+            free(path);
+        }
+    }
+};
+
+/// An overlay that shows the profiling counters of the emulator.
+struct ProfileOverlay : TransparentWidget {
+    /// the period to measure the rates of the counters over in seconds
+    static constexpr double PERIOD = 0.5;
+    /// the module to show the counters of
+    RackNES* module = nullptr;
+    /// the counters at the start of the current period
+    NES::Profile last;
+    /// the lines of text that describe the last period
+    std::vector<std::string> lines;
+
+    /// Update the text at the end of every period.
+    void step() override {
+        TransparentWidget::step();
+        if (module == nullptr || !module->showProfile) return;
+        const auto profile = module->emulator->get_profile();
+        const auto delta = profile - last;
+        if (delta.wall < PERIOD) return;
+        last = profile;
+        lines.clear();
+        // the rates of the clock, frames, instructions, and dots
+        lines.push_back(string::f("%.3f MHz  %.1f fps",
+            delta.cycles / delta.wall * 1e-6, delta.cycles / delta.wall / NES::CYCLES_PER_FRAME));
+        lines.push_back(string::f("%.3f MIPS  %.2f Mdots/s",
+            delta.instructions / delta.wall * 1e-6, delta.dots / delta.wall * 1e-6));
+        // the load of each stage as a percentage of one core
+        std::string stages;
+        for (int i = 0; i < NES::Profiler::NUM_STAGES; i++) {
+            const auto stage = static_cast<NES::Profiler::Stage>(i);
+            stages += string::f("%s %.1f%%  ", NES::Profiler::get_name(stage), 100 * delta.seconds[i] / delta.wall);
+            if (i % 3 == 2 || i == NES::Profiler::NUM_STAGES - 1) {
+                lines.push_back(stages);
+                stages.clear();
+            }
+        }
+        // the three most accessed I/O registers
+        std::size_t order[NES::NUM_IO_REGISTERS];
+        for (std::size_t i = 0; i < NES::NUM_IO_REGISTERS; i++) order[i] = i;
+        auto accesses = [&](std::size_t i) { return delta.io_reads[i] + delta.io_writes[i]; };
+        std::partial_sort(order, order + 3, order + NES::NUM_IO_REGISTERS,
+            [&](std::size_t a, std::size_t b) { return accesses(a) > accesses(b); });
+        std::string registers;
+        for (std::size_t i = 0; i < 3 && accesses(order[i]); i++) {
+            registers += string::f("$%04X %.1fk/s  ",
+                NES::io_register_address(order[i]), accesses(order[i]) / delta.wall * 1e-3);
+        }
+        if (!registers.empty()) lines.push_back(registers);
+    }
+
+    /// Draw the text over the screen.
+    ///
+    /// @param args the arguments for the draw context for this widget
+    /// @param layer the layer to draw on
+    ///
+    void drawLayer(const DrawArgs& args, int layer) override {
+        // the height of a line of text
+        static constexpr float LINE_HEIGHT = 11.f;
+        if (layer == 1 && module != nullptr && module->showProfile && !lines.empty()) {
+            auto font = APP->window->loadFont(asset::system("res/fonts/ShareTechMono-Regular.ttf"));
+            if (font && font->handle >= 0) {
+                nvgBeginPath(args.vg);
+                nvgRect(args.vg, 0, 0, box.size.x, 4 + LINE_HEIGHT * lines.size());
+                nvgFillColor(args.vg, nvgRGBA(0, 0, 0, 192));
+                nvgFill(args.vg);
+                nvgFontFaceId(args.vg, font->handle);
+                nvgFontSize(args.vg, 10.f);
+                nvgTextAlign(args.vg, NVG_ALIGN_LEFT | NVG_ALIGN_TOP);
+                nvgFillColor(args.vg, nvgRGB(0x7f, 0xff, 0x7f));
+                for (std::size_t i = 0; i < lines.size(); i++)
+                    nvgText(args.vg, 4, 2 + LINE_HEIGHT * i, lines[i].c_str(), NULL);
+            }
+        }
+        TransparentWidget::drawLayer(args, layer);
+    }
+};
+
 /// The basename for the RackNES panel files.
 const char BASENAME[] = "res/RackNES";
 
@@ -476,11 +1635,17 @@ struct RackNESWidget : ThemedWidget<BASENAME> {
         // setup the display for the NES screen
         display = new Display(
             Vec(157, 18),                                         // screen position
-            static_cast<RackNES*>(module)->screen,                // pixel buffer
+            module ? &module->screen : nullptr,                   // frame buffer
             Vec(NES::Emulator::WIDTH, NES::Emulator::HEIGHT),     // buffer size
             Vec(NES::Emulator::WIDTH_NES, NES::Emulator::HEIGHT)  // image size
         );
         addChild(display);
+        // setup the profiling overlay on top of the display
+        auto overlay = new ProfileOverlay;
+        overlay->module = static_cast<RackNES*>(module);
+        overlay->setPosition(display->box.pos);
+        overlay->setSize(display->box.size);
+        addChild(overlay);
         // panel screws
         addChild(createWidget<ScrewSilver>(Vec(7 * RACK_GRID_WIDTH, 0)));
         addChild(createWidget<ScrewSilver>(Vec(box.size.x - 8 * RACK_GRID_WIDTH, 0)));
@@ -584,6 +1749,14 @@ struct RackNESWidget : ThemedWidget<BASENAME> {
             static constexpr auto MSG = "ROM file was not found!";
             osdialog_message(OSDIALOG_ERROR, OSDIALOG_OK, MSG);
         }
+        // handle signal from module that the movie is of another game
+        if (module->movie_game_signal) {
+            module->movie_game_signal = false;
+            static constexpr auto MSG = "Movie is of a different game!";
+            osdialog_message(OSDIALOG_ERROR, OSDIALOG_OK, MSG);
+        }
+        // delete the emulators that the engine swapped out of the bank
+        module->bank.collect_retired();
     }
 
     /// Add context items for the module to a menu on the UI.
@@ -598,6 +1771,131 @@ struct RackNESWidget : ThemedWidget<BASENAME> {
             &ROMMenuItem::module,
             static_cast<RackNES*>(this->module)
         ));
+        auto module = static_cast<RackNES*>(this->module);
+        menu->addChild(new MenuSeparator);
+        menu->addChild(createMenuLabel("ROM bank"));
+        for (int i = 0; i < ROMBank::NUM_SLOTS; i++) {
+            NES::Emulator* nes = module->bank.get(i);
+            std::string name = "empty";
+            if (nes != nullptr && nes->has_game()) name = rack::system::getStem(nes->get_rom_path());
+            else if (nes != nullptr) name = "no ROM";
+            auto item = createMenuItem<BankSlotMenuItem>(std::to_string(i + 1) + ": " + name, RIGHT_ARROW);
+            if (i == module->bankSlot) item->rightText = "playing " + item->rightText;
+            item->module = module;
+            item->slot = i;
+            menu->addChild(item);
+        }
+        menu->addChild(new MenuSeparator);
+        menu->addChild(createMenuLabel("Mode"));
+        static constexpr const char* MODE_NAMES[RackNES::NUM_MODES] = {
+            "NES emulator",
+            "APU oscillator",
+            "APU oscillator (polyphonic)"
+        };
+        for (int i = 0; i < RackNES::NUM_MODES; i++) {
+            auto item = createMenuItem<ModeMenuItem>(MODE_NAMES[i], CHECKMARK(module->mode == i));
+            item->module = module;
+            item->mode = static_cast<RackNES::Mode>(i);
+            menu->addChild(item);
+        }
+        menu->addChild(new MenuSeparator);
+        menu->addChild(createMenuLabel("Run-ahead"));
+        static constexpr const char* RUN_AHEAD_NAMES[RackNES::MAX_RUN_AHEAD + 1] = {
+            "Off",
+            "1 frame",
+            "2 frames",
+            "3 frames"
+        };
+        for (int i = 0; i <= RackNES::MAX_RUN_AHEAD; i++) {
+            auto item = createMenuItem<RunAheadMenuItem>(RUN_AHEAD_NAMES[i], CHECKMARK(module->runAhead == i));
+            item->module = module;
+            item->frames = i;
+            menu->addChild(item);
+        }
+        menu->addChild(new MenuSeparator);
+        menu->addChild(createMenuLabel("Control rate"));
+        static constexpr int CONTROL_RATE_DIVISIONS[4] = {1, 4, 16, RackNES::MAX_CV_DIVISION};
+        static constexpr const char* CONTROL_RATE_NAMES[4] = {
+            "Every sample",
+            "Every 4 samples",
+            "Every 16 samples",
+            "Every 64 samples"
+        };
+        for (int i = 0; i < 4; i++) {
+            const int division = CONTROL_RATE_DIVISIONS[i];
+            auto item = createMenuItem<ControlRateMenuItem>(CONTROL_RATE_NAMES[i], CHECKMARK(module->cvDivider.getDivision() == static_cast<uint32_t>(division)));
+            item->module = module;
+            item->division = division;
+            menu->addChild(item);
+        }
+        menu->addChild(new MenuSeparator);
+        menu->addChild(createMenuLabel("Save states"));
+        auto target = createMenuItem<StateTargetMenuItem>("Save / load target", RIGHT_ARROW);
+        target->module = module;
+        menu->addChild(target);
+        if (module->stateSlot > 0) {
+            auto name = new StateNameField;
+            name->module = module;
+            name->slot = module->stateSlot - 1;
+            name->box.size.x = 200;
+            name->placeholder = "State " + std::to_string(module->stateSlot);
+            name->setText(module->library.get_name(module->stateSlot - 1));
+            menu->addChild(name);
+            auto clear = createMenuItem<ClearStateMenuItem>("Clear state");
+            clear->module = module;
+            clear->disabled = !module->library.has_state(module->stateSlot - 1);
+            menu->addChild(clear);
+        }
+        menu->addChild(new MenuSeparator);
+        menu->addChild(createMenuLabel("Movie"));
+        // the movie is only read or replaced from here while it is stopped
+        const bool is_movie_stopped = module->movieState == RackNES::MOVIE_STOPPED && module->movie_signal < 0;
+        auto record = createMenuItem<MovieStateMenuItem>("Record", CHECKMARK(module->movieState == RackNES::MOVIE_RECORDING));
+        record->module = module;
+        record->state = RackNES::MOVIE_RECORDING;
+        record->disabled = module->movieState == RackNES::MOVIE_PLAYING;
+        menu->addChild(record);
+        auto play = createMenuItem<MovieStateMenuItem>("Play", CHECKMARK(module->movieState == RackNES::MOVIE_PLAYING));
+        play->module = module;
+        play->state = RackNES::MOVIE_PLAYING;
+        play->disabled = module->movieState == RackNES::MOVIE_RECORDING || (is_movie_stopped && module->movie.is_empty());
+        menu->addChild(play);
+        auto save_movie = createMenuItem<SaveMovieMenuItem>("Save movie...");
+        save_movie->module = module;
+        save_movie->disabled = !is_movie_stopped || module->movie.is_empty();
+        menu->addChild(save_movie);
+        auto open_movie = createMenuItem<OpenMovieMenuItem>("Open movie...");
+        open_movie->module = module;
+        open_movie->disabled = !is_movie_stopped;
+        menu->addChild(open_movie);
+        menu->addChild(new MenuSeparator);
+        menu->addChild(createMenuLabel("Capture"));
+        auto capture = createMenuItem<CaptureMenuItem>("Capture video and audio...", CHECKMARK(module->capture.is_active()));
+        capture->module = module;
+        capture->disabled = !module->capture.is_active() && module->mode != RackNES::MODE_EMULATOR;
+        menu->addChild(capture);
+        if (module->capture.is_active()) {
+            menu->addChild(createMenuLabel(string::f("%llu frames, %llu frames and %llu samples dropped",
+                static_cast<unsigned long long>(module->capture.get_frames()),
+                static_cast<unsigned long long>(module->capture.get_dropped_frames()),
+                static_cast<unsigned long long>(module->capture.get_dropped_samples()))));
+        }
+        auto shared_export = createMenuItem<SharedExportMenuItem>("Share frames, RAM, and audio", CHECKMARK(module->sharedExport.is_active()));
+        shared_export->module = module;
+        menu->addChild(shared_export);
+        if (module->sharedExport.is_active())
+            menu->addChild(createMenuLabel("Shared memory " + module->sharedExport.get_name()));
+        menu->addChild(new MenuSeparator);
+        menu->addChild(createMenuLabel("Profiling"));
+        auto show_profile = createMenuItem<ShowProfileMenuItem>("Show counters over screen", CHECKMARK(module->showProfile));
+        show_profile->module = module;
+        menu->addChild(show_profile);
+        auto export_profile = createMenuItem<ExportProfileMenuItem>("Export counters as JSON...");
+        export_profile->module = module;
+        menu->addChild(export_profile);
+        auto trace = createMenuItem<TraceMenuItem>("Record timeline trace...", CHECKMARK(module->tracer.is_active()));
+        trace->module = module;
+        menu->addChild(trace);
         ThemedWidget<BASENAME>::appendContextMenu(menu);
     }
 
@@ -9,7 +9,9 @@
 #define NES_APU_HPP
 
 #include <vector>
+#ifndef NES_NO_JSON
 #include <jansson.h>
+#endif  // NES_NO_JSON
 #include "common.hpp"
 #include "apu/Nes_Apu.h"
 #include "apu/apu_snapshot.h"
@@ -23,6 +25,13 @@ class APU {
     Blip_Buffer buffer[Nes_Apu::osc_count];
     /// The NES APU instance to synthesize sound with
     Nes_Apu apu;
+    /// the buffer that the oscillators output to while the audio is held
+    Blip_Buffer hold_buffer;
+    /// the amplitudes of the oscillators in the buffers when the audio was
+    /// held
+    int held_amps[Nes_Apu::osc_count] = {};
+    /// whether the audio is held
+    bool is_held = false;
 
  public:
     /// the number of channels on the APU
@@ -37,6 +46,8 @@ class APU {
             buffer[i].clock_rate(CLOCK_RATE);
             apu.osc_output(i, &buffer[i]);
         }
+        hold_buffer.sample_rate(SAMPLE_RATE);
+        hold_buffer.clock_rate(CLOCK_RATE);
     }
 
     /// @brief Copy data from another instance.
@@ -49,21 +60,92 @@ class APU {
         apu.load_snapshot(snapshot);
     }
 
+    /// @brief Save the state of the APU (without its audio buffers).
+    ///
+    /// @param snapshot the snapshot to save the state to
+    ///
+    inline void save(apu_snapshot_t& snapshot) const { apu.save_snapshot(&snapshot); }
+
+    /// @brief Load the state of the APU (without its audio buffers).
+    ///
+    /// @param snapshot the snapshot to load the state from
+    /// @details
+    /// Loading resets the amplitudes of the oscillators, so the buffers are
+    /// cleared to match them. Only the samples in use are cleared, as the
+    /// rest of a buffer is always clear, so a load (and a fork) does not
+    /// touch the whole length of the buffers. While the audio is held, the
+    /// buffers are left alone and take up the amplitudes they had when the
+    /// audio is released.
+    ///
+    inline void load(const apu_snapshot_t& snapshot) {
+        apu.load_snapshot(snapshot);
+        if (is_held) {
+            hold_buffer.clear(false);
+            return;
+        }
+        for (std::size_t i = 0; i < Nes_Apu::osc_count; i++)
+            buffer[i].clear(false);
+    }
+
+    /// @brief Hold the audio of the buffers (i.e., while running cycles
+    /// whose audio is discarded).
+    ///
+    /// @details
+    /// The oscillators output to a scratch buffer until the audio is
+    /// released, so the samples, the position, and the amplitudes of the
+    /// buffers are kept as they were.
+    ///
+    inline void hold_audio() {
+        if (is_held) return;
+        for (std::size_t i = 0; i < Nes_Apu::osc_count; i++) {
+            held_amps[i] = apu.osc_amp(i);
+            apu.osc_output(i, &hold_buffer);
+        }
+        is_held = true;
+    }
+
+    /// @brief Release the audio of the buffers.
+    ///
+    /// @details
+    /// The oscillators output to the buffers again from the amplitudes that
+    /// the buffers were held at, so the audio continues from where it was
+    /// held without a step, and moves to the amplitudes of the oscillators
+    /// at their next change of output.
+    ///
+    inline void release_audio() {
+        if (!is_held) return;
+        for (std::size_t i = 0; i < Nes_Apu::osc_count; i++) {
+            apu.osc_output(i, &buffer[i]);
+            apu.osc_amp(i, held_amps[i]);
+        }
+        hold_buffer.clear(false);
+        is_held = false;
+    }
+
+    /// @brief Discard the samples of the audio while it is held.
+    inline void discard_samples() {
+        hold_buffer.remove_samples(hold_buffer.samples_avail());
+    }
+
     /// @brief Set the DMC Reader on the APU. The DMC Reader is a callback for
     /// reading audio samples from RAM for DMC playback.
     ///
     /// @param callback the callback function for reading RAM from memory
+    /// @param data the data to pass to the callback (i.e., the bus)
     ///
-    inline void set_dmc_reader(RomReaderCallback callback) {
-        apu.dmc_reader(callback);
+    inline void set_dmc_reader(RomReaderCallback callback, void* data) {
+        apu.dmc_reader(callback, data);
     }
 
-    /// @brief Set the callback function for IRQ interrupting the CPU.
+    /// @brief Return true if the APU is asserting the IRQ line.
     ///
-    /// @param callback the callback method that interrupts the CPU (IRQ)
+    /// @returns true if a frame or DMC interrupt is pending, false otherwise
+    /// @details
+    /// The line stays asserted until the CPU acknowledges the interrupt by
+    /// reading or writing the APU registers.
     ///
-    inline void set_irq_callback(APU_IRQ_InterruptCallback callback) {
-        apu.irq_notifier(callback);
+    inline bool is_irq_asserted() const {
+        return apu.earliest_irq() == Nes_Apu::irq_waiting;
     }
 
     /// @brief Set the sample rate to a new value.
@@ -82,6 +164,7 @@ class APU {
     inline void set_clock_rate(uint64_t value = CLOCK_RATE) {
         for (std::size_t i = 0; i < Nes_Apu::osc_count; i++)
             buffer[i].clock_rate(value);
+        hold_buffer.clock_rate(value);
     }
 
     /// @brief Reset the APU.
@@ -106,13 +189,28 @@ class APU {
         apu.write_register(1, addr, value);
     }
 
-    /// @brief Run a cycle on the APU (increment number of elapsed cycles).
-    inline void cycle() {
-        apu.end_frame(1);
+    /// @brief Run cycles on the APU (increment number of elapsed cycles).
+    ///
+    /// @param cycles the number of CPU cycles to run the APU for
+    ///
+    inline void cycle(cpu_time_t cycles = 1) {
+        apu.end_frame(cycles);
+        // the buffers stay where they were while the audio is held
+        if (is_held) {
+            hold_buffer.end_frame(cycles);
+            return;
+        }
         for (std::size_t i = 0; i < Nes_Apu::osc_count; i++)
-            buffer[i].end_frame(1);
+            buffer[i].end_frame(cycles);
     }
 
+    /// @brief Return the number of cycles until the APU requests an IRQ.
+    ///
+    /// @returns the CPU cycles until the earliest IRQ, 0 if an IRQ is pending,
+    /// or Nes_Apu::no_irq if no IRQ will occur
+    ///
+    inline cpu_time_t get_earliest_irq() const { return apu.earliest_irq(); }
+
     /// @brief Return a 16-bit signed sample from the APU.
     ///
     /// @param channel the channel to get a sample from
@@ -126,6 +224,42 @@ class APU {
         return output_buffer[0];
     }
 
+    /// @brief Read a block of 16-bit signed samples from the APU.
+    ///
+    /// @param channel the channel to read samples from
+    /// @param output the buffer to read the samples into
+    /// @param count the most samples to read
+    /// @returns the number of samples that were read
+    ///
+    inline std::size_t read_samples(int channel, int16_t* output, std::size_t count) {
+        return buffer[channel].read_samples(output, count);
+    }
+
+    /// @brief Return the number of samples that the buffers produce over a
+    /// number of cycles from when they were cleared.
+    ///
+    /// @param cycles the number of CPU cycles since the buffers were cleared
+    /// @returns the number of samples at the resampling ratio of the buffers
+    ///
+    inline uint64_t get_sample_count(uint64_t cycles) const {
+        return (cycles * buffer[0].resampled_duration(1)) >> BLIP_BUFFER_ACCURACY;
+    }
+
+    /// @brief Set the position of the buffers within a sample as if they
+    /// were cleared a number of cycles ago.
+    ///
+    /// @param cycles the number of CPU cycles since the buffers were cleared
+    /// @details
+    /// This lines up the samples of buffers that were just cleared with the
+    /// samples of a render that did not clear them (see get_sample_count).
+    ///
+    inline void set_phase(uint64_t cycles) {
+        static constexpr uint64_t MASK = (uint64_t(1) << BLIP_BUFFER_ACCURACY) - 1;
+        for (std::size_t i = 0; i < Nes_Apu::osc_count; i++)
+            buffer[i].offset_ = (cycles * buffer[i].resampled_duration(1)) & MASK;
+    }
+
+#ifndef NES_NO_JSON
     /// @brief Convert the object's state to a JSON object.
     ///
     /// @returns a JSON object with the serialized contents of this object
@@ -150,6 +284,7 @@ class APU {
             apu.load_snapshot(snapshot);
         }
     }
+#endif  // NES_NO_JSON
 };
 
 }  // namespace NES
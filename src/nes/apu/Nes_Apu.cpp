@@ -20,8 +20,7 @@ Nes_Apu::Nes_Apu()
 {
 	dmc.apu = this;
 	dmc.rom_reader = NULL;
-	square1.synth = &square_synth;
-	square2.synth = &square_synth;
+	synths( NULL, NULL, NULL, NULL, NULL );
 	irq_notifier_ = NULL;
 
 	oscs [0] = &square1;
@@ -42,9 +41,21 @@ Nes_Apu::~Nes_Apu()
 void Nes_Apu::treble_eq( const blip_eq_t& eq )
 {
 	square_synth.treble_eq( eq );
-	triangle.synth.treble_eq( eq );
-	noise.synth.treble_eq( eq );
-	dmc.synth.treble_eq( eq );
+	triangle_synth.treble_eq( eq );
+	noise_synth.treble_eq( eq );
+	dmc_synth.treble_eq( eq );
+}
+
+void Nes_Apu::synths( const Nes_Square::Synth* square1_synth,
+		const Nes_Square::Synth* square2_synth,
+		const Nes_Triangle::Synth* triangle_synth,
+		const Nes_Noise::Synth* noise_synth, const Nes_Dmc::Synth* dmc_synth )
+{
+	square1.synth = square1_synth ? square1_synth : &square_synth;
+	square2.synth = square2_synth ? square2_synth : &square_synth;
+	triangle.synth = triangle_synth ? triangle_synth : &this->triangle_synth;
+	noise.synth = noise_synth ? noise_synth : &this->noise_synth;
+	dmc.synth = dmc_synth ? dmc_synth : &this->dmc_synth;
 }
 
 void Nes_Apu::buffer_cleared()
@@ -62,9 +73,9 @@ void Nes_Apu::enable_nonlinear( double v )
 	square_synth.volume( 1.3 * 0.25751258 / 0.742467605 * 0.25 * v );
 
 	const double tnd = 0.75 / 202 * 0.48;
-	triangle.synth.volume_unit( 3 * tnd );
-	noise.synth.volume_unit( 2 * tnd );
-	dmc.synth.volume_unit( tnd );
+	triangle_synth.volume_unit( 3 * tnd );
+	noise_synth.volume_unit( 2 * tnd );
+	dmc_synth.volume_unit( tnd );
 
 	buffer_cleared();
 }
@@ -73,9 +84,9 @@ void Nes_Apu::volume( double v )
 {
 	dmc.nonlinear = false;
 	square_synth.volume( 0.1128 * v );
-	triangle.synth.volume( 0.12765 * v );
-	noise.synth.volume( 0.0741 * v );
-	dmc.synth.volume( 0.42545 * v );
+	triangle_synth.volume( 0.12765 * v );
+	noise_synth.volume( 0.0741 * v );
+	dmc_synth.volume( 0.42545 * v );
 }
 
 void Nes_Apu::output( Blip_Buffer* buffer )
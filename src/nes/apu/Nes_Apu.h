@@ -15,7 +15,7 @@ struct apu_snapshot_t;
 class Nonlinear_Buffer;
 
 /// a callback method for issuing and IRQ interrupt to the CPU
-typedef std::function<void(void*)> APU_IRQ_InterruptCallback;
+typedef void (*APU_IRQ_InterruptCallback)(void*);
 
 class Nes_Apu {
  public:
@@ -70,6 +70,14 @@ class Nes_Apu {
     // Set treble equalization (see notes.txt).
     void treble_eq( const blip_eq_t& );
 
+    // Set the synthesizers used by the oscillators, e.g., to share a single set
+    // of impulse tables between many APUs. A NULL synthesizer selects the
+    // APU's own synthesizer for that oscillator. volume() and treble_eq()
+    // only affect the APU's own synthesizers.
+    void synths( const Nes_Square::Synth* square1, const Nes_Square::Synth* square2,
+            const Nes_Triangle::Synth* triangle, const Nes_Noise::Synth* noise,
+            const Nes_Dmc::Synth* dmc );
+
     // Set sound output of specific oscillator to buffer. If buffer is NULL,
     // the specified oscillator is muted and emulation accuracy is reduced.
     // The oscillators are indexed as follows: 0) Square 1, 1) Square 2,
@@ -77,6 +85,13 @@ class Nes_Apu {
     enum { osc_count = 5 };
     void osc_output( int index, Blip_Buffer* buffer );
 
+    // Get or set the amplitude that an oscillator last output to its buffer.
+    // The next output of the oscillator is relative to it, so setting it back
+    // after load_snapshot() or after running on another buffer continues the
+    // output of the buffer without a step.
+    int osc_amp( int index ) const;
+    void osc_amp( int index, int amp );
+
     // Set IRQ time callback that is invoked when the time of earliest IRQ
     // may have changed, or NULL to disable. When callback is invoked,
     // 'user_data' is passed unchanged as the first parameter.
@@ -124,9 +139,11 @@ class Nes_Apu {
     int frame_mode;
     bool irq_flag;
     APU_IRQ_InterruptCallback irq_notifier_;
-    // void (*irq_notifier_)( void* user_data );
     void* irq_data;
     Nes_Square::Synth square_synth; // shared by squares
+    Nes_Triangle::Synth triangle_synth;
+    Nes_Noise::Synth noise_synth;
+    Nes_Dmc::Synth dmc_synth;
 
     void irq_changed();
     void state_restored();
@@ -139,6 +156,16 @@ inline void Nes_Apu::osc_output(int osc, Blip_Buffer* buf) {
     oscs[osc]->output = buf;
 }
 
+inline int Nes_Apu::osc_amp(int osc) const {
+    assert(0 <= osc && osc < osc_count /*Nes_Apu::osc_amp(): Index out of range*/);
+    return oscs[osc]->last_amp;
+}
+
+inline void Nes_Apu::osc_amp(int osc, int amp) {
+    assert(0 <= osc && osc < osc_count /*Nes_Apu::osc_amp(): Index out of range*/);
+    oscs[osc]->last_amp = amp;
+}
+
 inline cpu_time_t Nes_Apu::earliest_irq() const { return earliest_irq_; }
 
 inline void Nes_Apu::dmc_reader(RomReaderCallback callback, void* user_data ) {
@@ -181,7 +181,7 @@ void Nes_Triangle::run( cpu_time_t time, cpu_time_t end_time )
 	
 	int delta = update_amp( calc_amp() );
 	if ( delta )
-		synth.offset( time, delta, output );
+		synth->offset( time, delta, output );
 	
 	time += delay;
 	const int timer_period = period() + 1;
@@ -206,7 +206,7 @@ void Nes_Triangle::run( cpu_time_t time, cpu_time_t end_time )
 				volume = -volume;
 			}
 			else {
-				synth.offset_inline( time, volume, output );
+				synth->offset_inline( time, volume, output );
 			}
 			
 			time += timer_period;
@@ -365,7 +365,7 @@ void Nes_Dmc::run( cpu_time_t time, cpu_time_t end_time )
 	
 	int delta = update_amp( dac );
 	if ( delta )
-		synth.offset( time, delta, output );
+		synth->offset( time, delta, output );
 	
 	time += delay;
 	if ( time < end_time )
@@ -392,7 +392,7 @@ void Nes_Dmc::run( cpu_time_t time, cpu_time_t end_time )
 					bits >>= 1;
 					if ( unsigned (dac + step) <= 0x7F ) {
 						dac += step;
-						synth.offset_inline( time, step, output );
+						synth->offset_inline( time, step, output );
 					}
 				}
 				
@@ -441,7 +441,7 @@ void Nes_Noise::run( cpu_time_t time, cpu_time_t end_time )
 	int amp = (noise & 1) ? volume : 0;
 	int delta = update_amp( amp );
 	if ( delta )
-		synth.offset( time, delta, output );
+		synth->offset( time, delta, output );
 	
 	time += delay;
 	if ( time < end_time )
@@ -465,7 +465,7 @@ void Nes_Noise::run( cpu_time_t time, cpu_time_t end_time )
 		{
 			Blip_Buffer* const output = this->output;
 			
-			// using resampled time avoids conversion in synth.offset()
+			// using resampled time avoids conversion in synth->offset()
 			Blip_Buffer::resampled_time_t rperiod = output->resampled_duration( period );
 			Blip_Buffer::resampled_time_t rtime = output->resampled_time( time );
 			
@@ -480,7 +480,7 @@ void Nes_Noise::run( cpu_time_t time, cpu_time_t end_time )
 				if ( (noise + 1) & 2 ) {
 					// bits 0 and 1 of noise differ
 					delta = -delta;
-					synth.offset_resampled( rtime, delta, output );
+					synth->offset_resampled( rtime, delta, output );
 				}
 				
 				rtime += rperiod;
@@ -6,7 +6,6 @@
 #ifndef NES_OSCS_H
 #define NES_OSCS_H
 
-#include <functional>
 #include "Blip_Buffer.h"
 
 class Nes_Apu;
@@ -75,7 +74,9 @@ struct Nes_Triangle : Nes_Osc
 	enum { phase_range = 16 };
 	int phase;
 	int linear_counter;
-	Blip_Synth<blip_good_quality,15> synth;
+
+	typedef Blip_Synth<blip_good_quality,15> Synth;
+	const Synth* synth;
 
 	int calc_amp() const;
 	void run( cpu_time_t, cpu_time_t );
@@ -91,7 +92,9 @@ struct Nes_Triangle : Nes_Osc
 struct Nes_Noise : Nes_Envelope
 {
 	int noise;
-	Blip_Synth<blip_med_quality,15> synth;
+
+	typedef Blip_Synth<blip_med_quality,15> Synth;
+	const Synth* synth;
 
 	void run( cpu_time_t, cpu_time_t );
 	void reset() {
@@ -101,7 +104,7 @@ struct Nes_Noise : Nes_Envelope
 };
 
 /// a callback function for reading from the emulator's ROM
-typedef std::function<int(void*, cpu_addr_t)> RomReaderCallback;
+typedef int (*RomReaderCallback)(void*, cpu_addr_t);
 
 // Nes_Dmc
 struct Nes_Dmc : Nes_Osc
@@ -125,13 +128,13 @@ struct Nes_Dmc : Nes_Osc
 	bool pal_mode;
 	bool nonlinear;
 
-	RomReaderCallback rom_reader;
-	// int (*rom_reader)( void*, cpu_addr_t ); // needs to be initialized to rom read function
+	RomReaderCallback rom_reader; // needs to be initialized to rom read function
 	void* rom_reader_data;
 
 	Nes_Apu* apu;
 
-	Blip_Synth<blip_med_quality,127> synth;
+	typedef Blip_Synth<blip_med_quality,127> Synth;
+	const Synth* synth;
 
 	void start();
 	void write_register( int, int );
@@ -20,8 +20,10 @@
 #include <string>
 #include <cstring>
 #include <vector>
+#ifndef NES_NO_JSON
 #include <jansson.h>
 #include "../../base64.h"
+#endif  // NES_NO_JSON
 #include "blargg_common.h"
 
 struct apu_snapshot_t {
@@ -49,6 +51,7 @@ struct apu_snapshot_t {
         byte swp_reset;
         byte unused[1];
 
+#ifndef NES_NO_JSON
         /// Convert the object's state to a JSON object.
         json_t* dataToJson() {
             json_t* rootJ = json_object();
@@ -106,6 +109,7 @@ struct apu_snapshot_t {
                 if (json_data) swp_reset = json_integer_value(json_data);
             }
         }
+#endif  // NES_NO_JSON
     } square1, square2;
 
     /// The triangle oscillator.
@@ -116,6 +120,7 @@ struct apu_snapshot_t {
         byte linear_counter;
         byte linear_mode;
 
+#ifndef NES_NO_JSON
         /// Convert the object's state to a JSON object.
         json_t* dataToJson() {
             json_t* rootJ = json_object();
@@ -155,6 +160,7 @@ struct apu_snapshot_t {
                 if (json_data) linear_mode = json_integer_value(json_data);
             }
         }
+#endif  // NES_NO_JSON
     } triangle;
 
     /// The noise oscillator.
@@ -164,6 +170,7 @@ struct apu_snapshot_t {
         byte length;
         BOOST::uint16_t shift_reg;
 
+#ifndef NES_NO_JSON
         /// Convert the object's state to a JSON object.
         json_t* dataToJson() {
             json_t* rootJ = json_object();
@@ -209,6 +216,7 @@ struct apu_snapshot_t {
                 if (json_data) shift_reg = json_integer_value(json_data);
             }
         }
+#endif  // NES_NO_JSON
     } noise;
 
     /// The DMC sampler.
@@ -223,6 +231,7 @@ struct apu_snapshot_t {
         byte silence;
         byte irq_flag;
 
+#ifndef NES_NO_JSON
         /// Convert the object's state to a JSON object.
         json_t* dataToJson() {
             json_t* rootJ = json_object();
@@ -286,11 +295,13 @@ struct apu_snapshot_t {
                 if (json_data) irq_flag = json_integer_value(json_data);
             }
         }
+#endif  // NES_NO_JSON
     } dmc;
 
     // enum { tag = 'APUR' };
     // void swap();
 
+#ifndef NES_NO_JSON
     /// Convert the object's state to a JSON object.
     json_t* dataToJson() {
         json_t* rootJ = json_object();
@@ -373,6 +384,7 @@ struct apu_snapshot_t {
             if (json_data) dmc.dataFromJson(json_data);
         }
     }
+#endif  // NES_NO_JSON
 };
 BOOST_STATIC_ASSERT( sizeof (apu_snapshot_t) == 72 );
 
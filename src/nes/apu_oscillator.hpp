@@ -0,0 +1,164 @@
+//  Program:      nes-py
+//  File:         apu_oscillator.hpp
+//  Description:  This class drives the NES APU directly through its registers
+//
+//  Copyright (c) 2020 Christian Kauten. All rights reserved.
+//
+
+#ifndef NES_APU_OSCILLATOR_HPP
+#define NES_APU_OSCILLATOR_HPP
+
+#include <limits>
+#include "common.hpp"
+#include "apu_voice.hpp"
+
+namespace NES {
+
+/// The 2A03 APU as a stand-alone oscillator, i.e., without a CPU, PPU, or ROM.
+///
+/// @details
+/// Channel parameters are quantized to APU register values and the registers
+/// are written only when the quantized value changes. Time advances one host
+/// sample per call to `process`, so the cost per sample is a single
+/// `Nes_Apu::end_frame` call instead of one call per emulated CPU cycle.
+///
+class APUOscillator {
+ public:
+    /// the number of channels on the APU
+    static constexpr std::size_t NUM_CHANNELS = Nes_Apu::osc_count;
+    /// The default sample rate for the oscillator
+    static constexpr uint32_t SAMPLE_RATE = 96000;
+    /// The length of the BLIP buffers in milliseconds
+    static constexpr int BUFFER_LENGTH = 50;
+    /// The channels on the APU.
+    using Channel = APUVoice::Channel;
+    static constexpr Channel SQUARE1 = APUVoice::SQUARE1;
+    static constexpr Channel SQUARE2 = APUVoice::SQUARE2;
+    static constexpr Channel TRIANGLE = APUVoice::TRIANGLE;
+    static constexpr Channel NOISE = APUVoice::NOISE;
+    static constexpr Channel DMC = APUVoice::DMC;
+
+ private:
+    /// The BLIP buffers to render audio samples from
+    Blip_Buffer buffer[NUM_CHANNELS];
+    /// The APU to synthesize sound with
+    APUVoice voice;
+    /// the number of CPU cycles per host sample
+    double cycles_per_sample = static_cast<double>(CLOCK_RATE) / SAMPLE_RATE;
+    /// the fractional CPU cycles that have not been run yet
+    double cycles_remainder = 0;
+    /// the last sample rendered for each channel
+    int16_t samples[NUM_CHANNELS] = {0, 0, 0, 0, 0};
+
+ public:
+    /// @brief Initialize a new APU oscillator.
+    APUOscillator() {
+        for (std::size_t i = 0; i < NUM_CHANNELS; i++) {
+            buffer[i].sample_rate(SAMPLE_RATE, BUFFER_LENGTH);
+            buffer[i].clock_rate(CLOCK_RATE);
+            voice.set_output(i, &buffer[i]);
+        }
+    }
+
+    /// @brief Set the sample rate to a new value.
+    ///
+    /// @param value the sample rate, i.e., 96000 Hz
+    ///
+    inline void set_sample_rate(uint32_t value = SAMPLE_RATE) {
+        cycles_per_sample = static_cast<double>(CLOCK_RATE) / value;
+        for (std::size_t i = 0; i < NUM_CHANNELS; i++) {
+            buffer[i].sample_rate(value, BUFFER_LENGTH);
+            buffer[i].clock_rate(CLOCK_RATE);
+        }
+    }
+
+    /// @brief Reset the APU and clear the register shadows.
+    void reset() {
+        voice.reset();
+        for (std::size_t i = 0; i < NUM_CHANNELS; i++) {
+            buffer[i].clear();
+            samples[i] = 0;
+        }
+        cycles_remainder = 0;
+    }
+
+    /// @brief Set the parameters of one of the square wave channels.
+    ///
+    /// @param channel the square channel to set, SQUARE1 or SQUARE2
+    /// @param frequency the frequency of the square wave in Hz
+    /// @param duty the duty cycle index in [0, 3] (12.5%, 25%, 50%, 75%)
+    /// @param volume the constant volume in [0, 15]
+    /// @param gate whether the channel is enabled
+    ///
+    inline void set_square(Channel channel, float frequency, int duty, int volume, bool gate) {
+        voice.set_square(channel, APUVoice::pulse_period(frequency), duty, volume, gate);
+    }
+
+    /// @brief Set the parameters of the triangle wave channel.
+    ///
+    /// @param frequency the frequency of the triangle wave in Hz
+    /// @param gate whether the channel is enabled
+    ///
+    inline void set_triangle(float frequency, bool gate) {
+        voice.set_triangle(APUVoice::triangle_period(frequency), gate);
+    }
+
+    /// @brief Set the parameters of the noise channel.
+    ///
+    /// @param frequency the frequency of the noise in Hz
+    /// @param is_short whether to use the short (93-step) LFSR sequence
+    /// @param volume the constant volume in [0, 15]
+    /// @param gate whether the channel is enabled
+    ///
+    inline void set_noise(float frequency, bool is_short, int volume, bool gate) {
+        voice.set_noise(APUVoice::noise_period(frequency), is_short, volume, gate);
+    }
+
+    /// @brief Set the level of the DMC channel's 7-bit DAC directly.
+    ///
+    /// @param level the level of the DAC in [0, 127]
+    ///
+    inline void set_dmc(int level) { voice.set_dmc(level); }
+
+    /// @brief Run the APU for the duration of one host sample.
+    void process() {
+        cycles_remainder += cycles_per_sample;
+        const auto cycles = static_cast<cpu_time_t>(cycles_remainder);
+        cycles_remainder -= cycles;
+        voice.end_frame(cycles);
+        for (std::size_t i = 0; i < NUM_CHANNELS; i++) {
+            buffer[i].end_frame(cycles);
+            // hold the last sample if the buffer has not produced a new one
+            if (buffer[i].samples_avail() == 0) continue;
+            buffer[i].read_samples(&samples[i], 1);
+            // drop any excess samples caused by rounding in the resampler
+            // to keep the latency of the oscillator constant
+            if (buffer[i].samples_avail())
+                buffer[i].remove_samples(buffer[i].samples_avail());
+        }
+    }
+
+    /// @brief Return a 16-bit signed sample from the APU.
+    ///
+    /// @param channel the channel to get a sample from
+    /// @returns a 16-bit audio sample for the given channel
+    ///
+    inline int16_t get_sample(int channel) const { return samples[channel]; }
+
+    /// @brief Return an audio sample from the APU in volts [-10.f, 10.f].
+    ///
+    /// @param channel the channel to get a sample from
+    /// @returns an audio sample for the given channel measure in volts
+    ///
+    inline float get_voltage(int channel) const {
+        // the peak to peak output of the voltage
+        static constexpr float Vpp = 10.f;
+        // the amount of voltage per increment of 16-bit fidelity volume
+        static constexpr float divisor = std::numeric_limits<int16_t>::max();
+        return Vpp * samples[channel] / divisor;
+    }
+};
+
+}  // namespace NES
+
+#endif  // NES_APU_OSCILLATOR_HPP
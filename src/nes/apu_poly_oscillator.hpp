@@ -0,0 +1,221 @@
+//  Program:      nes-py
+//  File:         apu_poly_oscillator.hpp
+//  Description:  This class drives a bank of NES APUs as polyphonic voices
+//
+//  Copyright (c) 2020 Christian Kauten. All rights reserved.
+//
+
+#ifndef NES_APU_POLY_OSCILLATOR_HPP
+#define NES_APU_POLY_OSCILLATOR_HPP
+
+#include <limits>
+#include "common.hpp"
+#include "apu_voice.hpp"
+
+namespace NES {
+
+/// A bank of up to 16 stand-alone 2A03 APUs, one per polyphonic voice.
+///
+/// @details
+/// Control parameters are held in structure-of-arrays layout so that the
+/// quantization of every voice runs as one vectorizable loop per parameter.
+/// All voices share one set of BLIP synthesizers (and thus one set of impulse
+/// tables in cache) and every voice mixes its five channels into a single
+/// BLIP buffer, so the bank produces one polyphonic output.
+///
+class APUPolyOscillator {
+ public:
+    /// the maximal number of voices in the bank
+    static constexpr std::size_t MAX_VOICES = 16;
+    /// the number of channels on each APU
+    static constexpr std::size_t NUM_CHANNELS = Nes_Apu::osc_count;
+    /// The default sample rate for the oscillator
+    static constexpr uint32_t SAMPLE_RATE = 96000;
+    /// The length of the BLIP buffers in milliseconds
+    static constexpr int BUFFER_LENGTH = 50;
+
+    /// The control parameters of all voices in structure-of-arrays layout.
+    struct Controls {
+        /// the frequencies in Hz of the square 1, square 2, triangle, and
+        /// noise channels
+        float frequency[4][MAX_VOICES];
+        /// the gates of the square 1, square 2, triangle, and noise channels
+        bool gate[4][MAX_VOICES];
+        /// the duty cycle indexes in [0, 3] of the square channels
+        int duty[2][MAX_VOICES];
+        /// the volumes in [0, 15] of the square 1, square 2, and noise channels
+        int volume[3][MAX_VOICES];
+        /// whether the noise channels use the short LFSR sequence
+        bool is_short[MAX_VOICES];
+        /// the levels in [0, 127] of the DMC DACs
+        int dmc[MAX_VOICES];
+    };
+
+ private:
+    /// the synthesizers for the square channels shared by every voice
+    Nes_Square::Synth square_synth[2];
+    /// the synthesizer for the triangle channel shared by every voice
+    Nes_Triangle::Synth triangle_synth;
+    /// the synthesizer for the noise channel shared by every voice
+    Nes_Noise::Synth noise_synth;
+    /// the synthesizer for the DMC channel shared by every voice
+    Nes_Dmc::Synth dmc_synth;
+    /// the BLIP buffers that the channels of each voice mix into
+    Blip_Buffer buffer[MAX_VOICES];
+    /// the APUs for each voice
+    APUVoice voices[MAX_VOICES];
+    /// the quantized timer periods of the square 1, square 2, triangle, and
+    /// noise channels
+    int periods[4][MAX_VOICES];
+    /// the number of active voices
+    std::size_t num_voices = 1;
+    /// the number of CPU cycles per host sample
+    double cycles_per_sample = static_cast<double>(CLOCK_RATE) / SAMPLE_RATE;
+    /// the fractional CPU cycles that have not been run yet
+    double cycles_remainder = 0;
+    /// the last sample rendered for each voice
+    int16_t samples[MAX_VOICES] = {};
+
+ public:
+    /// @brief Initialize a new polyphonic APU oscillator.
+    APUPolyOscillator() {
+        for (std::size_t i = 0; i < MAX_VOICES; i++) {
+            buffer[i].sample_rate(SAMPLE_RATE, BUFFER_LENGTH);
+            buffer[i].clock_rate(CLOCK_RATE);
+            voices[i].set_output(&buffer[i]);
+            voices[i].set_synths(
+                &square_synth[0],
+                &square_synth[1],
+                &triangle_synth,
+                &noise_synth,
+                &dmc_synth
+            );
+        }
+        const float levels[NUM_CHANNELS] = {1.f, 1.f, 1.f, 1.f, 1.f};
+        set_levels(levels);
+    }
+
+    /// @brief Set the sample rate to a new value.
+    ///
+    /// @param value the sample rate, i.e., 96000 Hz
+    ///
+    inline void set_sample_rate(uint32_t value = SAMPLE_RATE) {
+        cycles_per_sample = static_cast<double>(CLOCK_RATE) / value;
+        for (std::size_t i = 0; i < MAX_VOICES; i++) {
+            buffer[i].sample_rate(value, BUFFER_LENGTH);
+            buffer[i].clock_rate(CLOCK_RATE);
+        }
+    }
+
+    /// @brief Set the level of each channel in the mix of every voice.
+    ///
+    /// @param levels the level of each channel, where 1 is the level of the
+    /// channel in the mix of the console
+    /// @details
+    /// changing the level rescales the impulse tables of the synthesizer, so
+    /// this should only be called when a level actually changes
+    ///
+    void set_levels(const float levels[NUM_CHANNELS]) {
+        // the relative levels of the channels from Nes_Apu::volume
+        square_synth[0].volume(0.1128 * levels[0]);
+        square_synth[1].volume(0.1128 * levels[1]);
+        triangle_synth.volume(0.12765 * levels[2]);
+        noise_synth.volume(0.0741 * levels[3]);
+        dmc_synth.volume(0.42545 * levels[4]);
+    }
+
+    /// @brief Return the number of active voices.
+    inline std::size_t get_num_voices() const { return num_voices; }
+
+    /// @brief Set the number of active voices.
+    ///
+    /// @param value the number of voices to render in [1, MAX_VOICES]
+    ///
+    inline void set_num_voices(std::size_t value) {
+        num_voices = std::min<std::size_t>(std::max<std::size_t>(value, 1), static_cast<std::size_t>(MAX_VOICES));
+    }
+
+    /// @brief Reset the APUs and clear the register shadows.
+    void reset() {
+        for (std::size_t i = 0; i < MAX_VOICES; i++) {
+            voices[i].reset();
+            buffer[i].clear();
+            samples[i] = 0;
+        }
+        cycles_remainder = 0;
+    }
+
+    /// @brief Set the parameters of every voice.
+    ///
+    /// @param controls the control parameters for each voice
+    /// @details
+    /// the periods of all voices are quantized in fixed-length loops over the
+    /// arrays of the controls, registers are then written only for the
+    /// active voices and only when their quantized values change
+    ///
+    void update(const Controls& controls) {
+        for (std::size_t i = 0; i < MAX_VOICES; i++)
+            periods[0][i] = APUVoice::pulse_period(controls.frequency[0][i]);
+        for (std::size_t i = 0; i < MAX_VOICES; i++)
+            periods[1][i] = APUVoice::pulse_period(controls.frequency[1][i]);
+        for (std::size_t i = 0; i < MAX_VOICES; i++)
+            periods[2][i] = APUVoice::triangle_period(controls.frequency[2][i]);
+        for (std::size_t i = 0; i < MAX_VOICES; i++)
+            periods[3][i] = APUVoice::noise_period(controls.frequency[3][i]);
+        for (std::size_t i = 0; i < num_voices; i++) {
+            auto& voice = voices[i];
+            voice.set_square(APUVoice::SQUARE1, periods[0][i],
+                controls.duty[0][i], controls.volume[0][i], controls.gate[0][i]);
+            voice.set_square(APUVoice::SQUARE2, periods[1][i],
+                controls.duty[1][i], controls.volume[1][i], controls.gate[1][i]);
+            voice.set_triangle(periods[2][i], controls.gate[2][i]);
+            voice.set_noise(periods[3][i], controls.is_short[i],
+                controls.volume[2][i], controls.gate[3][i]);
+            voice.set_dmc(controls.dmc[i]);
+        }
+    }
+
+    /// @brief Run the active voices for the duration of one host sample.
+    void process() {
+        cycles_remainder += cycles_per_sample;
+        const auto cycles = static_cast<cpu_time_t>(cycles_remainder);
+        cycles_remainder -= cycles;
+        for (std::size_t i = 0; i < num_voices; i++) {
+            voices[i].end_frame(cycles);
+            buffer[i].end_frame(cycles);
+            // hold the last sample if the buffer has not produced a new one
+            if (buffer[i].samples_avail() == 0) continue;
+            buffer[i].read_samples(&samples[i], 1);
+            // drop any excess samples caused by rounding in the resampler
+            // to keep the latency of the oscillator constant
+            if (buffer[i].samples_avail())
+                buffer[i].remove_samples(buffer[i].samples_avail());
+        }
+    }
+
+    /// @brief Return a 16-bit signed sample from one of the voices.
+    ///
+    /// @param voice the voice to get a sample from
+    /// @returns a 16-bit audio sample for the given voice
+    ///
+    inline int16_t get_sample(int voice) const { return samples[voice]; }
+
+    /// @brief Copy the audio samples of every voice in volts [-10.f, 10.f].
+    ///
+    /// @param voltages the output array of MAX_VOICES voltages
+    /// @param gain the gain to apply to the voltages
+    ///
+    inline void get_voltages(float* voltages, float gain = 1.f) const {
+        // the peak to peak output of the voltage
+        static constexpr float Vpp = 10.f;
+        // the amount of voltage per increment of 16-bit fidelity volume
+        static constexpr float divisor = std::numeric_limits<int16_t>::max();
+        const float scale = gain * Vpp / divisor;
+        for (std::size_t i = 0; i < MAX_VOICES; i++)
+            voltages[i] = scale * samples[i];
+    }
+};
+
+}  // namespace NES
+
+#endif  // NES_APU_POLY_OSCILLATOR_HPP
@@ -0,0 +1,246 @@
+//  Program:      nes-py
+//  File:         apu_voice.hpp
+//  Description:  This class drives one NES APU through a register shadow
+//
+//  Copyright (c) 2020 Christian Kauten. All rights reserved.
+//
+
+#ifndef NES_APU_VOICE_HPP
+#define NES_APU_VOICE_HPP
+
+#include <algorithm>
+#include <cstring>
+#include "common.hpp"
+#include "apu/Nes_Apu.h"
+
+namespace NES {
+
+/// A single NES APU that is written to directly instead of by a CPU.
+///
+/// @details
+/// The voice keeps a shadow copy of the APU registers and only forwards a
+/// write to the APU when the value differs from the shadow. Parameters are
+/// given as quantized register values, see the static quantization methods
+/// for converting frequencies into timer periods.
+///
+class APUVoice {
+ public:
+    /// The channels on the APU.
+    enum Channel {
+        SQUARE1 = 0,
+        SQUARE2,
+        TRIANGLE,
+        NOISE,
+        DMC
+    };
+
+ private:
+    /// The NES APU instance to synthesize sound with
+    Nes_Apu apu;
+    /// the last values written to registers $4000-$4017
+    NES_Byte registers[0x18];
+    /// whether each of the registers $4000-$4017 has been written yet
+    bool is_written[0x18];
+    /// the channel enable bits of the status register ($4015)
+    NES_Byte enables = 0;
+
+    /// the address of the status register
+    static constexpr NES_Address SND_CHN_ADDRESS = 0x4015;
+    /// the address of the frame counter register
+    static constexpr NES_Address FRAME_COUNTER_ADDRESS = 0x4017;
+
+    /// @brief Write a value to an APU register if the value changed.
+    ///
+    /// @param address the address of the register in [$4000, $4017]
+    /// @param value the value to write to the register
+    /// @param force true to write the value even if it did not change
+    /// @details
+    /// Writes to the length counter registers ($4003, $4007, $400B, $400F)
+    /// reset the phase of the channel, so these must only occur when the
+    /// value actually changes or when a note is (re)triggered.
+    ///
+    inline void write(NES_Address address, NES_Byte value, bool force = false) {
+        const auto index = address - Nes_Apu::start_addr;
+        if (!force && is_written[index] && registers[index] == value) return;
+        registers[index] = value;
+        is_written[index] = true;
+        apu.write_register(0, address, value);
+    }
+
+    /// @brief Set the enable bit for a channel in the status register.
+    ///
+    /// @param channel the channel to enable or disable
+    /// @param gate true to enable the channel, false to disable it
+    /// @returns true if the channel was just enabled, false otherwise
+    ///
+    inline bool set_enabled(Channel channel, bool gate) {
+        const NES_Byte mask = 1 << channel;
+        const bool was_enabled = enables & mask;
+        enables = gate ? (enables | mask) : (enables & ~mask);
+        write(SND_CHN_ADDRESS, enables);
+        return gate && !was_enabled;
+    }
+
+ public:
+    /// @brief Initialize a new APU voice.
+    APUVoice() { reset(); }
+
+    /// @brief Return the 11-bit timer period for a square wave.
+    ///
+    /// @param frequency the frequency of the square wave in Hz
+    /// @returns the timer period, clamped to the audible range [8, $7FF]
+    /// @details
+    /// the method is branch-free so loops over many voices vectorize
+    ///
+    static inline int pulse_period(float frequency) {
+        float period = CLOCK_RATE / (16.f * frequency) - 1.f;
+        period = std::min(std::max(period, 8.f), static_cast<float>(0x7FF));
+        return static_cast<int>(period + 0.5f);
+    }
+
+    /// @brief Return the 11-bit timer period for a triangle wave.
+    ///
+    /// @param frequency the frequency of the triangle wave in Hz
+    /// @returns the timer period, clamped to the audible range [2, $7FF]
+    /// @details
+    /// the method is branch-free so loops over many voices vectorize
+    ///
+    static inline int triangle_period(float frequency) {
+        float period = CLOCK_RATE / (32.f * frequency) - 1.f;
+        period = std::min(std::max(period, 2.f), static_cast<float>(0x7FF));
+        return static_cast<int>(period + 0.5f);
+    }
+
+    /// @brief Return the 4-bit period index for the noise channel.
+    ///
+    /// @param frequency the frequency of the noise in Hz
+    /// @returns the index of the hardware noise period that is nearest to
+    /// 1/16th of the period of the given frequency (in log space)
+    /// @details
+    /// the index is the number of geometric means between adjacent hardware
+    /// periods that are below the target period. Comparing squares avoids
+    /// the square roots and keeps the method branch-free
+    ///
+    static inline int noise_period(float frequency) {
+        // products of adjacent noise timer periods in CPU cycles (NTSC)
+        static constexpr float PRODUCTS[15] = {
+            4 * 8, 8 * 16, 16 * 32, 32 * 64, 64 * 96, 96 * 128, 128 * 160,
+            160 * 202, 202 * 254, 254 * 380, 380 * 508, 508 * 762,
+            762 * 1016, 1016 * 2034, 2034 * 4068
+        };
+        const float period = CLOCK_RATE / (16.f * frequency);
+        const float squared = period * period;
+        int index = 0;
+        for (int i = 0; i < 15; i++) index += squared > PRODUCTS[i];
+        return index;
+    }
+
+    /// @brief Set the output buffer for a channel on the APU.
+    ///
+    /// @param channel the channel to set the output buffer of
+    /// @param buffer the buffer to synthesize into (nullptr to mute)
+    ///
+    inline void set_output(int channel, Blip_Buffer* buffer) {
+        apu.osc_output(channel, buffer);
+    }
+
+    /// @brief Set the output buffer for all channels on the APU.
+    ///
+    /// @param buffer the buffer to synthesize the mix into (nullptr to mute)
+    ///
+    inline void set_output(Blip_Buffer* buffer) { apu.output(buffer); }
+
+    /// @brief Set the synthesizers for the channels of the APU.
+    ///
+    /// @param square1 the synthesizer for the first square channel
+    /// @param square2 the synthesizer for the second square channel
+    /// @param triangle the synthesizer for the triangle channel
+    /// @param noise the synthesizer for the noise channel
+    /// @param dmc the synthesizer for the DMC channel
+    /// @details
+    /// sharing synthesizers between voices shares their impulse tables, a
+    /// nullptr selects the APU's own synthesizer for the channel
+    ///
+    inline void set_synths(
+        const Nes_Square::Synth* square1,
+        const Nes_Square::Synth* square2,
+        const Nes_Triangle::Synth* triangle,
+        const Nes_Noise::Synth* noise,
+        const Nes_Dmc::Synth* dmc
+    ) { apu.synths(square1, square2, triangle, noise, dmc); }
+
+    /// @brief Reset the APU and clear the register shadows.
+    void reset() {
+        apu.reset();
+        std::memset(registers, 0, sizeof registers);
+        std::memset(is_written, 0, sizeof is_written);
+        enables = 0;
+        // disable the frame IRQ, there is no CPU to service it
+        write(FRAME_COUNTER_ADDRESS, 0x40);
+        // disable the sweep units (negate flag with shift 0 never mutes)
+        write(0x4001, 0x08);
+        write(0x4005, 0x08);
+    }
+
+    /// @brief Set the registers of one of the square wave channels.
+    ///
+    /// @param channel the square channel to set, SQUARE1 or SQUARE2
+    /// @param period the 11-bit timer period, see `pulse_period`
+    /// @param duty the duty cycle index in [0, 3] (12.5%, 25%, 50%, 75%)
+    /// @param volume the constant volume in [0, 15]
+    /// @param gate whether the channel is enabled
+    ///
+    void set_square(Channel channel, int period, int duty, int volume, bool gate) {
+        const NES_Address base = 0x4000 + 4 * (channel == SQUARE2);
+        // duty, length counter halt, constant volume, volume
+        write(base + 0, ((duty & 0x3) << 6) | 0x30 | (volume & 0xF));
+        const bool is_triggered = set_enabled(channel, gate);
+        write(base + 2, period & 0xFF);
+        // only write the high byte when it changes (or on note on) because
+        // the write resets the phase of the square wave
+        write(base + 3, (period >> 8) & 0x7, is_triggered);
+    }
+
+    /// @brief Set the registers of the triangle wave channel.
+    ///
+    /// @param period the 11-bit timer period, see `triangle_period`
+    /// @param gate whether the channel is enabled
+    ///
+    void set_triangle(int period, bool gate) {
+        // linear counter control (halt) with the maximal reload value
+        write(0x4008, 0xFF);
+        const bool is_triggered = set_enabled(TRIANGLE, gate);
+        write(0x400A, period & 0xFF);
+        write(0x400B, (period >> 8) & 0x7, is_triggered);
+    }
+
+    /// @brief Set the registers of the noise channel.
+    ///
+    /// @param period the 4-bit period index, see `noise_period`
+    /// @param is_short whether to use the short (93-step) LFSR sequence
+    /// @param volume the constant volume in [0, 15]
+    /// @param gate whether the channel is enabled
+    ///
+    void set_noise(int period, bool is_short, int volume, bool gate) {
+        write(0x400C, 0x30 | (volume & 0xF));
+        const bool is_triggered = set_enabled(NOISE, gate);
+        write(0x400E, (is_short << 7) | (period & 0xF));
+        write(0x400F, 0x00, is_triggered);
+    }
+
+    /// @brief Set the level of the DMC channel's 7-bit DAC directly.
+    ///
+    /// @param level the level of the DAC in [0, 127]
+    ///
+    inline void set_dmc(int level) { write(0x4011, level & 0x7F); }
+
+    /// @brief Run the APU for a number of CPU cycles.
+    ///
+    /// @param cycles the number of CPU cycles to run the APU for
+    ///
+    inline void end_frame(cpu_time_t cycles) { apu.end_frame(cycles); }
+};
+
+}  // namespace NES
+
+#endif  // NES_APU_VOICE_HPP
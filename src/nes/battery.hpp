@@ -0,0 +1,217 @@
+//  Program:      nes-py
+//  File:         battery.hpp
+//  Description:  This class keeps battery backed RAM in a save file
+//
+//  Copyright (c) 2020 Christian Kauten. All rights reserved.
+//
+
+#ifndef NES_BATTERY_HPP
+#define NES_BATTERY_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#if defined(_WIN32)
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+#include "common.hpp"
+
+namespace NES {
+
+/// Battery backed RAM that is mapped onto a save file.
+///
+/// @details
+/// The RAM is the memory of the file mapping, so the emulator reads and
+/// writes the file without any I/O of its own. Writes mark the RAM dirty
+/// with a relaxed store and a background thread flushes the mapping to
+/// disk when it is dirty, so the thread that runs the emulator never waits
+/// on the disk. The mapping is flushed one last time when it is closed.
+///
+class BatteryRAM {
+ public:
+    /// the number of bytes of battery backed RAM ($6000 to $7FFF)
+    static constexpr std::size_t SIZE = 0x2000;
+
+    /// @brief Return the path of the save file for a ROM.
+    ///
+    /// @param rom_path the path to the ROM
+    /// @returns the path with the extension of the ROM replaced by .sav
+    ///
+    static std::string get_save_path(const std::string& rom_path) {
+        const auto dot = rom_path.find_last_of('.');
+        const auto slash = rom_path.find_last_of("/\\");
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+            return rom_path + ".sav";
+        return rom_path.substr(0, dot) + ".sav";
+    }
+
+ private:
+    /// the memory of the file mapping (nullptr if closed)
+    NES_Byte* memory = nullptr;
+    /// whether the file did not hold a full save when it was opened
+    bool is_created = false;
+    /// whether the RAM was written since the last flush
+    std::atomic<bool> is_dirty{false};
+#if defined(_WIN32)
+    /// the handle of the save file
+    HANDLE file = INVALID_HANDLE_VALUE;
+    /// the handle of the file mapping
+    HANDLE mapping = nullptr;
+#else
+    /// the descriptor of the save file
+    int file = -1;
+#endif
+
+    /// the background thread that flushes the mapping
+    std::thread flusher;
+    /// a lock for waking the flush thread
+    std::mutex mutex;
+    /// a condition for waking the flush thread
+    std::condition_variable condition;
+    /// whether the flush thread should stop
+    bool is_stopping = false;
+
+    /// @brief Write the mapping to disk.
+    void flush() {
+#if defined(_WIN32)
+        FlushViewOfFile(memory, SIZE);
+        FlushFileBuffers(file);
+#else
+        msync(memory, SIZE, MS_SYNC);
+#endif
+    }
+
+    /// @brief Flush the mapping periodically until the battery closes.
+    void run() {
+        // the period that the mapping is checked for writes at
+        const std::chrono::milliseconds period(1000);
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!is_stopping) {
+            condition.wait_for(lock, period);
+            if (is_dirty.exchange(false, std::memory_order_relaxed)) flush();
+        }
+    }
+
+    /// @brief Map the save file into memory.
+    ///
+    /// @param path the path of the save file
+    /// @returns true if the file is mapped, false otherwise
+    ///
+    bool map(const std::string& path) {
+#if defined(_WIN32)
+        file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+            nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size)) return false;
+        is_created = static_cast<std::size_t>(size.QuadPart) < SIZE;
+        // the mapping grows the file to the size of the RAM
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, 0, SIZE, nullptr);
+        if (mapping == nullptr) return false;
+        memory = static_cast<NES_Byte*>(MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, SIZE));
+        return memory != nullptr;
+#else
+        file = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (file < 0) return false;
+        struct stat status;
+        if (fstat(file, &status) != 0) return false;
+        is_created = static_cast<std::size_t>(status.st_size) < SIZE;
+        if (is_created && ftruncate(file, SIZE) != 0) return false;
+        void* address = mmap(nullptr, SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+        if (address == MAP_FAILED) return false;
+        memory = static_cast<NES_Byte*>(address);
+        return true;
+#endif
+    }
+
+    /// @brief Unmap the save file and close it.
+    void unmap() {
+#if defined(_WIN32)
+        if (memory != nullptr) UnmapViewOfFile(memory);
+        if (mapping != nullptr) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (memory != nullptr) munmap(memory, SIZE);
+        if (file >= 0) ::close(file);
+        file = -1;
+#endif
+        memory = nullptr;
+    }
+
+ public:
+    /// @brief Initialize a new closed battery.
+    BatteryRAM() { }
+
+    /// @brief Flush and close the save file.
+    ~BatteryRAM() { close(); }
+
+    BatteryRAM(const BatteryRAM&) = delete;
+    BatteryRAM& operator=(const BatteryRAM&) = delete;
+
+    /// @brief Open a save file and map it as the RAM.
+    ///
+    /// @param path the path of the save file, it is created if it does not
+    /// exist
+    /// @returns true if the file is mapped, false if the RAM is not battery
+    /// backed because the file could not be opened or mapped
+    ///
+    bool open(const std::string& path) {
+        close();
+        if (!map(path)) {
+            NES_DEBUG("failed to map save file " << path);
+            unmap();
+            return false;
+        }
+        is_dirty = false;
+        is_stopping = false;
+        flusher = std::thread(&BatteryRAM::run, this);
+        return true;
+    }
+
+    /// @brief Flush the RAM and close the save file.
+    void close() {
+        if (flusher.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                is_stopping = true;
+            }
+            condition.notify_one();
+            flusher.join();
+        }
+        if (memory != nullptr) flush();
+        unmap();
+    }
+
+    /// @brief Return true if a save file is mapped.
+    inline bool is_open() const { return memory != nullptr; }
+
+    /// @brief Return true if the save file was created (or was too short)
+    /// when it was opened, i.e., it does not hold a save yet.
+    inline bool is_new() const { return is_created; }
+
+    /// @brief Return the memory of the RAM.
+    inline NES_Byte* data() { return memory; }
+
+    /// @brief Return the memory of the RAM.
+    inline const NES_Byte* data() const { return memory; }
+
+    /// @brief Mark the RAM as written so the flush thread writes it to disk.
+    inline void touch() { is_dirty.store(true, std::memory_order_relaxed); }
+};
+
+}  // namespace NES
+
+#endif  // NES_BATTERY_HPP
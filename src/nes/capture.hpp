@@ -0,0 +1,378 @@
+//  Program:      nes-py
+//  File:         capture.hpp
+//  Description:  This class captures the frames and audio of the emulator
+//                to disk while it runs
+//
+//  Copyright (c) 2020 Christian Kauten. All rights reserved.
+//
+
+#ifndef NES_CAPTURE_HPP
+#define NES_CAPTURE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "common.hpp"
+#include "ppu.hpp"
+#include "apu.hpp"
+
+namespace NES {
+
+/// A recorder of the frames and the audio of every channel of the emulator.
+///
+/// @details
+/// Frames are captured as the 8-bit palette indexes of the PPU (60KB per
+/// frame instead of the 580KB of the NTSC filtered screen) and samples as
+/// the 16-bit output of every channel. A single producer (the thread that
+/// runs the emulator) pushes them into fixed-size lock-free rings, and a
+/// background thread converts the frames to a YUV4MPEG2 video and writes
+/// the samples to a WAV file with a channel for each channel of the APU.
+/// Pushing never allocates, locks, or touches the disk; if the writer falls
+/// behind, frames and samples are dropped and counted, and the writer fills
+/// in for them where they were dropped (with the last frame and silence) so
+/// the video and the audio keep their length and stay in sync. When the
+/// capture is not recording, pushing is a single relaxed atomic load.
+///
+class Capture {
+ public:
+    /// the width of the frames in pixels
+    static constexpr int WIDTH = SCANLINE_VISIBLE_DOTS;
+    /// the height of the frames in pixels
+    static constexpr int HEIGHT = VISIBLE_SCANLINES;
+    /// the number of bytes in a frame of palette indexes
+    static constexpr std::size_t FRAME_BYTES = WIDTH * HEIGHT;
+    /// the number of frames the ring can hold (a power of 2, about 1s)
+    static constexpr std::size_t FRAME_CAPACITY = 64;
+    /// the number of samples of every channel the ring can hold (a power of
+    /// 2, about 1.4s at 96kHz)
+    static constexpr std::size_t SAMPLE_CAPACITY = 1 << 17;
+    /// the number of channels of audio
+    static constexpr std::size_t NUM_CHANNELS = APU::NUM_CHANNELS;
+
+ private:
+    /// the number of bytes in the header of the WAV file
+    static constexpr long WAV_HEADER_SIZE = 44;
+
+    /// the ring of frames
+    std::vector<NES_Byte> frames;
+    /// the ring of samples (with the channels of each sample interleaved)
+    std::vector<int16_t> samples;
+    /// the number of frames dropped right before each frame of the ring
+    std::vector<uint32_t> frame_gaps;
+    /// the number of samples dropped right before each sample of the ring
+    std::vector<uint32_t> sample_gaps;
+    /// the frames and samples dropped since the last one that was pushed
+    /// (owned by the producer)
+    uint32_t pending_frames = 0;
+    uint32_t pending_samples = 0;
+    /// the index of the next frame to write (owned by the producer)
+    std::atomic<std::size_t> frame_head{0};
+    /// the index of the next frame to read (owned by the writer thread)
+    std::atomic<std::size_t> frame_tail{0};
+    /// the index of the next sample to write (owned by the producer)
+    std::atomic<std::size_t> sample_head{0};
+    /// the index of the next sample to read (owned by the writer thread)
+    std::atomic<std::size_t> sample_tail{0};
+    /// the number of frames dropped because the ring was full
+    std::atomic<uint64_t> dropped_frames{0};
+    /// the number of samples dropped because the ring was full
+    std::atomic<uint64_t> dropped_samples{0};
+    /// the number of frames written to the video
+    std::atomic<uint64_t> written_frames{0};
+    /// whether frames and samples are being recorded
+    std::atomic<bool> is_recording{false};
+
+    /// the background thread that writes the frames and samples to disk
+    std::thread writer;
+    /// a lock for waking the writer thread
+    std::mutex mutex;
+    /// a condition for waking the writer thread
+    std::condition_variable condition;
+    /// whether the writer thread should stop
+    bool is_stopping = false;
+    /// the file that the video is written to
+    std::FILE* video = nullptr;
+    /// the file that the audio is written to
+    std::FILE* audio = nullptr;
+    /// the sample rate of the audio
+    uint32_t sample_rate = 0;
+    /// the number of samples written to the audio
+    uint64_t written_samples = 0;
+    /// the dropped frames and samples that the writer has filled in for
+    uint64_t filled_frames = 0;
+    uint64_t filled_samples = 0;
+    /// the luma and chroma of the colors of the palette
+    NES_Byte luma[64];
+    NES_Byte chroma_blue[64];
+    NES_Byte chroma_red[64];
+    /// the YUV planes of the last frame (owned by the writer thread)
+    std::vector<NES_Byte> planes;
+
+    /// @brief Write a 32-bit little-endian integer to a file.
+    static void write_u32(std::FILE* file, uint32_t value) {
+        const NES_Byte bytes[4] = {
+            NES_Byte(value), NES_Byte(value >> 8), NES_Byte(value >> 16), NES_Byte(value >> 24)
+        };
+        std::fwrite(bytes, 1, sizeof bytes, file);
+    }
+
+    /// @brief Write a 16-bit little-endian integer to a file.
+    static void write_u16(std::FILE* file, uint16_t value) {
+        const NES_Byte bytes[2] = {NES_Byte(value), NES_Byte(value >> 8)};
+        std::fwrite(bytes, 1, sizeof bytes, file);
+    }
+
+    /// @brief Write the header of the WAV file for the samples written.
+    void write_wav_header() {
+        const uint32_t block = NUM_CHANNELS * sizeof(int16_t);
+        const uint32_t bytes = written_samples * block;
+        std::fseek(audio, 0, SEEK_SET);
+        std::fwrite("RIFF", 1, 4, audio);
+        write_u32(audio, WAV_HEADER_SIZE - 8 + bytes);
+        std::fwrite("WAVEfmt ", 1, 8, audio);
+        write_u32(audio, 16);
+        write_u16(audio, 1);  // PCM
+        write_u16(audio, NUM_CHANNELS);
+        write_u32(audio, sample_rate);
+        write_u32(audio, sample_rate * block);
+        write_u16(audio, block);
+        write_u16(audio, 16);
+        std::fwrite("data", 1, 4, audio);
+        write_u32(audio, bytes);
+    }
+
+    /// @brief Set up the colors of the palette from the NTSC filter.
+    void setup_palette() {
+        NES_Byte rgb[64 * 3];
+        std::unique_ptr<nes_ntsc_t> ntsc(new nes_ntsc_t);
+        nes_ntsc_setup_t setup = nes_ntsc_composite;
+        setup.palette_out = rgb;
+        nes_ntsc_init(ntsc.get(), &setup);
+        // BT.601 with the studio range of luma and chroma
+        for (int i = 0; i < 64; i++) {
+            const float r = rgb[3 * i], g = rgb[3 * i + 1], b = rgb[3 * i + 2];
+            luma[i] = 16.5f + (65.738f * r + 129.057f * g + 25.064f * b) / 256.f;
+            chroma_blue[i] = 128.5f + (-37.945f * r - 74.494f * g + 112.439f * b) / 256.f;
+            chroma_red[i] = 128.5f + (112.439f * r - 94.154f * g - 18.285f * b) / 256.f;
+        }
+    }
+
+    /// @brief Write a frame of palette indexes to the video.
+    void write_frame(const NES_Byte* pixels) {
+        NES_Byte* y = planes.data();
+        NES_Byte* u = y + FRAME_BYTES;
+        NES_Byte* v = u + FRAME_BYTES;
+        for (std::size_t i = 0; i < FRAME_BYTES; i++) {
+            const NES_Byte index = pixels[i] & 0x3f;
+            y[i] = luma[index];
+            u[i] = chroma_blue[index];
+            v[i] = chroma_red[index];
+        }
+        repeat_frame();
+    }
+
+    /// @brief Write the last frame to the video again.
+    void repeat_frame() {
+        std::fputs("FRAME\n", video);
+        std::fwrite(planes.data(), 1, planes.size(), video);
+        written_frames.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /// @brief Write silence to the audio.
+    ///
+    /// @param count the number of samples of silence to write
+    ///
+    void write_silence(uint64_t count) {
+        static constexpr int16_t silence[NUM_CHANNELS] = {};
+        for (uint64_t i = 0; i < count; i++) std::fwrite(silence, sizeof silence, 1, audio);
+        written_samples += count;
+    }
+
+    /// @brief Write the frames and samples in the rings to the files.
+    ///
+    /// @param is_final whether the capture is stopping, in which case the
+    /// frames and samples dropped after the last ones that were pushed are
+    /// filled in at the end
+    ///
+    void drain(bool is_final) {
+        // frames, after the frames that were dropped before each of them
+        std::size_t index = frame_tail.load(std::memory_order_relaxed);
+        std::size_t end = frame_head.load(std::memory_order_acquire);
+        for (; index != end; index++) {
+            const std::size_t offset = index & (FRAME_CAPACITY - 1);
+            for (uint32_t gap = frame_gaps[offset]; gap > 0; gap--, filled_frames++) repeat_frame();
+            write_frame(&frames[offset * FRAME_BYTES]);
+        }
+        frame_tail.store(index, std::memory_order_release);
+        // samples, in runs that end at the ring or at the samples that were
+        // dropped
+        index = sample_tail.load(std::memory_order_relaxed);
+        end = sample_head.load(std::memory_order_acquire);
+        while (index != end) {
+            const std::size_t offset = index & (SAMPLE_CAPACITY - 1);
+            const std::size_t limit = std::min(end - index, SAMPLE_CAPACITY - offset);
+            write_silence(sample_gaps[offset]);
+            filled_samples += sample_gaps[offset];
+            std::size_t count = 1;
+            while (count < limit && sample_gaps[offset + count] == 0) count++;
+            std::fwrite(&samples[offset * NUM_CHANNELS], sizeof(int16_t) * NUM_CHANNELS, count, audio);
+            index += count;
+            written_samples += count;
+        }
+        sample_tail.store(index, std::memory_order_release);
+        if (!is_final) return;
+        const uint64_t frames_dropped = dropped_frames.load(std::memory_order_relaxed);
+        for (; filled_frames < frames_dropped; filled_frames++) repeat_frame();
+        write_silence(dropped_samples.load(std::memory_order_relaxed) - filled_samples);
+        filled_samples = dropped_samples.load(std::memory_order_relaxed);
+    }
+
+    /// @brief Drain the rings periodically until the capture stops.
+    void run() {
+        // the period that the rings are drained at
+        const std::chrono::milliseconds period(50);
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!is_stopping) {
+            condition.wait_for(lock, period);
+            drain(false);
+        }
+        drain(true);
+    }
+
+ public:
+    /// @brief Initialize a new capture.
+    Capture() { }
+
+    /// @brief Stop recording and close the files.
+    ~Capture() { stop(); }
+
+    Capture(const Capture&) = delete;
+    Capture& operator=(const Capture&) = delete;
+
+    /// @brief Return true if the capture is recording.
+    inline bool is_active() const {
+        return is_recording.load(std::memory_order_relaxed);
+    }
+
+    /// @brief Return the number of frames written in the recording.
+    inline uint64_t get_frames() const { return written_frames.load(); }
+
+    /// @brief Return the number of frames dropped in the recording.
+    inline uint64_t get_dropped_frames() const { return dropped_frames.load(); }
+
+    /// @brief Return the number of samples dropped in the recording.
+    inline uint64_t get_dropped_samples() const { return dropped_samples.load(); }
+
+    /// @brief Record a frame of palette indexes.
+    ///
+    /// @param pixels the palette indexes of the frame (i.e., PPU::get_pixels)
+    ///
+    inline void push_frame(const NES_Byte* pixels) {
+        if (!is_active()) return;
+        const std::size_t index = frame_head.load(std::memory_order_relaxed);
+        if (index - frame_tail.load(std::memory_order_acquire) >= FRAME_CAPACITY) {
+            dropped_frames.fetch_add(1, std::memory_order_relaxed);
+            pending_frames++;
+            return;
+        }
+        frame_gaps[index & (FRAME_CAPACITY - 1)] = pending_frames;
+        pending_frames = 0;
+        std::memcpy(&frames[(index & (FRAME_CAPACITY - 1)) * FRAME_BYTES], pixels, FRAME_BYTES);
+        frame_head.store(index + 1, std::memory_order_release);
+    }
+
+    /// @brief Record a sample of every channel.
+    ///
+    /// @param sample the samples of the NUM_CHANNELS channels
+    ///
+    inline void push_sample(const int16_t* sample) {
+        if (!is_active()) return;
+        const std::size_t index = sample_head.load(std::memory_order_relaxed);
+        if (index - sample_tail.load(std::memory_order_acquire) >= SAMPLE_CAPACITY) {
+            dropped_samples.fetch_add(1, std::memory_order_relaxed);
+            pending_samples++;
+            return;
+        }
+        sample_gaps[index & (SAMPLE_CAPACITY - 1)] = pending_samples;
+        pending_samples = 0;
+        std::memcpy(&samples[(index & (SAMPLE_CAPACITY - 1)) * NUM_CHANNELS], sample, sizeof(int16_t) * NUM_CHANNELS);
+        sample_head.store(index + 1, std::memory_order_release);
+    }
+
+    /// @brief Start recording to a video and a WAV file.
+    ///
+    /// @param video_path the path of the YUV4MPEG2 (.y4m) file for the frames
+    /// @param audio_path the path of the WAV file for the samples
+    /// @param rate the sample rate of the samples
+    /// @returns true if the recording started, false if a file could not be
+    /// opened
+    /// @details
+    /// The rings are allocated the first time the capture starts, so a
+    /// capture that never records costs nothing.
+    ///
+    bool start(const std::string& video_path, const std::string& audio_path, uint32_t rate) {
+        stop();
+        video = std::fopen(video_path.c_str(), "wb");
+        audio = std::fopen(audio_path.c_str(), "wb");
+        if (video == nullptr || audio == nullptr) {
+            stop();
+            return false;
+        }
+        frames.resize(FRAME_CAPACITY * FRAME_BYTES);
+        samples.resize(SAMPLE_CAPACITY * NUM_CHANNELS);
+        frame_gaps.resize(FRAME_CAPACITY);
+        sample_gaps.resize(SAMPLE_CAPACITY);
+        // the frames dropped before the first are black
+        planes.assign(3 * FRAME_BYTES, 128);
+        std::fill_n(planes.begin(), FRAME_BYTES, 16);
+        setup_palette();
+        // the frames are progressive 4:4:4 at the NTSC frame rate
+        std::fprintf(video, "YUV4MPEG2 W%d H%d F39375000:655171 Ip A1:1 C444\n", WIDTH, HEIGHT);
+        sample_rate = rate;
+        written_samples = 0;
+        write_wav_header();
+        frame_head = frame_tail = 0;
+        sample_head = sample_tail = 0;
+        dropped_frames = dropped_samples = written_frames = 0;
+        filled_frames = filled_samples = 0;
+        pending_frames = pending_samples = 0;
+        is_stopping = false;
+        writer = std::thread(&Capture::run, this);
+        is_recording = true;
+        return true;
+    }
+
+    /// @brief Stop recording and finish the files.
+    void stop() {
+        is_recording = false;
+        if (writer.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                is_stopping = true;
+            }
+            condition.notify_one();
+            writer.join();
+        }
+        if (video != nullptr) {
+            std::fclose(video);
+            video = nullptr;
+        }
+        if (audio != nullptr) {
+            write_wav_header();
+            std::fclose(audio);
+            audio = nullptr;
+        }
+    }
+};
+
+}  // namespace NES
+
+#endif  // NES_CAPTURE_HPP
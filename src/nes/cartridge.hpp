@@ -9,12 +9,14 @@
 #define NES_MAPPER_FACTORY_HPP
 
 #include <string>
+#ifndef NES_NO_JSON
 #include <jansson.h>
+#endif  // NES_NO_JSON
 #include "rom.hpp"
 #include "mappers/mapper0_NROM.hpp"
 #include "mappers/mapper1_MMC1.hpp"
-#include "mappers/mapper2_UNROM.hpp"
-#include "mappers/mapper3_CNROM.hpp"
+#include "mappers/mapper4_MMC3.hpp"
+#include "mappers/discrete.hpp"
 
 namespace NES {
 
@@ -33,10 +35,16 @@ class Cartridge : public ROM {
  public:
     /// an enumeration of supported mapper IDs
     enum class MapperID : NES_Byte {
-        NROM   = 0,
-        MMC1   = 1,
-        UNROM  = 2,
-        CNROM  = 3,
+        NROM        = 0,
+        MMC1        = 1,
+        UNROM       = 2,
+        CNROM       = 3,
+        MMC3        = 4,
+        AxROM       = 7,
+        ColorDreams = 11,
+        CPROM       = 13,
+        BNROM       = 34,
+        GxROM       = 66,
     };
 
     /// Create a new Cartridge.
@@ -50,10 +58,16 @@ class Cartridge : public ROM {
         // load the mapper
         NES_DEBUG("loading mapper with ID " << static_cast<int>(cartridge->get_mapper_number()));
         switch (static_cast<MapperID>(cartridge->get_mapper_number())) {
-            case MapperID::NROM:  cartridge->mapper = new MapperNROM(*cartridge);           break;
-            case MapperID::MMC1:  cartridge->mapper = new MapperMMC1(*cartridge, callback); break;
-            case MapperID::UNROM: cartridge->mapper = new MapperUNROM(*cartridge);          break;
-            case MapperID::CNROM: cartridge->mapper = new MapperCNROM(*cartridge);          break;
+            case MapperID::NROM:        cartridge->mapper = new MapperNROM(*cartridge);                  break;
+            case MapperID::MMC1:        cartridge->mapper = new MapperMMC1(*cartridge, callback);        break;
+            case MapperID::UNROM:       cartridge->mapper = new MapperUNROM(*cartridge, callback);       break;
+            case MapperID::CNROM:       cartridge->mapper = new MapperCNROM(*cartridge, callback);       break;
+            case MapperID::MMC3:        cartridge->mapper = new MapperMMC3(*cartridge, callback);        break;
+            case MapperID::AxROM:       cartridge->mapper = new MapperAxROM(*cartridge, callback);       break;
+            case MapperID::ColorDreams: cartridge->mapper = new MapperColorDreams(*cartridge, callback); break;
+            case MapperID::CPROM:       cartridge->mapper = new MapperCPROM(*cartridge, callback);       break;
+            case MapperID::BNROM:       cartridge->mapper = new MapperBNROM(*cartridge, callback);       break;
+            case MapperID::GxROM:       cartridge->mapper = new MapperGxROM(*cartridge, callback);       break;
             default: delete cartridge; cartridge = nullptr;
         }
         // return the cartridge
@@ -74,6 +88,7 @@ class Cartridge : public ROM {
     /// Return a pointer to the mapper for the cartridge.
     inline Mapper* get_mapper() { return mapper; }
 
+#ifndef NES_NO_JSON
     /// Convert the object's state to a JSON object.
     json_t* dataToJson() const {
         json_t* rootJ = ROM::dataToJson();
@@ -87,6 +102,7 @@ class Cartridge : public ROM {
         json_t* json_data = json_object_get(rootJ, "mapper");
         if (json_data) mapper->dataFromJson(json_data);
     }
+#endif  // NES_NO_JSON
 };
 
 }  // namespace NES
@@ -19,6 +19,15 @@
 // #include <iostream>
 // #define NES_DEBUG(x) do { std::cerr << x << std::endl; } while (0)
 
+// The state of the core serializes to JSON using jansson. Define NES_NO_JSON
+// to build the core without jansson (and without dataToJson / dataFromJson),
+// e.g., for the headless tools in tools/.
+
+// Define NES_TRACE to call NES::trace_instruction before the CPU executes each
+// instruction, e.g., for the golden trace harness in tools/. The program that
+// defines NES_TRACE must define trace_instruction too. Without NES_TRACE, the
+// hook compiles to nothing.
+
 namespace NES {
 
 /// A shortcut for a byte
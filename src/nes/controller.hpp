@@ -8,7 +8,9 @@
 #ifndef NES_CONTROLLER_HPP
 #define NES_CONTROLLER_HPP
 
+#ifndef NES_NO_JSON
 #include <jansson.h>
+#endif  // NES_NO_JSON
 #include "common.hpp"
 
 namespace NES {
@@ -67,6 +69,7 @@ class Controller {
         return ret | 0x40;
     }
 
+#ifndef NES_NO_JSON
     /// Convert the object's state to a JSON object.
     json_t* dataToJson() const {
         json_t* rootJ = json_object();
@@ -94,6 +97,7 @@ class Controller {
             if (json_data) joypad_bits = json_boolean_value(json_data);
         }
     }
+#endif  // NES_NO_JSON
 };
 
 }  // namespace NES
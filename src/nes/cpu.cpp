@@ -453,6 +453,58 @@ bool CPU::type2(MainBus &bus, NES_Byte opcode) {
     return true;
 }
 
+void CPU::detect_idle_loop(MainBus &bus, NES_Address address, NES_Byte opcode) {
+    // the number of cycles the jump or branch took, including page crossing
+    const int jump_cycles = skip_cycles;
+    // a jump or branch to itself loops until an interrupt
+    if (register_PC == address) {
+        idle_loop = IdleLoop::Jump;
+        idle_cycles = jump_cycles;
+        return;
+    }
+    // only conditional branches can exit a polling loop
+    if ((opcode & BRANCH_INSTRUCTION_MASK) != BRANCH_INSTRUCTION_MASK_RESULT)
+        return;
+    // only fetch the loop body from RAM or cartridge space (no side effects)
+    if (register_PC >= 0x2000 && register_PC < 0x6000) return;
+    // the load must be the only instruction before the branch
+    const NES_Byte load = bus.read(register_PC);
+    const bool is_absolute = load == 0xAD || load == 0x2C;  // LDA / BIT abs
+    const bool is_zero_page = load == 0xA5 || load == 0x24;  // LDA / BIT zp
+    if (!(is_absolute && address - register_PC == 3) &&
+        !(is_zero_page && address - register_PC == 2))
+        return;
+    const NES_Address location = is_absolute ?
+        read_address(bus, register_PC + 1) : bus.read(register_PC + 1);
+    // only RAM and PPUSTATUS can be polled without side effects
+    if (location >= 0x2000 && location != 0x2002) return;
+    const bool is_bit = load == 0x2C || load == 0x24;
+    // the branch is taken while its flag matches the status bit of opcode
+    const bool is_taken_if_set = opcode & 0b00100000;
+    switch (static_cast<BranchFlagType>(opcode >> 6)) {
+        case BranchFlagType::Negative: {
+            idle_mask = 0x80;
+            idle_wake_if_set = !is_taken_if_set;
+            break;
+        }
+        case BranchFlagType::Overflow: {  // only BIT loads the V flag
+            if (!is_bit) return;
+            idle_mask = 0x40;
+            idle_wake_if_set = !is_taken_if_set;
+            break;
+        }
+        case BranchFlagType::Zero: {  // Z is set when the masked bits are 0
+            idle_mask = is_bit ? register_A : 0xFF;
+            idle_wake_if_set = is_taken_if_set;
+            break;
+        }
+        default: return;
+    }
+    idle_loop = IdleLoop::Poll;
+    idle_cycles = OPERATION_CYCLES[load] + jump_cycles;
+    idle_address = location;
+}
+
 void CPU::reset(NES_Address start_address) {
     register_PC = start_address;
     register_SP = 0xfd;
@@ -462,18 +514,26 @@ void CPU::reset(NES_Address start_address) {
     flags.byte = 0b00110100;
     skip_cycles = 0;
     cycles = 0;
+    is_nmi_pending = false;
+    idle_loop = IdleLoop::None;
 }
 
 void CPU::interrupt(MainBus &bus, InterruptType type) {
     if (flags.bits.I && type != NMI_INTERRUPT && type != BRK_INTERRUPT)
         return;
+    // wake from an idle loop, the interrupt returns to the start of the loop
+    idle_loop = IdleLoop::None;
     // Add one if BRK, a quirk of 6502
     if (type == BRK_INTERRUPT)
         ++register_PC;
     // push values on to the stack
     push_stack(bus, register_PC >> 8);
     push_stack(bus, register_PC);
-    push_stack(bus, flags.byte | 0b00100000 | (type == BRK_INTERRUPT) << 4);
+    // push the flags with the break flag set for BRK. the flags are not in
+    // the bit order of the 6502, so the bits are set by name
+    auto pushed = flags;
+    pushed.bits.B = type == BRK_INTERRUPT;
+    push_stack(bus, pushed.byte);
     // set the interrupt flag
     flags.bits.I = true;
     // handle the kind of interrupt
@@ -498,13 +558,38 @@ void CPU::cycle(MainBus &bus) {
         return;
     // reset the number of skip cycles to 0
     skip_cycles = 0;
+    // handle the interrupt lines between instructions, the first cycle of
+    // the interrupt is this one
+    if (is_nmi_pending) {
+        is_nmi_pending = false;
+        interrupt(bus, NMI_INTERRUPT);
+        return;
+    }
+    if (irq_line && !flags.bits.I) {
+        interrupt(bus, IRQ_INTERRUPT);
+        return;
+    }
+    // charge another iteration of the idle loop instead of executing it
+    if (idle_loop != IdleLoop::None) {
+        skip_cycles = idle_cycles;
+        return;
+    }
+#ifdef NES_TRACE
+    trace_instruction(*this);
+#endif  // NES_TRACE
+    // the address of the instruction to detect backward jumps
+    const NES_Address address = register_PC;
     // read the opcode from the bus and lookup the number of cycles
     NES_Byte op = bus.read(register_PC++);
+    ++instructions;
     // Using short-circuit evaluation, call the other function only if the
     // first failed. ExecuteImplied must be called first and ExecuteBranch
     // must be before ExecuteType0
     if (implied(bus, op) || branch(bus, op) || type1(bus, op) || type2(bus, op) || type0(bus, op)) {
         skip_cycles += OPERATION_CYCLES[op];
+        // a jump or branch backward may be the end of an idle loop
+        if (register_PC <= address && (op == JMP || (op & BRANCH_INSTRUCTION_MASK) == BRANCH_INSTRUCTION_MASK_RESULT))
+            detect_idle_loop(bus, address, op);
     } else {
         NES_DEBUG("failed to execute opcode: " << std::hex << +op);
     }
@@ -8,7 +8,9 @@
 #ifndef NES_CPU_HPP
 #define NES_CPU_HPP
 
+#ifndef NES_NO_JSON
 #include <jansson.h>
+#endif  // NES_NO_JSON
 #include "common.hpp"
 #include "cpu_opcodes.hpp"
 #include "main_bus.hpp"
@@ -48,6 +50,36 @@ class CPU {
     int skip_cycles = 0;
     /// The number of cycles the CPU has run
     int cycles = 0;
+    /// The number of instructions the CPU has executed
+    uint64_t instructions = 0;
+
+    /// The kinds of idle loops the CPU detects
+    enum class IdleLoop: NES_Byte {
+        /// the CPU is executing instructions
+        None,
+        /// a jump or branch to itself, only an interrupt ends the loop
+        Jump,
+        /// a load from RAM or PPUSTATUS with a branch back to the load
+        Poll,
+    };
+
+    /// The level of the NMI line at the last cycle
+    bool nmi_line = false;
+    /// Whether the NMI line was asserted and the NMI is not handled yet
+    bool is_nmi_pending = false;
+    /// The level of the IRQ line
+    bool irq_line = false;
+
+    /// The idle loop the CPU is sleeping in
+    IdleLoop idle_loop = IdleLoop::None;
+    /// The number of cycles in one iteration of the idle loop
+    int idle_cycles = 0;
+    /// The address that the idle loop polls
+    NES_Address idle_address = 0;
+    /// The bits of the polled value that the exit branch depends on
+    NES_Byte idle_mask = 0;
+    /// Whether the loop exits when the masked bits are set (or when clear)
+    bool idle_wake_if_set = false;
 
     /// Set the zero and negative flags based on the given value.
     ///
@@ -183,13 +215,27 @@ class CPU {
     ///
     bool type2(MainBus &bus, NES_Byte opcode);
 
+    /// Detect an idle loop after a jump or branch backward.
+    ///
+    /// @param bus the bus to read instructions from
+    /// @param address the address of the jump or branch instruction
+    /// @param opcode the opcode of the jump or branch instruction
+    /// @details
+    /// Idle loops are a JMP or branch to itself, and a load (LDA / BIT) from
+    /// RAM or PPUSTATUS followed by a branch back to the load. Once detected,
+    /// the CPU stops fetching instructions and charges one iteration of the
+    /// loop at a time until an interrupt occurs or the polled value changes
+    /// such that the branch would fall through.
+    ///
+    void detect_idle_loop(MainBus &bus, NES_Address address, NES_Byte opcode);
+
+ public:
     /// Reset the emulator using the given starting address.
     ///
     /// @param start_address the starting address for the program counter
     ///
     void reset(NES_Address start_address);
 
- public:
     /// The interrupt types available to this CPU
     enum InterruptType {
         IRQ_INTERRUPT,
@@ -208,17 +254,92 @@ class CPU {
     /// @param bus the main bus of the machine
     /// @param type the type of interrupt to issue
     ///
-    /// TODO: Assuming sequential execution, for asynchronously calling this
-    ///       with Execute, further work needed
-    ///
     void interrupt(MainBus &bus, InterruptType type);
 
+    /// Set the level of the NMI line.
+    ///
+    /// @param is_asserted whether the source of the NMI (the PPU) asserts it
+    /// @details
+    /// NMI is edge triggered: the CPU latches the edge and handles it at the
+    /// next instruction boundary.
+    ///
+    inline void set_nmi_line(bool is_asserted) {
+        is_nmi_pending |= is_asserted && !nmi_line;
+        nmi_line = is_asserted;
+    }
+
+    /// Set the level of the IRQ line.
+    ///
+    /// @param is_asserted whether any source of IRQ (e.g., the APU) asserts it
+    /// @details
+    /// IRQ is level triggered: the CPU handles it at every instruction
+    /// boundary that the line is asserted and the interrupt flag is clear.
+    ///
+    inline void set_irq_line(bool is_asserted) { irq_line = is_asserted; }
+
     /// Perform a full CPU cycle using and storing data in the given bus.
     ///
     /// @param bus the bus to read and write data from / to
     ///
     void cycle(MainBus &bus);
 
+    /// Return the number of instructions the CPU has executed.
+    inline uint64_t get_instructions() const { return instructions; }
+
+    /// Copy the state of another CPU without its instruction counter.
+    ///
+    /// @param other the CPU to copy the state of
+    ///
+    inline void copy_from(const CPU& other) {
+        const uint64_t executed = instructions;
+        *this = other;
+        instructions = executed;
+    }
+
+    /// Return the number of cycles the CPU has run since the last reset.
+    inline int get_cycles() const { return cycles; }
+
+    /// Return the program counter register.
+    inline NES_Address get_PC() const { return register_PC; }
+
+    /// Return the stack pointer register.
+    inline NES_Byte get_SP() const { return register_SP; }
+
+    /// Return the accumulator register.
+    inline NES_Byte get_A() const { return register_A; }
+
+    /// Return the X index register.
+    inline NES_Byte get_X() const { return register_X; }
+
+    /// Return the Y index register.
+    inline NES_Byte get_Y() const { return register_Y; }
+
+    /// Return the flags register.
+    inline NES_Byte get_flags() const { return flags.byte; }
+
+    /// Return true if the CPU is sleeping in an idle loop.
+    inline bool is_idle() const { return idle_loop != IdleLoop::None; }
+
+    /// Return true if the CPU is sleeping in a loop that polls a value.
+    inline bool is_polling() const { return idle_loop == IdleLoop::Poll; }
+
+    /// Return the address that the CPU is polling in an idle loop.
+    inline NES_Address get_poll_address() const { return idle_address; }
+
+    /// Wake the CPU from an idle loop if the polled value ends the loop.
+    ///
+    /// @param value the current value at the polled address (read without
+    /// side effects)
+    ///
+    inline void poll(NES_Byte value) {
+        // the loop exits when the branch condition changes. a poll of the
+        // vertical blank flag in PPUSTATUS would also clear the flag, so
+        // wake for it too and let the loop observe the change
+        if (static_cast<bool>(value & idle_mask) == idle_wake_if_set ||
+            (idle_address == 0x2002 && (value & 0x80) && idle_mask != 0x80))
+            idle_loop = IdleLoop::None;
+    }
+
     /// Skip DMA cycles.
     ///
     /// 513 = 256 read + 256 write + 1 dummy read
@@ -226,6 +347,7 @@ class CPU {
     ///
     inline void skip_DMA_cycles() { skip_cycles += 513 + (cycles & 1); }
 
+#ifndef NES_NO_JSON
     /// Convert the object's state to a JSON object.
     json_t* dataToJson() const {
         json_t* rootJ = json_object();
@@ -237,6 +359,14 @@ class CPU {
         json_object_set_new(rootJ, "flags", json_integer(flags.byte));
         json_object_set_new(rootJ, "skip_cycles", json_integer(skip_cycles));
         json_object_set_new(rootJ, "cycles", json_integer(cycles));
+        json_object_set_new(rootJ, "idle_loop", json_integer(static_cast<int>(idle_loop)));
+        json_object_set_new(rootJ, "idle_cycles", json_integer(idle_cycles));
+        json_object_set_new(rootJ, "idle_address", json_integer(idle_address));
+        json_object_set_new(rootJ, "idle_mask", json_integer(idle_mask));
+        json_object_set_new(rootJ, "idle_wake_if_set", json_boolean(idle_wake_if_set));
+        json_object_set_new(rootJ, "nmi_line", json_boolean(nmi_line));
+        json_object_set_new(rootJ, "is_nmi_pending", json_boolean(is_nmi_pending));
+        json_object_set_new(rootJ, "irq_line", json_boolean(irq_line));
         return rootJ;
     }
 
@@ -274,9 +404,46 @@ class CPU {
         json_t* cycles_ = json_object_get(rootJ, "cycles");
         if (cycles_)
             cycles = json_integer_value(cycles_);
+        // load idle_loop (states without it were saved while awake)
+        json_t* idle_loop_ = json_object_get(rootJ, "idle_loop");
+        idle_loop = idle_loop_ ?
+            static_cast<IdleLoop>(json_integer_value(idle_loop_)) : IdleLoop::None;
+        // load idle_cycles
+        json_t* idle_cycles_ = json_object_get(rootJ, "idle_cycles");
+        if (idle_cycles_)
+            idle_cycles = json_integer_value(idle_cycles_);
+        // load idle_address
+        json_t* idle_address_ = json_object_get(rootJ, "idle_address");
+        if (idle_address_)
+            idle_address = json_integer_value(idle_address_);
+        // load idle_mask
+        json_t* idle_mask_ = json_object_get(rootJ, "idle_mask");
+        if (idle_mask_)
+            idle_mask = json_integer_value(idle_mask_);
+        // load idle_wake_if_set
+        json_t* idle_wake_if_set_ = json_object_get(rootJ, "idle_wake_if_set");
+        if (idle_wake_if_set_)
+            idle_wake_if_set = json_boolean_value(idle_wake_if_set_);
+        // load the interrupt lines (states without them were saved between
+        // interrupts)
+        json_t* nmi_line_ = json_object_get(rootJ, "nmi_line");
+        nmi_line = nmi_line_ ? json_boolean_value(nmi_line_) : false;
+        json_t* is_nmi_pending_ = json_object_get(rootJ, "is_nmi_pending");
+        is_nmi_pending = is_nmi_pending_ ? json_boolean_value(is_nmi_pending_) : false;
+        json_t* irq_line_ = json_object_get(rootJ, "irq_line");
+        irq_line = irq_line_ ? json_boolean_value(irq_line_) : false;
     }
+#endif  // NES_NO_JSON
 };
 
+#ifdef NES_TRACE
+/// Observe the CPU before it executes the instruction at its program counter.
+///
+/// @param cpu the CPU that is about to execute an instruction
+///
+void trace_instruction(const CPU& cpu);
+#endif  // NES_TRACE
+
 }  // namespace NES
 
 #endif  // NES_CPU_HPP
@@ -16,22 +16,122 @@
 #include "main_bus.hpp"
 #include "picture_bus.hpp"
 #include "cartridge.hpp"
+#include "state.hpp"
+#include "profiler.hpp"
+#include "tracer.hpp"
+#ifndef NES_NO_JSON
 #include <jansson.h>
+#endif  // NES_NO_JSON
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <memory>
 #include <string>
 #include <limits>
+#include <vector>
 
 namespace NES {
 
+/// A snapshot of the profiling counters of an emulator.
+struct Profile {
+    /// the seconds of wall time since the counters started
+    double wall = 0;
+    /// the number of CPU cycles that the emulator has run
+    uint64_t cycles = 0;
+    /// the number of instructions that the CPU has executed
+    uint64_t instructions = 0;
+    /// the number of visible dots that the PPU has rendered
+    uint64_t dots = 0;
+    /// the estimated seconds spent in each stage of the emulator
+    double seconds[Profiler::NUM_STAGES] = {};
+    /// the number of reads from each I/O register (see io_register_address)
+    uint64_t io_reads[NUM_IO_REGISTERS] = {};
+    /// the number of writes to each I/O register (see io_register_address)
+    uint64_t io_writes[NUM_IO_REGISTERS] = {};
+
+    /// @brief Return the number of frames that the emulator has run.
+    inline uint64_t frames() const { return cycles / CYCLES_PER_FRAME; }
+
+    /// @brief Return the counters accumulated since an earlier snapshot.
+    ///
+    /// @param other the earlier snapshot to subtract from this one
+    /// @returns the difference between the snapshots
+    ///
+    Profile operator-(const Profile& other) const {
+        Profile delta;
+        delta.wall = wall - other.wall;
+        delta.cycles = cycles - other.cycles;
+        delta.instructions = instructions - other.instructions;
+        delta.dots = dots - other.dots;
+        for (int i = 0; i < Profiler::NUM_STAGES; i++)
+            delta.seconds[i] = seconds[i] - other.seconds[i];
+        for (std::size_t i = 0; i < NUM_IO_REGISTERS; i++) {
+            delta.io_reads[i] = io_reads[i] - other.io_reads[i];
+            delta.io_writes[i] = io_writes[i] - other.io_writes[i];
+        }
+        return delta;
+    }
+
+#ifndef NES_NO_JSON
+    /// @brief Convert the snapshot to a JSON object.
+    ///
+    /// @returns a JSON object with the counters of the snapshot
+    ///
+    json_t* dataToJson() const {
+        json_t* rootJ = json_object();
+        json_object_set_new(rootJ, "wall_seconds", json_real(wall));
+        json_object_set_new(rootJ, "cycles", json_integer(cycles));
+        json_object_set_new(rootJ, "frames", json_integer(frames()));
+        json_object_set_new(rootJ, "instructions", json_integer(instructions));
+        json_object_set_new(rootJ, "dots", json_integer(dots));
+        // the seconds spent in each stage
+        {
+            json_t* stagesJ = json_object();
+            for (int i = 0; i < Profiler::NUM_STAGES; i++) {
+                const auto stage = static_cast<Profiler::Stage>(i);
+                json_object_set_new(stagesJ, Profiler::get_name(stage), json_real(seconds[i]));
+            }
+            json_object_set_new(rootJ, "stage_seconds", stagesJ);
+        }
+        // the reads and writes of each I/O register keyed by address
+        {
+            json_t* registersJ = json_object();
+            for (std::size_t i = 0; i < NUM_IO_REGISTERS; i++) {
+                if (io_reads[i] == 0 && io_writes[i] == 0) continue;
+                char address[8];
+                snprintf(address, sizeof address, "$%04X", io_register_address(i));
+                json_t* registerJ = json_object();
+                json_object_set_new(registerJ, "reads", json_integer(io_reads[i]));
+                json_object_set_new(registerJ, "writes", json_integer(io_writes[i]));
+                json_object_set_new(registersJ, address, registerJ);
+            }
+            json_object_set_new(rootJ, "io_registers", registersJ);
+        }
+        return rootJ;
+    }
+#endif  // NES_NO_JSON
+};
+
 /// An NES Emulator and OpenAI Gym interface
 class Emulator {
  private:
     /// the number of elapsed cycles
     uint32_t cycles = 0;
+    /// the number of APU cycles deferred while the CPU is idle
+    uint32_t apu_cycles = 0;
     /// the virtual cartridge with ROM and mapper data
     Cartridge* cartridge = nullptr;
+    /// the identifier of the game that is loaded (identifies snapshots)
+    uint64_t game = 0;
+    /// whether finished frames are passed through the NTSC filter
+    bool is_rendering = true;
+    /// the PPU dots until the mapper counts a scanline (-1 for never)
+    int scanline_countdown = -1;
     /// the 2 controllers on the emulator
     Controller controllers[2];
 
+    /// the battery that keeps the extended RAM of the game in a save file
+    BatteryRAM battery;
     /// the main data bus (RAM and data passing / IO registers)
     MainBus bus;
     /// the picture bus (graphic data passing / IO registers)
@@ -44,6 +144,67 @@ class Emulator {
     /// the audio processing unit
     APU apu;
 
+    /// the timers for the stages of the emulator
+    Profiler profiler;
+    /// the timeline to record frames and NTSC blits to (not owned)
+    Tracer* tracer = nullptr;
+    /// the time that the current frame started at for the tracer
+    uint64_t frame_start = 0;
+
+    /// @brief Return the value at an address that the CPU may poll in an
+    /// idle loop without any side effects.
+    ///
+    /// @param address the address in RAM or the PPUSTATUS register
+    /// @returns the current value at the given address
+    ///
+    inline NES_Byte peek(NES_Address address) {
+        if (address == 0x2002) return ppu.peek_status();
+        return bus.get_memory_buffer()[address & 0x7ff];
+    }
+
+    /// @brief Read a byte of a DMC sample from the main bus.
+    ///
+    /// @param bus the main bus to read from
+    /// @param address the address of the byte to read
+    /// @returns the byte at the address on the bus
+    ///
+    static int read_dmc(void* bus, cpu_addr_t address) {
+        return static_cast<MainBus*>(bus)->read(address);
+    }
+
+    /// @brief Predict the dot that the mapper counts the next scanline on.
+    ///
+    /// @details
+    /// The prediction holds until the PPU registers that it depends on
+    /// change, so it is made again when they are written and when the state
+    /// of the emulator is replaced.
+    ///
+    inline void schedule_scanline() {
+        if (cartridge != nullptr && cartridge->get_mapper()->has_scanline_counter())
+            scanline_countdown = ppu.get_dots_to_a12_edge();
+        else
+            scanline_countdown = -1;
+    }
+
+    /// @brief Return a new identifier for a game.
+    ///
+    /// @details
+    /// The identifiers are unique across the emulators of the process, so
+    /// a snapshot of one emulator is never loaded into a different game in
+    /// another one.
+    ///
+    static uint64_t get_new_game() {
+        static std::atomic<uint64_t> games{0};
+        return ++games;
+    }
+
+    /// @brief Run the APU for the cycles that were deferred while idle.
+    inline void flush_apu() {
+        if (apu_cycles == 0) return;
+        apu.cycle(apu_cycles);
+        apu_cycles = 0;
+    }
+
  public:
     /// The width of the NES screen in pixels (after NTSC filtering)
     static constexpr int WIDTH = SCANLINE_VISIBLE_DOTS_NTSC;
@@ -56,6 +217,38 @@ class Emulator {
     /// The width of the NES screen in pixels
     static constexpr int WIDTH_NES = SCANLINE_VISIBLE_DOTS;
 
+    /// The state of an emulator at a point in time for rewinding to it.
+    ///
+    /// @details
+    /// A snapshot holds the state of every unit except the audio buffers,
+    /// the NTSC filter, and the ROM, which do not change. After the first
+    /// save, saving and loading copy into memory the snapshot already owns.
+    ///
+    struct Snapshot {
+        /// the game that the snapshot was saved from (0 for no game)
+        uint64_t game = 0;
+        /// the checksum of the ROM of the game
+        uint32_t rom = 0;
+        /// the state of the mapper on the cartridge
+        std::unique_ptr<ROM::Mapper> mapper;
+        /// the number of elapsed cycles in the frame
+        uint32_t cycles = 0;
+        /// the number of APU cycles deferred while the CPU is idle
+        uint32_t apu_cycles = 0;
+        /// the 2 controllers on the emulator
+        Controller controllers[2];
+        /// the memory of the main bus
+        MainBus bus;
+        /// the memory of the picture bus
+        PictureBus picture_bus;
+        /// the central processing unit
+        CPU cpu;
+        /// the picture processing unit
+        PPU::Snapshot ppu;
+        /// the audio processing unit
+        apu_snapshot_t apu;
+    };
+
     /// @brief Initialize a new emulator.
     Emulator() {
         // set the read callbacks
@@ -66,8 +259,8 @@ class Emulator {
         bus.set_read_callback(OAMDATA,   [&](void) { return ppu.get_OAM_data();        });
         bus.set_read_callback(SND_CHN,   [&](void) { return apu.read_status();         });
         // set the write callbacks
-        bus.set_write_callback(PPUCTRL,  [&](NES_Byte b) { ppu.control(b);                                             });
-        bus.set_write_callback(PPUMASK,  [&](NES_Byte b) { ppu.set_mask(b);                                            });
+        bus.set_write_callback(PPUCTRL,  [&](NES_Byte b) { ppu.control(b);  schedule_scanline();                       });
+        bus.set_write_callback(PPUMASK,  [&](NES_Byte b) { ppu.set_mask(b); schedule_scanline();                       });
         bus.set_write_callback(OAMADDR,  [&](NES_Byte b) { ppu.set_OAM_address(b);                                     });
         bus.set_write_callback(PPUADDR,  [&](NES_Byte b) { ppu.set_data_address(b);                                    });
         bus.set_write_callback(PPUSCROL, [&](NES_Byte b) { ppu.set_scroll(b);                                          });
@@ -98,11 +291,8 @@ class Emulator {
         bus.set_write_callback(DMC_LEN,     [&](NES_Byte b) { apu.write(DMC_LEN, b);     });
         bus.set_write_callback(SND_CHN,     [&](NES_Byte b) { apu.write(SND_CHN, b);     });
         bus.set_write_callback(JOY2,        [&](NES_Byte b) { apu.write(JOY2, b);        });
-        // set the interrupt callback for the PPU
-        ppu.set_interrupt_callback([&]() { cpu.interrupt(bus, CPU::NMI_INTERRUPT); });
-        // setup the DMC reader callback (for loading samples from RAM)
-        apu.set_dmc_reader([&](void*, cpu_addr_t addr) -> int { return bus.read(addr);  });
-        apu.set_irq_callback([&](void*) { cpu.interrupt(bus, CPU::IRQ_INTERRUPT); });
+        // setup the DMC reader (for loading samples from RAM)
+        apu.set_dmc_reader(&read_dmc, &bus);
     }
 
     // @brief Destroy this emulator.
@@ -129,6 +319,9 @@ class Emulator {
     /// @brief Load a new game into the emulator.
     ///
     /// @param path a path to the ROM to load into the emulator
+    /// @param is_battery_saved whether the RAM of a game with a battery is
+    /// kept in its save file (tools that replay states into many emulators
+    /// at once leave the save file alone)
     /// @returns true if the load succeeded, false otherwise
     /// @details
     /// When returning false, the emulator remains in its current state.
@@ -136,7 +329,7 @@ class Emulator {
     /// The boolean output answers the question: is the ASIC mapper
     /// implemented for the ROM at given path?
     ///
-    bool load_game(const std::string& path) {
+    bool load_game(const std::string& path, bool is_battery_saved = true) {
         // load the new game, but don't overwrite the cartridge yet
         auto game = Cartridge::create(path, [&](){
             picture_bus.update_mirroring();
@@ -147,19 +340,31 @@ class Emulator {
         if (cartridge != nullptr) delete cartridge;
         // assign the game pointer to the cartridge slot
         cartridge = game;
+        this->game = get_new_game();
         // setup the buses and reset the machine
+        bus.set_battery(nullptr);
         bus.set_mapper(cartridge->get_mapper());
         picture_bus.set_mapper(cartridge->get_mapper());
+        // keep the RAM of games with a battery in a save file by the ROM
+        battery.close();
+        if (is_battery_saved && cartridge->hasExtendedRAM() && battery.open(BatteryRAM::get_save_path(path)))
+            bus.set_battery(&battery);
         reset();
         // load succeeded, return true
         return true;
     }
 
+    /// @brief Return true if the RAM of the game is kept in its save file.
+    inline bool has_save_file() const { return battery.is_open(); }
+
     /// @brief Remove the inserted game from the emulator.
     inline void remove_game() {
         if (cartridge != nullptr) {
             delete cartridge;
             cartridge = nullptr;
+            game = get_new_game();
+            bus.set_battery(nullptr);
+            battery.close();
         }
     }
 
@@ -189,6 +394,11 @@ class Emulator {
         return "";
     }
 
+    /// @brief Return the checksum of the ROM of the game (0 for no game).
+    inline uint32_t get_rom_checksum() const {
+        return has_game() ? cartridge->get_checksum() : 0;
+    }
+
     /// @brief Return a 32-bit pointer to the screen buffer's first address.
     ///
     /// @returns a 32-bit pointer to the screen buffer's first address
@@ -201,6 +411,285 @@ class Emulator {
     ///
     inline NES_Byte* get_memory_buffer() { return bus.get_memory_buffer(); }
 
+    /// @brief Return the CPU of the emulator.
+    inline const CPU& get_cpu() const { return cpu; }
+
+    /// @brief Return the PPU of the emulator.
+    inline const PPU& get_ppu() const { return ppu; }
+
+    /// @brief Return the number of instructions the CPU has executed.
+    inline uint64_t get_instructions() const { return cpu.get_instructions(); }
+
+    /// @brief Return the timers for the stages of the emulator.
+    inline const Profiler& get_profiler() const { return profiler; }
+
+    /// @brief Set the timeline to record frames and NTSC blits to.
+    ///
+    /// @param tracer the tracer to record to, or nullptr to stop recording
+    ///
+    inline void set_tracer(Tracer* tracer) { this->tracer = tracer; }
+
+    /// @brief Return a snapshot of the profiling counters of the emulator.
+    ///
+    /// @returns the counters accumulated since the emulator was created
+    ///
+    Profile get_profile() const {
+        Profile profile;
+        profile.wall = profiler.get_wall_seconds();
+        profile.cycles = profiler.get_cycles();
+        profile.instructions = cpu.get_instructions();
+        profile.dots = ppu.get_dots();
+        for (int i = 0; i < Profiler::NUM_STAGES; i++)
+            profile.seconds[i] = profiler.get_seconds(static_cast<Profiler::Stage>(i));
+        for (std::size_t i = 0; i < NUM_IO_REGISTERS; i++) {
+            profile.io_reads[i] = bus.get_io_reads()[i];
+            profile.io_writes[i] = bus.get_io_writes()[i];
+        }
+        return profile;
+    }
+
+    /// @brief Return the number of cycles that have elapsed in the frame.
+    inline uint32_t get_frame_cycles() const { return cycles; }
+
+    /// @brief Save the state of the emulator to a snapshot.
+    ///
+    /// @param snapshot the snapshot to save the state to
+    ///
+    void save(Snapshot& snapshot) const {
+        if (!has_game()) {
+            snapshot.game = 0;
+            return;
+        }
+        // the mapper is cloned for the first save of a game and copied into
+        // after that
+        if (snapshot.game != game || !snapshot.mapper)
+            snapshot.mapper.reset(cartridge->get_mapper()->clone());
+        else
+            snapshot.mapper->copy_from(*cartridge->get_mapper());
+        snapshot.game = game;
+        snapshot.rom = get_rom_checksum();
+        snapshot.cycles = cycles;
+        snapshot.apu_cycles = apu_cycles;
+        snapshot.controllers[0] = controllers[0];
+        snapshot.controllers[1] = controllers[1];
+        snapshot.bus.copy_from(bus);
+        snapshot.picture_bus.copy_from(picture_bus);
+        snapshot.cpu.copy_from(cpu);
+        ppu.save(snapshot.ppu);
+        apu.save(snapshot.apu);
+    }
+
+    /// @brief Load the state of the emulator from a snapshot.
+    ///
+    /// @param snapshot the snapshot to load the state from
+    /// @returns true if the snapshot was loaded, false if it was saved from
+    /// a different game
+    ///
+    bool load(const Snapshot& snapshot) {
+        // a snapshot of the same game is of the same ROM
+        return snapshot.game == game && fork(snapshot);
+    }
+
+    /// @brief Load a snapshot of another emulator with the same ROM (i.e.,
+    /// fork the other emulator into this one).
+    ///
+    /// @param snapshot the snapshot of the other emulator
+    /// @returns true if the snapshot was loaded, false if it was saved from
+    /// a different ROM
+    /// @details
+    /// Unlike copy_from, the cartridge of this emulator is kept and the
+    /// mapper is copied into it, so a fork does not allocate. The battery
+    /// backed RAM of this emulator (if it has a battery) takes the RAM of
+    /// the snapshot, so forks are usually loaded without one.
+    ///
+    bool fork(const Snapshot& snapshot) {
+        if (!has_game() || snapshot.game == 0 || snapshot.rom != get_rom_checksum()) return false;
+        cartridge->get_mapper()->copy_from(*snapshot.mapper);
+        cycles = snapshot.cycles;
+        apu_cycles = snapshot.apu_cycles;
+        controllers[0] = snapshot.controllers[0];
+        controllers[1] = snapshot.controllers[1];
+        bus.copy_from(snapshot.bus);
+        picture_bus.copy_from(snapshot.picture_bus);
+        cpu.copy_from(snapshot.cpu);
+        ppu.load(snapshot.ppu);
+        apu.load(snapshot.apu);
+        schedule_scanline();
+        return true;
+    }
+
+    /// the first 4 bytes of a binary state ("NEST")
+    static constexpr uint32_t STATE_MAGIC = 0x5453454e;
+    /// the version of the binary state format
+    static constexpr uint32_t STATE_VERSION = 1;
+    /// the number of bytes in the header of a binary state
+    static constexpr std::size_t STATE_HEADER_SIZE = 20;
+
+    /// @brief Return the layout of the values that a binary state writes
+    /// as bytes, which must match for a state to be read.
+    static constexpr uint32_t get_state_layout() {
+        static_assert(sizeof(CPU) < 256 && sizeof(apu_snapshot_t) < 256, "the layout has a byte per size");
+        return sizeof(CPU) | sizeof(apu_snapshot_t) << 8 | sizeof(Controller) << 16 | sizeof(std::size_t) << 24;
+    }
+
+    /// @brief Return the FNV-1a hash of the body of a binary state.
+    static uint32_t get_state_hash(const NES_Byte* data, std::size_t size) {
+        uint32_t hash = 2166136261u;
+        for (std::size_t i = STATE_HEADER_SIZE; i < size; i++) hash = (hash ^ data[i]) * 16777619u;
+        return hash;
+    }
+
+    /// @brief Return true if data is a whole binary state of a game.
+    ///
+    /// @param data the binary state
+    /// @param size the number of bytes in the binary state
+    /// @param checksum the checksum of the ROM of the game (see
+    /// get_rom_checksum)
+    /// @details
+    /// This hashes the whole state, so states from disk are checked once
+    /// when they are read instead of every time they are loaded.
+    ///
+    static bool is_state(const NES_Byte* data, std::size_t size, uint32_t checksum) {
+        if (size < STATE_HEADER_SIZE) return false;
+        uint32_t magic = 0, version = 0, layout = 0, rom = 0, hash = 0;
+        StateReader reader(data, size);
+        reader.read(magic);
+        reader.read(version);
+        reader.read(layout);
+        reader.read(rom);
+        reader.read(hash);
+        return magic == STATE_MAGIC && version == STATE_VERSION && layout == get_state_layout() &&
+            rom == checksum && hash == get_state_hash(data, size);
+    }
+
+    /// @brief Write the state of the emulator in the binary state format.
+    ///
+    /// @param snapshot a snapshot to stage the state in
+    /// @param buffer the buffer to write the state to (it is cleared first)
+    /// @returns true if the state was written, false if there is no game
+    /// @details
+    /// The state is a header (the magic number, the version, the layout,
+    /// the checksum of the ROM, and the hash of the body) and a body with
+    /// the units of a snapshot. Nothing is allocated once the snapshot
+    /// belongs to the game and the buffer has the capacity for a state.
+    ///
+    bool save_state(Snapshot& snapshot, std::vector<NES_Byte>& buffer) const {
+        if (!has_game()) return false;
+        save(snapshot);
+        StateWriter writer(buffer);
+        // the constants are copied, as write takes a reference
+        writer.write(uint32_t(STATE_MAGIC));
+        writer.write(uint32_t(STATE_VERSION));
+        writer.write(get_state_layout());
+        writer.write(get_rom_checksum());
+        writer.write(uint32_t(0));
+        snapshot.mapper->save_state(writer);
+        writer.write(snapshot.cycles);
+        writer.write(snapshot.apu_cycles);
+        writer.write(snapshot.controllers);
+        snapshot.bus.save_state(writer);
+        snapshot.picture_bus.save_state(writer);
+        writer.write(snapshot.cpu);
+        snapshot.ppu.save_state(writer);
+        writer.write(snapshot.apu);
+        // fill in the hash of the body
+        const uint32_t hash = get_state_hash(buffer.data(), buffer.size());
+        std::memcpy(&buffer[STATE_HEADER_SIZE - sizeof hash], &hash, sizeof hash);
+        return true;
+    }
+
+    /// @brief Load the state of the emulator from the binary state format.
+    ///
+    /// @param snapshot a snapshot to stage the state in
+    /// @param data the binary state
+    /// @param size the number of bytes in the binary state
+    /// @returns true if the state was loaded, false if it is not a state of
+    /// the game (in which case the emulator is unchanged)
+    /// @details
+    /// The header is checked, but the hash of the body is not (see
+    /// is_state). The state is read into the snapshot, which is loaded only
+    /// if the whole state was read, so a load never leaves the emulator
+    /// half way between two states.
+    ///
+    bool load_state(Snapshot& snapshot, const NES_Byte* data, std::size_t size) {
+        if (!has_game()) return false;
+        StateReader reader(data, size);
+        uint32_t magic = 0, version = 0, layout = 0, rom = 0, hash = 0;
+        reader.read(magic);
+        reader.read(version);
+        reader.read(layout);
+        reader.read(rom);
+        reader.read(hash);
+        if (!reader.is_ok() || magic != STATE_MAGIC || version != STATE_VERSION ||
+            layout != get_state_layout() || rom != get_rom_checksum()) return false;
+        // stage the present state so the memory has the sizes of the game
+        save(snapshot);
+        snapshot.mapper->load_state(reader);
+        reader.read(snapshot.cycles);
+        reader.read(snapshot.apu_cycles);
+        reader.read(snapshot.controllers);
+        snapshot.bus.load_state(reader);
+        snapshot.picture_bus.load_state(reader);
+        reader.read(snapshot.cpu);
+        snapshot.ppu.load_state(reader);
+        reader.read(snapshot.apu);
+        if (!reader.is_done()) return false;
+        return load(snapshot);
+    }
+
+    /// @brief Run cycles without rendering frames or keeping audio.
+    ///
+    /// @param count the number of CPU cycles to run
+    /// @param callback a callback function for when a frame event occurs
+    /// @details
+    /// This is used to catch up to the present after loading a snapshot
+    /// from the past (i.e., for run-ahead). Finished frames are not passed
+    /// through the NTSC filter and the audio of the cycles is held back and
+    /// discarded, so the screen and the audio stream continue from where
+    /// they were.
+    ///
+    template<typename EndOfFrameCallback>
+    void fast_forward(uint64_t count, EndOfFrameCallback callback) {
+        if (!has_game()) return;
+        is_rendering = false;
+        apu.hold_audio();
+        for (uint64_t i = 0; i < count; i++) {
+            // drop the audio every frame so the buffer never fills up
+            cycle([&]() { apu.discard_samples(); callback(); });
+        }
+        is_rendering = true;
+        flush_apu();
+        apu.discard_samples();
+        apu.release_audio();
+    }
+
+    /// @brief Rewind to a snapshot from the past, write the controllers
+    /// there, and run back to the present (i.e., for run-ahead).
+    ///
+    /// @param snapshot the snapshot to rewind to
+    /// @param player1 the button bitmap of the player 1 controller
+    /// @param player2 the button bitmap of the player 2 controller
+    /// @param count the number of CPU cycles from the snapshot to the present
+    /// @param callback a callback function for when a frame event occurs
+    /// @returns true if the emulator rewound, false if the snapshot was
+    /// saved from a different game
+    /// @details
+    /// Unlike a load followed by fast_forward, the audio is held through the
+    /// load, so the buffers keep the samples and the amplitudes of the
+    /// present and the audio continues without a step.
+    ///
+    template<typename EndOfFrameCallback>
+    bool rewind(const Snapshot& snapshot, NES_Byte player1, NES_Byte player2, uint64_t count, EndOfFrameCallback callback) {
+        apu.hold_audio();
+        if (!load(snapshot)) {
+            apu.release_audio();
+            return false;
+        }
+        set_controllers(player1, player2);
+        fast_forward(count, callback);
+        return true;
+    }
+
     /// @brief Return a pointer to a controller port
     ///
     /// @param port the port of the controller to return the pointer to
@@ -235,6 +724,7 @@ class Emulator {
     ///
     inline int16_t get_audio_sample(std::size_t channel) {
         if (!has_game()) return 0;
+        flush_apu();
         return apu.get_sample(channel);
     }
 
@@ -251,9 +741,37 @@ class Emulator {
         static constexpr float Vpp = 10.f;
         // the amount of voltage per increment of 16-bit fidelity volume
         static constexpr float divisor = std::numeric_limits<int16_t>::max();
+        flush_apu();
         return Vpp * apu.get_sample(channel) / divisor;
     }
 
+    /// @brief Read a block of audio samples from the APU of the emulator.
+    ///
+    /// @param channel the channel to read samples from
+    /// @param output the buffer to read the samples into
+    /// @param count the most samples to read
+    /// @returns the number of samples that were read
+    /// @details
+    /// Unlike get_audio_sample, this reads every sample at the sample rate,
+    /// so it is for rendering the audio offline.
+    ///
+    inline std::size_t read_audio_samples(std::size_t channel, int16_t* output, std::size_t count) {
+        if (!has_game()) return 0;
+        flush_apu();
+        return apu.read_samples(channel, output, count);
+    }
+
+    /// @brief Return the number of audio samples that the emulator produces
+    /// over a number of cycles from when its audio was last cleared (i.e.,
+    /// by a load).
+    inline uint64_t get_audio_sample_count(uint64_t cycles) const {
+        return apu.get_sample_count(cycles);
+    }
+
+    /// @brief Set the position of the audio within a sample as if it was
+    /// cleared a number of cycles ago (see APU::set_phase).
+    inline void set_audio_phase(uint64_t cycles) { apu.set_phase(cycles); }
+
     /// @brief Emulate pressing the reset button on the NES.
     inline void reset() {
         // ignore the call if there is no game
@@ -262,6 +780,20 @@ class Emulator {
         cpu.reset(bus);
         ppu.reset();
         apu.reset();
+        apu_cycles = 0;
+        schedule_scanline();
+    }
+
+    /// @brief Reset the NES and start the CPU at a given address.
+    ///
+    /// @param start_address the address to start the program counter at
+    /// @details
+    /// Test ROMs like nestest run without a PPU from a fixed address.
+    ///
+    inline void reset(NES_Address start_address) {
+        if (!has_game()) return;
+        reset();
+        cpu.reset(start_address);
     }
 
     /// @brief Run a single CPU cycle on the emulator.
@@ -272,18 +804,58 @@ class Emulator {
     inline void cycle(EndOfFrameCallback callback) {
         // ignore the call if there is no game
         if (!has_game()) return;
+        profiler.begin();
         // 3 PPU steps per CPU step
         ppu.cycle(picture_bus);
         ppu.cycle(picture_bus);
         ppu.cycle(picture_bus);
+        cpu.set_nmi_line(ppu.get_nmi_line());
+        // count a scanline on the mapper if the PPU raised A12
+        if (scanline_countdown >= 0 && (scanline_countdown -= 3) < 0) {
+            cartridge->get_mapper()->clock_scanline();
+            schedule_scanline();
+        }
+        profiler.mark(Profiler::PPU_STAGE);
+        // filter the frame as soon as the PPU finishes it
+        if (ppu.has_frame() && !is_rendering) {
+            ppu.skip_render();
+        } else if (ppu.has_frame()) {
+            const uint64_t start = tracer != nullptr ? Tracer::now() : 0;
+            profiler.restart();
+            ppu.render();
+            profiler.lap(Profiler::NTSC_STAGE);
+            if (tracer != nullptr)
+                tracer->record("ntsc_blit", Tracer::EMULATOR_TRACK, start);
+        }
+        // wake the CPU from a polling loop once the polled value changes
+        if (cpu.is_polling()) cpu.poll(peek(cpu.get_poll_address()));
+        // the CPU may access the APU again once it wakes from an idle loop
+        if (!cpu.is_idle()) flush_apu();
         cpu.cycle(bus);
-        apu.cycle();
+        profiler.mark(Profiler::CPU_STAGE);
+        if (cpu.is_idle()) {
+            // defer the APU while the CPU is idle, but run it before it can
+            // raise an IRQ so the interrupt occurs on the same cycle
+            if (++apu_cycles >= apu.get_earliest_irq()) flush_apu();
+        } else {
+            apu.cycle();
+        }
+        cpu.set_irq_line(apu.is_irq_asserted() || cartridge->get_mapper()->is_irq_asserted());
+        profiler.mark(Profiler::APU_STAGE);
         // increment the cycles counter
         ++cycles;
         // check for the end of the frame
         if (cycles >= CYCLES_PER_FRAME) {
             cycles = 0;
+            flush_apu();
+            profiler.restart();
             callback();
+            profiler.lap(Profiler::SCREEN_STAGE);
+            if (tracer != nullptr) {
+                const uint64_t now = Tracer::now();
+                tracer->record("frame", Tracer::FRAME_TRACK, frame_start, now);
+                frame_start = now;
+            }
         }
     }
 
@@ -298,22 +870,31 @@ class Emulator {
             delete cartridge;
             cartridge = nullptr;
         }
+        game = get_new_game();
         cycles = other.cycles;
+        apu_cycles = other.apu_cycles;
         controllers[0] = other.controllers[0];
         controllers[1] = other.controllers[1];
+        // the copy keeps the battery backed RAM of the other in memory
+        bus.set_battery(nullptr);
+        battery.close();
         bus = other.bus;
+        bus.set_battery(nullptr);
         picture_bus = other.picture_bus;
         cpu = other.cpu;
         ppu = other.ppu;
         apu.copy_from(other.apu);
+        schedule_scanline();
     }
 
+#ifndef NES_NO_JSON
     /// @brief Convert the object's state to a JSON object.
     ///
     /// @returns a JSON object with the serialized contents of this object
     ///
     json_t* dataToJson() const {
         json_t* rootJ = json_object();
+        json_object_set_new(rootJ, "apu_cycles", json_integer(apu_cycles));
         if (cartridge != nullptr)
             json_object_set_new(rootJ, "cartridge", cartridge->dataToJson());
         json_object_set_new(rootJ, "controllers[0]", controllers[0].dataToJson());
@@ -343,12 +924,21 @@ class Emulator {
             // if the cartridge does not have a ROM, there is no emulator
             // state to load, return
             if (!rom_path_data) return true;
-            // make sure the ROM file still exists and is still valid
             auto rom_path_string = json_string_value(rom_path_data);
-            if (!ROM::is_valid_rom(rom_path_string)) return false;
-            // load the game into the machine before loading the cartridge
-            // data (because cartridge may be nullptr)
-            load_game(rom_path_string);
+            json_t* checksum_data = json_object_get(json_data, "checksum");
+            if (has_game() && get_rom_path() == rom_path_string && checksum_data &&
+                static_cast<uint32_t>(json_integer_value(checksum_data)) == get_rom_checksum()) {
+                // the game is already in the machine (i.e., a state of the
+                // game is loaded), so it is reset instead of being read from
+                // disk again along with its save file
+                reset();
+            } else {
+                // make sure the ROM file still exists and is still valid
+                if (!ROM::is_valid_rom(rom_path_string)) return false;
+                // load the game into the machine before loading the
+                // cartridge data (because cartridge may be nullptr)
+                load_game(rom_path_string);
+            }
             cartridge->dataFromJson(json_data);
         }
         // load controllers[0]
@@ -386,8 +976,15 @@ class Emulator {
             json_t* json_data = json_object_get(rootJ, "apu");
             if (json_data) apu.dataFromJson(json_data);
         }
+        // load apu_cycles
+        {
+            json_t* json_data = json_object_get(rootJ, "apu_cycles");
+            apu_cycles = json_data ? json_integer_value(json_data) : 0;
+        }
+        schedule_scanline();
         return true;
     }
+#endif  // NES_NO_JSON
 };
 
 }  // namespace NES
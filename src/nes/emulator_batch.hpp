@@ -0,0 +1,206 @@
+//  Program:      nes-py
+//  File:         emulator_batch.hpp
+//  Description:  This class steps a batch of emulators on a pool of threads
+//
+//  Copyright (c) 2020 Christian Kauten. All rights reserved.
+//
+
+#ifndef NES_EMULATOR_BATCH_HPP
+#define NES_EMULATOR_BATCH_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "emulator.hpp"
+
+namespace NES {
+
+/// A batch of emulators that step together (i.e., the environments of a
+/// reinforcement learning agent).
+///
+/// @details
+/// Every step runs each emulator for one frame with its controllers and
+/// writes its screen (the palette indexes of the PPU) and its work RAM
+/// straight into arrays of the caller, with the emulators of the batch
+/// spread across a pool of threads. The emulators skip the NTSC filter and
+/// drop their audio, which the agents do not use, so a step costs the CPU,
+/// PPU, and APU alone. The threads of the pool live as long as the batch and
+/// sleep between steps.
+///
+class EmulatorBatch {
+ public:
+    /// the number of bytes in the screen of an emulator
+    static constexpr std::size_t SCREEN_BYTES = SCANLINE_VISIBLE_DOTS * VISIBLE_SCANLINES;
+    /// the number of bytes in the work RAM of an emulator
+    static constexpr std::size_t RAM_BYTES = 0x800;
+
+ private:
+    /// the emulators of the batch
+    std::vector<std::unique_ptr<Emulator>> emulators;
+
+    /// the arguments of the step that the pool is running
+    const NES_Byte* step_controllers = nullptr;
+    NES_Byte* step_screens = nullptr;
+    NES_Byte* step_rams = nullptr;
+    /// the index of the next emulator to step
+    std::atomic<std::size_t> next{0};
+    /// the number of emulators that have not finished the step
+    std::atomic<std::size_t> remaining{0};
+
+    /// the threads of the pool
+    std::vector<std::thread> workers;
+    /// a lock for starting and finishing steps
+    std::mutex mutex;
+    /// a condition for waking the pool for a step
+    std::condition_variable start_condition;
+    /// a condition for waking the caller when a step is done
+    std::condition_variable done_condition;
+    /// the number of steps that have started
+    uint64_t generation = 0;
+    /// whether the pool should stop
+    bool is_stopping = false;
+
+    /// @brief Step one emulator of the batch.
+    ///
+    /// @param index the index of the emulator to step
+    ///
+    void step_one(std::size_t index) {
+        Emulator& emulator = *emulators[index];
+        if (step_controllers != nullptr)
+            emulator.set_controllers(step_controllers[2 * index], step_controllers[2 * index + 1]);
+        emulator.fast_forward(CYCLES_PER_FRAME, []() { });
+        if (step_screens != nullptr)
+            std::memcpy(step_screens + index * SCREEN_BYTES, emulator.get_ppu().get_pixels(), SCREEN_BYTES);
+        if (step_rams != nullptr)
+            std::memcpy(step_rams + index * RAM_BYTES, emulator.get_memory_buffer(), RAM_BYTES);
+    }
+
+    /// @brief Step emulators of the batch until none are left.
+    void work() {
+        std::size_t done = 0;
+        for (std::size_t index = next++; index < emulators.size(); index = next++) {
+            step_one(index);
+            ++done;
+        }
+        if (done == 0) return;
+        if (remaining.fetch_sub(done, std::memory_order_acq_rel) == done) {
+            std::lock_guard<std::mutex> lock(mutex);
+            done_condition.notify_all();
+        }
+    }
+
+    /// @brief Join the steps of the batch until the pool stops.
+    void run() {
+        uint64_t seen = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            start_condition.wait(lock, [&]() { return is_stopping || generation != seen; });
+            if (is_stopping) return;
+            seen = generation;
+            lock.unlock();
+            work();
+            lock.lock();
+        }
+    }
+
+ public:
+    /// @brief Initialize a new batch of emulators without games.
+    ///
+    /// @param size the number of emulators in the batch
+    /// @param threads the number of threads to step the batch on (including
+    /// the thread that calls step), 0 for one per core
+    ///
+    explicit EmulatorBatch(std::size_t size, unsigned threads = 0) {
+        for (std::size_t i = 0; i < size; i++)
+            emulators.emplace_back(std::unique_ptr<Emulator>(new Emulator()));
+        if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+        threads = std::min<std::size_t>(threads, std::max<std::size_t>(size, 1));
+        for (unsigned i = 1; i < threads; i++)
+            workers.emplace_back(&EmulatorBatch::run, this);
+    }
+
+    /// @brief Stop the pool.
+    ~EmulatorBatch() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            is_stopping = true;
+        }
+        start_condition.notify_all();
+        for (auto& worker : workers) worker.join();
+    }
+
+    EmulatorBatch(const EmulatorBatch&) = delete;
+    EmulatorBatch& operator=(const EmulatorBatch&) = delete;
+
+    /// @brief Return the number of emulators in the batch.
+    inline std::size_t size() const { return emulators.size(); }
+
+    /// @brief Return the number of threads that step the batch.
+    inline std::size_t get_num_threads() const { return workers.size() + 1; }
+
+    /// @brief Return an emulator of the batch.
+    ///
+    /// @param index the index of the emulator
+    ///
+    inline Emulator& operator[](std::size_t index) { return *emulators[index]; }
+
+    /// @brief Load a game into every emulator of the batch.
+    ///
+    /// @param path the path to the ROM
+    /// @returns true if the game loaded, false otherwise
+    /// @details
+    /// The emulators leave the save file of a game with a battery alone, so
+    /// their battery backed RAM starts empty and is not written to disk.
+    ///
+    bool load_game(const std::string& path) {
+        for (auto& emulator : emulators)
+            if (!emulator->load_game(path, false)) return false;
+        return true;
+    }
+
+    /// @brief Reset every emulator of the batch.
+    void reset() {
+        for (auto& emulator : emulators) emulator->reset();
+    }
+
+    /// @brief Run every emulator of the batch for one frame.
+    ///
+    /// @param controllers the bytes of the player 1 and player 2 controllers
+    /// of every emulator (size x 2), or nullptr to keep the controllers
+    /// @param screens the array to write the palette indexes of the screen of
+    /// every emulator to (size x 240 x 256), or nullptr for none
+    /// @param rams the array to write the work RAM of every emulator to
+    /// (size x 2048), or nullptr for none
+    ///
+    void step(const NES_Byte* controllers, NES_Byte* screens = nullptr, NES_Byte* rams = nullptr) {
+        if (emulators.empty()) return;
+        step_controllers = controllers;
+        step_screens = screens;
+        step_rams = rams;
+        // a thread that wakes late for the last step may take an emulator
+        // as soon as the index is reset, so the count is set first
+        remaining = emulators.size();
+        next = 0;
+        if (!workers.empty()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ++generation;
+            }
+            start_condition.notify_all();
+        }
+        // the caller steps emulators too instead of waiting idle
+        work();
+        std::unique_lock<std::mutex> lock(mutex);
+        done_condition.wait(lock, [&]() { return remaining.load(std::memory_order_acquire) == 0; });
+    }
+};
+
+}  // namespace NES
+
+#endif  // NES_EMULATOR_BATCH_HPP
@@ -0,0 +1,264 @@
+//  Program:      nes-py
+//  File:         fork_pool.hpp
+//  Description:  This class forks an emulator into a pool of emulators that
+//                explore branches of its future in parallel
+//
+//  Copyright (c) 2020 Christian Kauten. All rights reserved.
+//
+
+#ifndef NES_FORK_POOL_HPP
+#define NES_FORK_POOL_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "emulator.hpp"
+
+namespace NES {
+
+/// A pool of emulators that an emulator forks into to explore the futures
+/// that follow from different inputs (i.e., to pick the best of N futures).
+///
+/// @details
+/// A run saves the source emulator to a snapshot and forks it into every
+/// emulator of the pool (see Emulator::fork), and each fork runs a branch of
+/// frames with its own controllers. The forks are spread across a pool of
+/// threads that live as long as the pool and sleep between runs. Like the
+/// emulators of EmulatorBatch, the forks skip the NTSC filter and drop their
+/// audio.
+///
+/// The emulators, the snapshot, and the outcomes are allocated up front, so
+/// once the snapshot has been saved from a source emulator, runs from it do
+/// not allocate and a fork costs a copy of the state of the emulator.
+///
+class ForkPool {
+ public:
+    /// the number of bytes in the screen of an emulator
+    static constexpr std::size_t SCREEN_BYTES = SCANLINE_VISIBLE_DOTS * VISIBLE_SCANLINES;
+    /// the number of bytes in the work RAM of an emulator
+    static constexpr std::size_t RAM_BYTES = 0x800;
+
+    static_assert(SCREEN_BYTES % sizeof(uint64_t) == 0, "the screen is hashed in words");
+
+    /// A predicate on the work RAM of a fork at the end of a frame (i.e.,
+    /// whether the player lost a life). It is called from every thread of
+    /// the pool at once.
+    using Predicate = std::function<bool(const NES_Byte* ram)>;
+
+    /// The outcome of the branch of a fork.
+    struct Outcome {
+        /// the FNV-1a hash of the 64-bit words of the screen (the palette
+        /// indexes of the PPU) at the end of the branch
+        uint64_t screen_hash = 0;
+        /// the frame of the branch (from 0) that the predicate first held at
+        /// the end of, or -1 if it never held
+        int64_t predicate_frame = -1;
+        /// the work RAM at the end of the branch
+        std::array<NES_Byte, RAM_BYTES> ram{};
+    };
+
+ private:
+    /// the emulators that the source forks into
+    std::vector<std::unique_ptr<Emulator>> emulators;
+    /// the outcomes of the branches of the last run
+    std::vector<Outcome> outcomes;
+    /// the snapshot of the source emulator that the forks load
+    Emulator::Snapshot snapshot;
+    /// the predicate on the RAM of the forks
+    Predicate predicate;
+
+    /// the arguments of the run that the pool is running
+    std::size_t run_frames = 0;
+    const NES_Byte* run_controllers = nullptr;
+    /// the index of the next fork to run
+    std::atomic<std::size_t> next{0};
+    /// the number of forks that have not finished the run
+    std::atomic<std::size_t> remaining{0};
+
+    /// the threads of the pool
+    std::vector<std::thread> workers;
+    /// a lock for starting and finishing runs
+    std::mutex mutex;
+    /// a condition for waking the pool for a run
+    std::condition_variable start_condition;
+    /// a condition for waking the caller when a run is done
+    std::condition_variable done_condition;
+    /// the number of runs that have started
+    uint64_t generation = 0;
+    /// whether the pool should stop
+    bool is_stopping = false;
+
+    /// @brief Fork the snapshot into one emulator and run its branch.
+    ///
+    /// @param index the index of the emulator to fork into
+    ///
+    void run_one(std::size_t index) {
+        Emulator& emulator = *emulators[index];
+        Outcome& outcome = outcomes[index];
+        emulator.fork(snapshot);
+        outcome.predicate_frame = -1;
+        for (std::size_t frame = 0; frame < run_frames; frame++) {
+            if (run_controllers != nullptr) {
+                const NES_Byte* controllers = run_controllers + 2 * (index * run_frames + frame);
+                emulator.set_controllers(controllers[0], controllers[1]);
+            }
+            emulator.fast_forward(CYCLES_PER_FRAME, []() { });
+            if (predicate && outcome.predicate_frame < 0 && predicate(emulator.get_memory_buffer()))
+                outcome.predicate_frame = frame;
+        }
+        // the screen is hashed a word at a time, which is 8 times fewer
+        // multiplies than a byte at a time
+        const NES_Byte* pixels = emulator.get_ppu().get_pixels();
+        uint64_t hash = 14695981039346656037ull;
+        for (std::size_t i = 0; i < SCREEN_BYTES; i += sizeof(uint64_t)) {
+            uint64_t word;
+            std::memcpy(&word, pixels + i, sizeof word);
+            hash = (hash ^ word) * 1099511628211ull;
+        }
+        outcome.screen_hash = hash;
+        std::copy(emulator.get_memory_buffer(), emulator.get_memory_buffer() + RAM_BYTES, outcome.ram.begin());
+    }
+
+    /// @brief Run forks until none are left.
+    void work() {
+        std::size_t done = 0;
+        for (std::size_t index = next++; index < emulators.size(); index = next++) {
+            run_one(index);
+            ++done;
+        }
+        if (done == 0) return;
+        if (remaining.fetch_sub(done, std::memory_order_acq_rel) == done) {
+            std::lock_guard<std::mutex> lock(mutex);
+            done_condition.notify_all();
+        }
+    }
+
+    /// @brief Join the runs of the pool until it stops.
+    void serve() {
+        uint64_t seen = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            start_condition.wait(lock, [&]() { return is_stopping || generation != seen; });
+            if (is_stopping) return;
+            seen = generation;
+            lock.unlock();
+            work();
+            lock.lock();
+        }
+    }
+
+ public:
+    /// @brief Initialize a new pool of emulators without games.
+    ///
+    /// @param size the number of forks (branches) in the pool
+    /// @param threads the number of threads to run the forks on (including
+    /// the thread that calls run), 0 for one per core
+    ///
+    explicit ForkPool(std::size_t size, unsigned threads = 0) : outcomes(size) {
+        for (std::size_t i = 0; i < size; i++)
+            emulators.emplace_back(std::unique_ptr<Emulator>(new Emulator()));
+        if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+        threads = std::min<std::size_t>(threads, std::max<std::size_t>(size, 1));
+        for (unsigned i = 1; i < threads; i++)
+            workers.emplace_back(&ForkPool::serve, this);
+    }
+
+    /// @brief Stop the pool.
+    ~ForkPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            is_stopping = true;
+        }
+        start_condition.notify_all();
+        for (auto& worker : workers) worker.join();
+    }
+
+    ForkPool(const ForkPool&) = delete;
+    ForkPool& operator=(const ForkPool&) = delete;
+
+    /// @brief Return the number of forks in the pool.
+    inline std::size_t size() const { return emulators.size(); }
+
+    /// @brief Return the number of threads that run the forks.
+    inline std::size_t get_num_threads() const { return workers.size() + 1; }
+
+    /// @brief Return the emulator of a fork (i.e., to keep the best branch).
+    ///
+    /// @param index the index of the fork
+    ///
+    inline Emulator& operator[](std::size_t index) { return *emulators[index]; }
+
+    /// @brief Return the outcome of the branch of a fork in the last run.
+    ///
+    /// @param index the index of the fork
+    ///
+    inline const Outcome& get_outcome(std::size_t index) const { return outcomes[index]; }
+
+    /// @brief Load a game into every emulator of the pool.
+    ///
+    /// @param path the path to the ROM of the emulators that will fork
+    /// @returns true if the game loaded, false otherwise
+    /// @details
+    /// The forks leave the save file of a game with a battery alone.
+    ///
+    bool load_game(const std::string& path) {
+        for (auto& emulator : emulators)
+            if (!emulator->load_game(path, false)) return false;
+        return true;
+    }
+
+    /// @brief Set the predicate on the RAM of the forks.
+    ///
+    /// @param predicate_ the predicate to check at the end of every frame of
+    /// a branch, or an empty predicate for none
+    ///
+    inline void set_predicate(Predicate predicate_) { predicate = std::move(predicate_); }
+
+    /// @brief Fork an emulator into every emulator of the pool and run a
+    /// branch of frames on each.
+    ///
+    /// @param source the emulator to fork (with the game of the pool)
+    /// @param frames the number of frames to run each branch for (0 to fork
+    /// without running)
+    /// @param controllers the bytes of the player 1 and player 2 controllers
+    /// of every frame of every branch (size x frames x 2), or nullptr to
+    /// keep the controllers of the source
+    /// @returns true if the source was forked, false if it has a different
+    /// game than the pool
+    ///
+    bool run(const Emulator& source, std::size_t frames, const NES_Byte* controllers = nullptr) {
+        if (emulators.empty()) return true;
+        source.save(snapshot);
+        if (!source.has_game() || snapshot.rom != emulators.front()->get_rom_checksum()) return false;
+        run_frames = frames;
+        run_controllers = controllers;
+        // a thread that wakes late for the last run may take a fork as soon
+        // as the index is reset, so the count is set first
+        remaining = emulators.size();
+        next = 0;
+        if (!workers.empty()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ++generation;
+            }
+            start_condition.notify_all();
+        }
+        // the caller runs forks too instead of waiting idle
+        work();
+        std::unique_lock<std::mutex> lock(mutex);
+        done_condition.wait(lock, [&]() { return remaining.load(std::memory_order_acquire) == 0; });
+        return true;
+    }
+};
+
+}  // namespace NES
+
+#endif  // NES_FORK_POOL_HPP
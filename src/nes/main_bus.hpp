@@ -8,12 +8,16 @@
 #ifndef NES_MAIN_BUS_HPP
 #define NES_MAIN_BUS_HPP
 
+#include <algorithm>
 #include <functional>
 #include <string>
 #include <vector>
 #include <unordered_map>
+#ifndef NES_NO_JSON
 #include <jansson.h>
+#endif  // NES_NO_JSON
 #include "common.hpp"
+#include "battery.hpp"
 #include "cartridge.hpp"
 
 namespace NES {
@@ -55,6 +59,19 @@ enum IORegisters {
     // $4018-$401F -> APU and I/O functionality that is normally disabled
 };
 
+/// The number of I/O registers that accesses are counted for, i.e., the 8
+/// PPU registers followed by the 24 APU and I/O registers
+static constexpr std::size_t NUM_IO_REGISTERS = 8 + 0x18;
+
+/// @brief Return the address of an I/O register from its counter index.
+///
+/// @param index the index of the register in the access counters
+/// @returns the address of the register on the main bus
+///
+inline NES_Address io_register_address(std::size_t index) {
+    return index < 8 ? PPUCTRL + index : SQ1_VOL + (index - 8);
+}
+
 // TODO: test potential performance improvements from alternate map hash algos
 
 /// An enum functor object for calculating the hash of an enum class
@@ -80,12 +97,18 @@ class MainBus {
     std::vector<NES_Byte> ram = std::vector<NES_Byte>(0x800, 0);
     /// The extended RAM (if the mapper has extended RAM)
     std::vector<NES_Byte> extended_ram = std::vector<NES_Byte>(0);
+    /// the battery that holds the extended RAM instead (nullptr if none)
+    BatteryRAM* battery = nullptr;
     /// a pointer to the mapper on the cartridge
     ROM::Mapper* mapper = nullptr;
     /// a map of IO registers to callback methods for writes
     IORegisterToWriteCallbackMap write_callbacks;
     /// a map of IO registers to callback methods for reads
     IORegisterToReadCallbackMap read_callbacks;
+    /// the number of reads from each IO register
+    uint64_t io_reads[NUM_IO_REGISTERS] = {};
+    /// the number of writes to each IO register
+    uint64_t io_writes[NUM_IO_REGISTERS] = {};
 
  public:
     /// Set the mapper pointer to a new value.
@@ -97,6 +120,29 @@ class MainBus {
         if (mapper->hasExtendedRAM()) extended_ram.resize(0x2000);
     }
 
+    /// Set the battery that holds the extended RAM.
+    ///
+    /// @param battery_ the open battery to read and write the extended RAM
+    /// of, or nullptr to keep the extended RAM in the bus
+    /// @details
+    /// The contents of the battery are kept in the bus when it is detached.
+    ///
+    void set_battery(BatteryRAM* battery_) {
+        if (battery != nullptr)
+            std::copy(battery->data(), battery->data() + extended_ram.size(), extended_ram.begin());
+        battery = battery_;
+    }
+
+    /// Return a pointer to the extended RAM.
+    inline NES_Byte* get_extended_ram() {
+        return battery != nullptr ? battery->data() : extended_ram.data();
+    }
+
+    /// Return a pointer to the extended RAM.
+    inline const NES_Byte* get_extended_ram() const {
+        return battery != nullptr ? battery->data() : extended_ram.data();
+    }
+
     /// Set a callback for when writes occur.
     inline void set_write_callback(IORegisters reg, WriteCallback callback) {
         write_callbacks.insert({reg, callback});
@@ -117,17 +163,58 @@ class MainBus {
         } else if (address < 0x6000) {
             NES_DEBUG("Expansion ROM access attempted, which is unsupported");
         } else if (address < 0x8000 && mapper->hasExtendedRAM()) {
-            return &extended_ram[address - 0x6000];
+            return get_extended_ram() + (address - 0x6000);
         }
         return nullptr;
     }
 
+    /// Return the number of reads from each IO register.
+    inline const uint64_t* get_io_reads() const { return io_reads; }
+
+    /// Return the number of writes to each IO register.
+    inline const uint64_t* get_io_writes() const { return io_writes; }
+
     /// Return a 8-bit pointer to the RAM buffer's first address.
     ///
     /// @return a 8-bit pointer to the RAM buffer's first address
     ///
     inline NES_Byte* get_memory_buffer() { return &ram.front(); }
 
+    /// Copy the memory of another bus without the mapper, callbacks, or
+    /// counters. Does not allocate once the memory is the same size.
+    ///
+    /// @param other the bus to copy the memory of
+    ///
+    inline void copy_from(const MainBus& other) {
+        ram = other.ram;
+        extended_ram.resize(other.extended_ram.size());
+        const NES_Byte* source = other.get_extended_ram();
+        std::copy(source, source + extended_ram.size(), get_extended_ram());
+        if (battery != nullptr) battery->touch();
+    }
+
+    /// Write the memory of the bus in the binary state format.
+    ///
+    /// @param writer the writer to write the memory with
+    ///
+    void save_state(StateWriter& writer) const {
+        writer.write_block(ram);
+        writer.write_block(get_extended_ram(), extended_ram.size());
+    }
+
+    /// Read the memory of the bus from the binary state format.
+    ///
+    /// @param reader the reader to read the memory with
+    /// @details
+    /// The memory is read in place, so it has to be the size that it was
+    /// saved with (i.e., the bus has the mapper of the same game).
+    ///
+    void load_state(StateReader& reader) {
+        reader.read_block(ram.data(), ram.size());
+        reader.read_block(get_extended_ram(), extended_ram.size());
+        if (battery != nullptr) battery->touch();
+    }
+
     /// Read a byte from an address on the RAM.
     ///
     /// @param address the 16-bit address of the byte to read in the RAM
@@ -140,6 +227,7 @@ class MainBus {
         } else if (address < 0x4020) {
             if (address < 0x4000) {  // PPU registers, mirrored
                 auto reg = static_cast<IORegisters>(address & 0x2007);
+                ++io_reads[address & 0x7];
                 if (read_callbacks.count(reg)) {
                     return read_callbacks.at(reg)();
                 } else {
@@ -147,6 +235,7 @@ class MainBus {
                 }
             } else if (address < 0x4018 && address >= 0x4000) {  // only *some* IO registers (mostly APU)
                 auto reg = static_cast<IORegisters>(address);
+                ++io_reads[8 + (address - 0x4000)];
                 if (read_callbacks.count(reg)) {
                     return read_callbacks.at(reg)();
                 } else {
@@ -159,7 +248,7 @@ class MainBus {
         } else if (address < 0x6000) {
             NES_DEBUG("Expansion ROM read attempted. This is currently unsupported");
         } else if (address < 0x8000) {
-            if (mapper->hasExtendedRAM()) return extended_ram[address - 0x6000];
+            if (mapper->hasExtendedRAM()) return get_extended_ram()[address - 0x6000];
         } else {
             return mapper->readPRG(address);
         }
@@ -177,6 +266,7 @@ class MainBus {
         } else if (address < 0x4020) {
             if (address < 0x4000) {  // PPU registers, mirrored
                 auto reg = static_cast<IORegisters>(address & 0x2007);
+                ++io_writes[address & 0x7];
                 if (write_callbacks.count(reg)) {
                     return write_callbacks.at(reg)(value);
                 } else {
@@ -184,6 +274,7 @@ class MainBus {
                 }
             } else if (address < 0x4018 && address >= 0x4000) {  // only some registers (mostly APU)
                 auto reg = static_cast<IORegisters>(address);
+                ++io_writes[8 + (address - 0x4000)];
                 if (write_callbacks.count(reg)) {
                     return write_callbacks.at(reg)(value);
                 } else {
@@ -195,12 +286,16 @@ class MainBus {
         } else if (address < 0x6000) {
             NES_DEBUG("Expansion ROM write access attempted. This is currently unsupported");
         } else if (address < 0x8000) {
-            if (mapper->hasExtendedRAM()) extended_ram[address - 0x6000] = value;
+            if (mapper->hasExtendedRAM()) {
+                get_extended_ram()[address - 0x6000] = value;
+                if (battery != nullptr) battery->touch();
+            }
         } else {
             mapper->writePRG(address, value);
         }
     }
 
+#ifndef NES_NO_JSON
     /// Convert the object's state to a JSON object.
     json_t* dataToJson() const {
         json_t* rootJ = json_object();
@@ -211,7 +306,7 @@ class MainBus {
         }
         // encode extended_ram
         {
-            auto data_string = base64_encode(&extended_ram[0], extended_ram.size());
+            auto data_string = base64_encode(get_extended_ram(), extended_ram.size());
             json_object_set_new(rootJ, "extended_ram", json_string(data_string.c_str()));
         }
         return rootJ;
@@ -228,16 +323,22 @@ class MainBus {
                 ram = std::vector<NES_Byte>(data_string.begin(), data_string.end());
             }
         }
-        // load extended_ram
+        // load extended_ram (into the save file of a game with a battery)
         {
             json_t* json_data = json_object_get(rootJ, "extended_ram");
             if (json_data) {
                 std::string data_string = json_string_value(json_data);
                 data_string = base64_decode(data_string);
-                extended_ram = std::vector<NES_Byte>(data_string.begin(), data_string.end());
+                if (battery == nullptr) {
+                    extended_ram = std::vector<NES_Byte>(data_string.begin(), data_string.end());
+                } else if (data_string.size() == extended_ram.size()) {
+                    std::copy(data_string.begin(), data_string.end(), battery->data());
+                    battery->touch();
+                }
             }
         }
     }
+#endif  // NES_NO_JSON
 };
 
 }  // namespace NES
@@ -0,0 +1,290 @@
+//  Program:      nes-py
+//  File:         discrete.hpp
+//  Description:  An implementation of the discrete logic mappers
+//
+//  Copyright (c) 2020 Christian Kauten. All rights reserved.
+//
+
+#ifndef NES_MAPPERS_DISCRETE_HPP
+#define NES_MAPPERS_DISCRETE_HPP
+
+#include <string>
+#include <vector>
+#include "../rom.hpp"
+
+namespace NES {
+
+/// A mapper built from discrete logic chips (i.e., a single latch).
+///
+/// @tparam Traits the layout of the board with the constexpr members:
+/// -   PRG_BANK: the size of the switchable PRG bank at $8000 (0x8000, or
+///     0x4000 with the last 16KB fixed at $C000)
+/// -   PRG_SHIFT, PRG_MASK: the bits of the latch that select the PRG bank
+/// -   CHR_BANK: the size of the switchable CHR bank at the top of pattern
+///     memory (0x2000, or 0x1000 with the first 4KB fixed at $0000)
+/// -   CHR_SHIFT, CHR_MASK: the bits of the latch that select the CHR bank
+/// -   CHR_RAM: the size of the CHR RAM of boards without CHR ROM
+/// -   MIRRORING_MASK: the bit of the latch that selects the one-screen
+///     name table, or 0 for the mirroring of the header
+///
+/// @details
+/// Every write to $8000 to $FFFF stores the value in the latch and maps the
+/// banks that it selects. Bus conflicts are not emulated.
+///
+template<typename Traits>
+class MapperDiscrete : public ROM::Mapper {
+ private:
+    static_assert(Traits::PRG_BANK == 0x8000 || Traits::PRG_BANK == 0x4000, "PRG banks are 16KB or 32KB");
+    static_assert(Traits::CHR_BANK == 0x2000 || Traits::CHR_BANK == 0x1000, "CHR banks are 4KB or 8KB");
+
+    /// The mirroring callback on the PPU
+    Callback mirroring_callback;
+    /// whether the rom uses character RAM
+    bool has_character_ram;
+    /// the value of the latch
+    NES_Byte latch;
+    /// The character RAM on the mapper
+    std::vector<NES_Byte> character_ram;
+
+    /// Map the PRG and CHR banks from the latch.
+    inline void update_banks() {
+        const std::size_t prg = (latch >> Traits::PRG_SHIFT) & Traits::PRG_MASK;
+        if (Traits::PRG_BANK == 0x8000) {
+            map_prg(0, 4, 0x8000 * prg);
+        } else {
+            map_prg(0, 2, 0x4000 * prg);
+            map_prg(2, 2, rom.getROM().size() - 0x4000);
+        }
+        const std::size_t chr = (latch >> Traits::CHR_SHIFT) & Traits::CHR_MASK;
+        const auto& memory = has_character_ram ? character_ram : rom.getVROM();
+        if (Traits::CHR_BANK == 0x2000) {
+            map_chr(0, 8, memory, 0x2000 * chr);
+        } else {
+            map_chr(0, 4, memory, 0);
+            map_chr(4, 4, memory, 0x1000 * chr);
+        }
+    }
+
+ public:
+    /// Create a new mapper with a rom.
+    ///
+    /// @param cart a reference to a rom for the mapper to access
+    /// @param mirroring_cb the callback to change mirroring modes on the PPU
+    ///
+    MapperDiscrete(ROM& cart, Callback mirroring_cb) : Mapper(cart),
+        mirroring_callback(mirroring_cb),
+        has_character_ram(cart.getVROM().size() == 0),
+        latch(0) {
+        if (has_character_ram) {
+            character_ram.resize(Traits::CHR_RAM);
+            NES_DEBUG("Uses character RAM");
+        }
+        update_banks();
+    }
+
+    /// Create a mapper as a copy of another mapper.
+    MapperDiscrete(const MapperDiscrete& other) : ROM::Mapper(other),
+        mirroring_callback(other.mirroring_callback),
+        has_character_ram(other.has_character_ram),
+        latch(other.latch),
+        character_ram(other.character_ram) { update_banks(); }
+
+    /// Destroy this mapper.
+    ~MapperDiscrete() override { }
+
+    /// Clone the mapper, i.e., the virtual copy constructor
+    MapperDiscrete* clone() override { return new MapperDiscrete(*this); }
+
+    /// Copy the state of another mapper into this one.
+    void copy_from(const ROM::Mapper& other) override {
+        const auto& mapper = static_cast<const MapperDiscrete&>(other);
+        latch = mapper.latch;
+        character_ram = mapper.character_ram;
+        update_banks();
+    }
+
+    /// Return the name table mirroring mode of this mapper.
+    inline NameTableMirroring getNameTableMirroring() const override {
+        if (Traits::MIRRORING_MASK == 0) return rom.getNameTableMirroring();
+        return (latch & Traits::MIRRORING_MASK) ? ONE_SCREEN_HIGHER : ONE_SCREEN_LOWER;
+    }
+
+    /// Write a byte to an address in the PRG RAM.
+    ///
+    /// @param address the 16-bit address to write to
+    /// @param value the byte to write to the given address
+    ///
+    inline void writePRG(NES_Address, NES_Byte value) override {
+        const bool is_mirroring_changed = (latch ^ value) & Traits::MIRRORING_MASK;
+        latch = value;
+        update_banks();
+        if (is_mirroring_changed) mirroring_callback();
+    }
+
+    /// Write a byte to an address in the CHR RAM.
+    ///
+    /// @param address the 16-bit address to write to
+    /// @param value the byte to write to the given address
+    ///
+    inline void writeCHR(NES_Address address, NES_Byte value) override {
+        if (has_character_ram) {
+            // the banks point into the character RAM
+            const NES_Byte* bank = chr_banks[(address >> 10) & 0x7];
+            character_ram[bank - &character_ram[0] + (address & 0x3ff)] = value;
+        } else {
+            NES_DEBUG("Read-only CHR memory write attempt at " << std::hex << address);
+        }
+    }
+
+    /// Write the state of the mapper in the binary state format.
+    void save_state(StateWriter& writer) const override {
+        writer.write(latch);
+        writer.write_block(character_ram);
+    }
+
+    /// Read the state of the mapper from the binary state format.
+    void load_state(StateReader& reader) override {
+        reader.read(latch);
+        reader.read_block(character_ram.data(), character_ram.size());
+        update_banks();
+    }
+
+#ifndef NES_NO_JSON
+    /// Convert the object's state to a JSON object.
+    json_t* dataToJson() override {
+        json_t* rootJ = json_object();
+        json_object_set_new(rootJ, "latch", json_integer(latch));
+        if (has_character_ram) {
+            auto data_string = base64_encode(&character_ram[0], character_ram.size());
+            json_object_set_new(rootJ, "character_ram", json_string(data_string.c_str()));
+        }
+        return rootJ;
+    }
+
+    /// Load the object's state from a JSON object.
+    void dataFromJson(json_t* rootJ) override {
+        // load latch (the UNROM and CNROM mappers saved it by the bank)
+        for (const char* key : {"latch", "select_prg", "select_chr"}) {
+            json_t* json_data = json_object_get(rootJ, key);
+            if (!json_data) continue;
+            latch = json_integer_value(json_data);
+            break;
+        }
+        // load character_ram
+        {
+            json_t* json_data = json_object_get(rootJ, "character_ram");
+            if (json_data && has_character_ram) {
+                std::string data_string = json_string_value(json_data);
+                data_string = base64_decode(data_string);
+                if (data_string.size() == character_ram.size())
+                    character_ram.assign(data_string.begin(), data_string.end());
+            }
+        }
+        update_banks();
+        if (Traits::MIRRORING_MASK) mirroring_callback();
+    }
+#endif  // NES_NO_JSON
+};
+
+/// The layout of the UxROM boards (mapper #2).
+struct UNROMTraits {
+    static constexpr std::size_t PRG_BANK = 0x4000;
+    static constexpr int PRG_SHIFT = 0;
+    static constexpr NES_Byte PRG_MASK = 0xff;
+    static constexpr std::size_t CHR_BANK = 0x2000;
+    static constexpr int CHR_SHIFT = 0;
+    static constexpr NES_Byte CHR_MASK = 0;
+    static constexpr std::size_t CHR_RAM = 0x2000;
+    static constexpr NES_Byte MIRRORING_MASK = 0;
+};
+
+/// The layout of the CNROM boards (mapper #3).
+struct CNROMTraits {
+    static constexpr std::size_t PRG_BANK = 0x8000;
+    static constexpr int PRG_SHIFT = 0;
+    static constexpr NES_Byte PRG_MASK = 0;
+    static constexpr std::size_t CHR_BANK = 0x2000;
+    static constexpr int CHR_SHIFT = 0;
+    static constexpr NES_Byte CHR_MASK = 0x3;
+    static constexpr std::size_t CHR_RAM = 0x2000;
+    static constexpr NES_Byte MIRRORING_MASK = 0;
+};
+
+/// The layout of the AxROM boards (mapper #7).
+struct AxROMTraits {
+    static constexpr std::size_t PRG_BANK = 0x8000;
+    static constexpr int PRG_SHIFT = 0;
+    static constexpr NES_Byte PRG_MASK = 0x7;
+    static constexpr std::size_t CHR_BANK = 0x2000;
+    static constexpr int CHR_SHIFT = 0;
+    static constexpr NES_Byte CHR_MASK = 0;
+    static constexpr std::size_t CHR_RAM = 0x2000;
+    static constexpr NES_Byte MIRRORING_MASK = 0x10;
+};
+
+/// The layout of the Color Dreams boards (mapper #11).
+struct ColorDreamsTraits {
+    static constexpr std::size_t PRG_BANK = 0x8000;
+    static constexpr int PRG_SHIFT = 0;
+    static constexpr NES_Byte PRG_MASK = 0x3;
+    static constexpr std::size_t CHR_BANK = 0x2000;
+    static constexpr int CHR_SHIFT = 4;
+    static constexpr NES_Byte CHR_MASK = 0xf;
+    static constexpr std::size_t CHR_RAM = 0x2000;
+    static constexpr NES_Byte MIRRORING_MASK = 0;
+};
+
+/// The layout of the CPROM board (mapper #13).
+struct CPROMTraits {
+    static constexpr std::size_t PRG_BANK = 0x8000;
+    static constexpr int PRG_SHIFT = 0;
+    static constexpr NES_Byte PRG_MASK = 0;
+    static constexpr std::size_t CHR_BANK = 0x1000;
+    static constexpr int CHR_SHIFT = 0;
+    static constexpr NES_Byte CHR_MASK = 0x3;
+    static constexpr std::size_t CHR_RAM = 0x4000;
+    static constexpr NES_Byte MIRRORING_MASK = 0;
+};
+
+/// The layout of the BNROM boards (mapper #34).
+struct BNROMTraits {
+    static constexpr std::size_t PRG_BANK = 0x8000;
+    static constexpr int PRG_SHIFT = 0;
+    static constexpr NES_Byte PRG_MASK = 0xff;
+    static constexpr std::size_t CHR_BANK = 0x2000;
+    static constexpr int CHR_SHIFT = 0;
+    static constexpr NES_Byte CHR_MASK = 0;
+    static constexpr std::size_t CHR_RAM = 0x2000;
+    static constexpr NES_Byte MIRRORING_MASK = 0;
+};
+
+/// The layout of the GxROM boards (mapper #66).
+struct GxROMTraits {
+    static constexpr std::size_t PRG_BANK = 0x8000;
+    static constexpr int PRG_SHIFT = 4;
+    static constexpr NES_Byte PRG_MASK = 0x3;
+    static constexpr std::size_t CHR_BANK = 0x2000;
+    static constexpr int CHR_SHIFT = 0;
+    static constexpr NES_Byte CHR_MASK = 0x3;
+    static constexpr std::size_t CHR_RAM = 0x2000;
+    static constexpr NES_Byte MIRRORING_MASK = 0;
+};
+
+/// The UxROM mapper (mapper #2).
+typedef MapperDiscrete<UNROMTraits> MapperUNROM;
+/// The CNROM mapper (mapper #3).
+typedef MapperDiscrete<CNROMTraits> MapperCNROM;
+/// The AxROM mapper (mapper #7).
+typedef MapperDiscrete<AxROMTraits> MapperAxROM;
+/// The Color Dreams mapper (mapper #11).
+typedef MapperDiscrete<ColorDreamsTraits> MapperColorDreams;
+/// The CPROM mapper (mapper #13).
+typedef MapperDiscrete<CPROMTraits> MapperCPROM;
+/// The BNROM mapper (mapper #34).
+typedef MapperDiscrete<BNROMTraits> MapperBNROM;
+/// The GxROM mapper (mapper #66).
+typedef MapperDiscrete<GxROMTraits> MapperGxROM;
+
+}  // namespace NES
+
+#endif  // NES_MAPPERS_DISCRETE_HPP
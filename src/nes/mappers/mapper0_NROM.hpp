@@ -23,6 +23,12 @@ class MapperNROM : public ROM::Mapper {
     /// the character RAM on the mapper
     std::vector<NES_Byte> character_ram;
 
+    /// Map the PRG and CHR banks.
+    inline void update_banks() {
+        map_prg(0, 4, 0);
+        map_chr(0, 8, has_character_ram ? character_ram : rom.getVROM(), 0);
+    }
+
  public:
     /// Create a new mapper with a rom.
     ///
@@ -35,13 +41,14 @@ class MapperNROM : public ROM::Mapper {
             character_ram.resize(0x2000);
             NES_DEBUG("Uses character RAM");
         }
+        update_banks();
     }
 
     /// Create a mapper as a copy of another mapper.
-    MapperNROM(const MapperNROM& other) : ROM::Mapper(*this),
+    MapperNROM(const MapperNROM& other) : ROM::Mapper(other),
         is_one_bank(other.is_one_bank),
         has_character_ram(other.has_character_ram),
-        character_ram(other.character_ram) { }
+        character_ram(other.character_ram) { update_banks(); }
 
     /// Destroy this mapper.
     ~MapperNROM() override { }
@@ -49,16 +56,11 @@ class MapperNROM : public ROM::Mapper {
     /// Clone the mapper, i.e., the virtual copy constructor
     MapperNROM* clone() override { return new MapperNROM(*this); }
 
-    /// Read a byte from the PRG RAM.
-    ///
-    /// @param address the 16-bit address of the byte to read
-    /// @return the byte located at the given address in PRG RAM
-    ///
-    inline NES_Byte readPRG(NES_Address address) override {
-        if (!is_one_bank)
-            return rom.getROM()[address - 0x8000];
-        else  // mirrored
-            return rom.getROM()[(address - 0x8000) & 0x3fff];
+    /// Copy the state of another mapper into this one.
+    void copy_from(const ROM::Mapper& other) override {
+        const auto& mapper = static_cast<const MapperNROM&>(other);
+        character_ram = mapper.character_ram;
+        update_banks();
     }
 
     /// Write a byte to an address in the PRG RAM.
@@ -70,18 +72,6 @@ class MapperNROM : public ROM::Mapper {
         NES_DEBUG("ROM memory write attempt at " << +address << " to set " << +value);
     }
 
-    /// Read a byte from the CHR RAM.
-    ///
-    /// @param address the 16-bit address of the byte to read
-    /// @return the byte located at the given address in CHR RAM
-    ///
-    inline NES_Byte readCHR(NES_Address address) override {
-        if (has_character_ram)
-            return character_ram[address];
-        else
-            return rom.getVROM()[address];
-    }
-
     /// Write a byte to an address in the CHR RAM.
     ///
     /// @param address the 16-bit address to write to
@@ -95,6 +85,18 @@ class MapperNROM : public ROM::Mapper {
         }
     }
 
+    /// Write the state of the mapper in the binary state format.
+    void save_state(StateWriter& writer) const override {
+        writer.write_block(character_ram);
+    }
+
+    /// Read the state of the mapper from the binary state format.
+    void load_state(StateReader& reader) override {
+        reader.read_block(character_ram.data(), character_ram.size());
+        update_banks();
+    }
+
+#ifndef NES_NO_JSON
     /// Convert the object's state to a JSON object.
     json_t* dataToJson() override {
         json_t* rootJ = json_object();
@@ -131,7 +133,9 @@ class MapperNROM : public ROM::Mapper {
                 character_ram = std::vector<NES_Byte>(data_string.begin(), data_string.end());
             }
         }
+        update_banks();
     }
+#endif  // NES_NO_JSON
 };
 
 }  // namespace NES
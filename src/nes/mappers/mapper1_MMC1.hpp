@@ -49,6 +49,18 @@ class MapperMMC1 : public ROM::Mapper {
     /// The character RAM on the rom
     std::vector<NES_Byte> character_ram;
 
+    /// Map the PRG and CHR banks from the bank offsets.
+    inline void update_banks() {
+        map_prg(0, 2, first_bank_prg);
+        map_prg(2, 2, second_bank_prg);
+        if (has_character_ram) {
+            map_chr(0, 8, character_ram, 0);
+        } else {
+            map_chr(0, 4, rom.getVROM(), first_bank_chr);
+            map_chr(4, 4, rom.getVROM(), second_bank_chr);
+        }
+    }
+
     /// TODO: what does this do
     void calculatePRGPointers() {
         if (mode_prg <= 1) {  // 32KB changeable
@@ -95,10 +107,11 @@ class MapperMMC1 : public ROM::Mapper {
             first_bank_chr = 0;
             second_bank_chr = 0x1000 * register_chr1;
         }
+        update_banks();
     }
 
     /// Create a mapper as a copy of another mapper.
-    MapperMMC1(const MapperMMC1& other) : ROM::Mapper(*this),
+    MapperMMC1(const MapperMMC1& other) : ROM::Mapper(other),
         mirroring_callback(other.mirroring_callback),
         mirroring(other.mirroring),
         has_character_ram(other.has_character_ram),
@@ -113,7 +126,7 @@ class MapperMMC1 : public ROM::Mapper {
         second_bank_prg(other.second_bank_prg),
         first_bank_chr(other.first_bank_chr),
         second_bank_chr(other.second_bank_chr),
-        character_ram(other.character_ram) { }
+        character_ram(other.character_ram) { update_banks(); }
 
     /// Destroy this mapper.
     ~MapperMMC1() override { }
@@ -121,23 +134,30 @@ class MapperMMC1 : public ROM::Mapper {
     /// Clone the mapper, i.e., the virtual copy constructor
     MapperMMC1* clone() override { return new MapperMMC1(*this); }
 
+    /// Copy the state of another mapper into this one.
+    void copy_from(const ROM::Mapper& other) override {
+        const auto& mapper = static_cast<const MapperMMC1&>(other);
+        mirroring = mapper.mirroring;
+        mode_chr = mapper.mode_chr;
+        mode_prg = mapper.mode_prg;
+        temp_register = mapper.temp_register;
+        write_counter = mapper.write_counter;
+        register_prg = mapper.register_prg;
+        register_chr0 = mapper.register_chr0;
+        register_chr1 = mapper.register_chr1;
+        first_bank_prg = mapper.first_bank_prg;
+        second_bank_prg = mapper.second_bank_prg;
+        first_bank_chr = mapper.first_bank_chr;
+        second_bank_chr = mapper.second_bank_chr;
+        character_ram = mapper.character_ram;
+        update_banks();
+    }
+
     /// Return the name table mirroring mode of this mapper.
     inline NameTableMirroring getNameTableMirroring() const override {
         return mirroring;
     }
 
-    /// Read a byte from the PRG RAM.
-    ///
-    /// @param address the 16-bit address of the byte to read
-    /// @return the byte located at the given address in PRG RAM
-    ///
-    inline NES_Byte readPRG(NES_Address address) override {
-        if (address < 0xc000)
-            return rom.getROM()[first_bank_prg + (address & 0x3fff)];
-        else
-            return rom.getROM()[second_bank_prg + (address & 0x3fff)];
-    }
-
     /// Write a byte to an address in the PRG RAM.
     ///
     /// @param address the 16-bit address to write to
@@ -193,29 +213,17 @@ class MapperMMC1 : public ROM::Mapper {
 
                 temp_register = 0;
                 write_counter = 0;
+                update_banks();
             }
         } else {  // reset
             temp_register = 0;
             write_counter = 0;
             mode_prg = 3;
             calculatePRGPointers();
+            update_banks();
         }
     }
 
-    /// Read a byte from the CHR RAM.
-    ///
-    /// @param address the 16-bit address of the byte to read
-    /// @return the byte located at the given address in CHR RAM
-    ///
-    inline NES_Byte readCHR(NES_Address address) override {
-        if (has_character_ram)
-            return character_ram[address];
-        else if (address < 0x1000)
-            return rom.getVROM()[first_bank_chr + address];
-        else
-            return rom.getVROM()[second_bank_chr + (address & 0xfff)];
-    }
-
     /// Write a byte to an address in the CHR RAM.
     ///
     /// @param address the 16-bit address to write to
@@ -229,6 +237,42 @@ class MapperMMC1 : public ROM::Mapper {
         }
     }
 
+    /// Write the state of the mapper in the binary state format.
+    void save_state(StateWriter& writer) const override {
+        writer.write(mirroring);
+        writer.write(mode_chr);
+        writer.write(mode_prg);
+        writer.write(temp_register);
+        writer.write(write_counter);
+        writer.write(register_prg);
+        writer.write(register_chr0);
+        writer.write(register_chr1);
+        writer.write(first_bank_prg);
+        writer.write(second_bank_prg);
+        writer.write(first_bank_chr);
+        writer.write(second_bank_chr);
+        writer.write_block(character_ram);
+    }
+
+    /// Read the state of the mapper from the binary state format.
+    void load_state(StateReader& reader) override {
+        reader.read(mirroring);
+        reader.read(mode_chr);
+        reader.read(mode_prg);
+        reader.read(temp_register);
+        reader.read(write_counter);
+        reader.read(register_prg);
+        reader.read(register_chr0);
+        reader.read(register_chr1);
+        reader.read(first_bank_prg);
+        reader.read(second_bank_prg);
+        reader.read(first_bank_chr);
+        reader.read(second_bank_chr);
+        reader.read_block(character_ram.data(), character_ram.size());
+        update_banks();
+    }
+
+#ifndef NES_NO_JSON
     /// Convert the object's state to a JSON object.
     json_t* dataToJson() override {
         json_t* rootJ = json_object();
@@ -328,7 +372,9 @@ class MapperMMC1 : public ROM::Mapper {
                 character_ram = std::vector<NES_Byte>(data_string.begin(), data_string.end());
             }
         }
+        update_banks();
     }
+#endif  // NES_NO_JSON
 };
 
 }  // namespace NES
@@ -0,0 +1,339 @@
+//  Program:      nes-py
+//  File:         mapper_MMC3.hpp
+//  Description:  An implementation of the MMC3 mapper
+//
+//  Copyright (c) 2020 Christian Kauten. All rights reserved.
+//
+
+#ifndef NES_MAPPERS_MAPPER_MMC3_HPP
+#define NES_MAPPERS_MAPPER_MMC3_HPP
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "../rom.hpp"
+
+namespace NES {
+
+/// The MMC3 mapper (mapper #4).
+///
+/// @details
+/// The scanline counter is clocked by the emulator at the rising edges of A12
+/// that the PPU predicts (see PPU::get_dots_to_a12_edge). The PRG RAM
+/// protect register is kept, but the RAM is always readable and writable.
+///
+class MapperMMC3 : public ROM::Mapper {
+ private:
+    /// The mirroring callback on the PPU
+    Callback mirroring_callback;
+    /// the mirroring mode on the device
+    NameTableMirroring mirroring;
+    /// whether the rom uses character RAM
+    bool has_character_ram;
+    /// the bank select register (the target bank and the PRG / CHR modes)
+    NES_Byte bank_select;
+    /// the 8 bank registers (R0 to R7)
+    NES_Byte registers[8];
+    /// the PRG RAM protect register
+    NES_Byte prg_ram_protect;
+    /// the value the IRQ counter reloads with
+    NES_Byte irq_latch;
+    /// the IRQ counter
+    NES_Byte irq_counter;
+    /// whether the IRQ counter reloads on the next scanline
+    bool is_irq_reload;
+    /// whether the IRQ is enabled
+    bool is_irq_enabled;
+    /// The character RAM on the rom
+    std::vector<NES_Byte> character_ram;
+
+    /// Map the PRG and CHR banks from the bank registers.
+    inline void update_banks() {
+        // the second to last 8KB bank is at $8000 or $C000 and the last is
+        // always at $E000
+        const std::size_t second_last = rom.getROM().size() - 0x4000;
+        if (bank_select & 0x40) {
+            map_prg(0, 1, second_last);
+            map_prg(2, 1, 0x2000 * registers[6]);
+        } else {
+            map_prg(0, 1, 0x2000 * registers[6]);
+            map_prg(2, 1, second_last);
+        }
+        map_prg(1, 1, 0x2000 * registers[7]);
+        map_prg(3, 1, second_last + 0x2000);
+        // two 2KB banks and four 1KB banks with the halves swapped in CHR
+        // mode 1
+        const auto& memory = has_character_ram ? character_ram : rom.getVROM();
+        const int high = (bank_select & 0x80) ? 0 : 4;
+        const int low = 4 - high;
+        map_chr(low + 0, 2, memory, 0x400 * (registers[0] & 0xfe));
+        map_chr(low + 2, 2, memory, 0x400 * (registers[1] & 0xfe));
+        for (int i = 0; i < 4; i++)
+            map_chr(high + i, 1, memory, 0x400 * registers[2 + i]);
+    }
+
+ public:
+    /// Create a new mapper with a rom.
+    ///
+    /// @param cart a reference to a rom for the mapper to access
+    /// @param mirroring_cb the callback to change mirroring modes on the PPU
+    ///
+    MapperMMC3(ROM& cart, Callback mirroring_cb) : Mapper(cart),
+        mirroring_callback(mirroring_cb),
+        mirroring(cart.getNameTableMirroring()),
+        has_character_ram(cart.getVROM().size() == 0),
+        bank_select(0),
+        registers{0, 2, 4, 5, 6, 7, 0, 1},
+        prg_ram_protect(0),
+        irq_latch(0),
+        irq_counter(0),
+        is_irq_reload(false),
+        is_irq_enabled(false) {
+        if (has_character_ram) {
+            character_ram.resize(0x2000);
+            NES_DEBUG("Uses character RAM");
+        }
+        update_banks();
+    }
+
+    /// Create a mapper as a copy of another mapper.
+    MapperMMC3(const MapperMMC3& other) : ROM::Mapper(other),
+        mirroring_callback(other.mirroring_callback),
+        mirroring(other.mirroring),
+        has_character_ram(other.has_character_ram),
+        bank_select(other.bank_select),
+        prg_ram_protect(other.prg_ram_protect),
+        irq_latch(other.irq_latch),
+        irq_counter(other.irq_counter),
+        is_irq_reload(other.is_irq_reload),
+        is_irq_enabled(other.is_irq_enabled),
+        character_ram(other.character_ram) {
+        std::copy(std::begin(other.registers), std::end(other.registers), registers);
+        update_banks();
+    }
+
+    /// Destroy this mapper.
+    ~MapperMMC3() override { }
+
+    /// Clone the mapper, i.e., the virtual copy constructor
+    MapperMMC3* clone() override { return new MapperMMC3(*this); }
+
+    /// Copy the state of another mapper into this one.
+    void copy_from(const ROM::Mapper& other) override {
+        const auto& mapper = static_cast<const MapperMMC3&>(other);
+        is_irq = mapper.is_irq;
+        mirroring = mapper.mirroring;
+        bank_select = mapper.bank_select;
+        std::copy(std::begin(mapper.registers), std::end(mapper.registers), registers);
+        prg_ram_protect = mapper.prg_ram_protect;
+        irq_latch = mapper.irq_latch;
+        irq_counter = mapper.irq_counter;
+        is_irq_reload = mapper.is_irq_reload;
+        is_irq_enabled = mapper.is_irq_enabled;
+        character_ram = mapper.character_ram;
+        update_banks();
+    }
+
+    /// Return true because MMC3 boards have PRG RAM at $6000 to $7FFF.
+    inline bool hasExtendedRAM() const override { return true; }
+
+    /// Return the name table mirroring mode of this mapper.
+    inline NameTableMirroring getNameTableMirroring() const override {
+        return mirroring;
+    }
+
+    /// Return true because the mapper counts scanlines.
+    inline bool has_scanline_counter() const override { return true; }
+
+    /// Count a scanline and raise an IRQ when the counter reaches 0.
+    void clock_scanline() override {
+        if (irq_counter == 0 || is_irq_reload) {
+            irq_counter = irq_latch;
+            is_irq_reload = false;
+        } else {
+            --irq_counter;
+        }
+        if (irq_counter == 0 && is_irq_enabled) is_irq = true;
+    }
+
+    /// Write a byte to an address in the PRG RAM.
+    ///
+    /// @param address the 16-bit address to write to
+    /// @param value the byte to write to the given address
+    ///
+    void writePRG(NES_Address address, NES_Byte value) override {
+        // the registers are selected by the top 3 bits and the lowest bit
+        const bool is_odd = address & 0x1;
+        switch (address & 0xe000) {
+            case 0x8000: {
+                if (is_odd)
+                    registers[bank_select & 0x7] = value;
+                else
+                    bank_select = value;
+                update_banks();
+                break;
+            }
+            case 0xa000: {
+                if (is_odd) {
+                    prg_ram_protect = value;
+                } else {
+                    mirroring = (value & 0x1) ? HORIZONTAL : VERTICAL;
+                    mirroring_callback();
+                }
+                break;
+            }
+            case 0xc000: {
+                if (is_odd) {
+                    irq_counter = 0;
+                    is_irq_reload = true;
+                } else {
+                    irq_latch = value;
+                }
+                break;
+            }
+            case 0xe000: {
+                // disabling the IRQ also acknowledges the pending one
+                is_irq_enabled = is_odd;
+                if (!is_odd) is_irq = false;
+                break;
+            }
+        }
+    }
+
+    /// Write a byte to an address in the CHR RAM.
+    ///
+    /// @param address the 16-bit address to write to
+    /// @param value the byte to write to the given address
+    ///
+    inline void writeCHR(NES_Address address, NES_Byte value) override {
+        if (has_character_ram) {
+            // the banks point into the character RAM
+            const NES_Byte* bank = chr_banks[(address >> 10) & 0x7];
+            character_ram[bank - &character_ram[0] + (address & 0x3ff)] = value;
+        } else {
+            NES_DEBUG("Read-only CHR memory write attempt at " << std::hex << address);
+        }
+    }
+
+    /// Write the state of the mapper in the binary state format.
+    void save_state(StateWriter& writer) const override {
+        writer.write(is_irq);
+        writer.write(mirroring);
+        writer.write(bank_select);
+        writer.write(registers);
+        writer.write(prg_ram_protect);
+        writer.write(irq_latch);
+        writer.write(irq_counter);
+        writer.write(is_irq_reload);
+        writer.write(is_irq_enabled);
+        writer.write_block(character_ram);
+    }
+
+    /// Read the state of the mapper from the binary state format.
+    void load_state(StateReader& reader) override {
+        reader.read(is_irq);
+        reader.read(mirroring);
+        reader.read(bank_select);
+        reader.read(registers);
+        reader.read(prg_ram_protect);
+        reader.read(irq_latch);
+        reader.read(irq_counter);
+        reader.read(is_irq_reload);
+        reader.read(is_irq_enabled);
+        reader.read_block(character_ram.data(), character_ram.size());
+        update_banks();
+    }
+
+#ifndef NES_NO_JSON
+    /// Convert the object's state to a JSON object.
+    json_t* dataToJson() override {
+        json_t* rootJ = json_object();
+        json_object_set_new(rootJ, "mirroring", json_integer(mirroring));
+        json_object_set_new(rootJ, "bank_select", json_integer(bank_select));
+        {
+            auto data_string = base64_encode(registers, sizeof registers);
+            json_object_set_new(rootJ, "registers", json_string(data_string.c_str()));
+        }
+        json_object_set_new(rootJ, "prg_ram_protect", json_integer(prg_ram_protect));
+        json_object_set_new(rootJ, "irq_latch", json_integer(irq_latch));
+        json_object_set_new(rootJ, "irq_counter", json_integer(irq_counter));
+        json_object_set_new(rootJ, "is_irq_reload", json_boolean(is_irq_reload));
+        json_object_set_new(rootJ, "is_irq_enabled", json_boolean(is_irq_enabled));
+        json_object_set_new(rootJ, "is_irq", json_boolean(is_irq));
+        if (has_character_ram) {
+            auto data_string = base64_encode(&character_ram[0], character_ram.size());
+            json_object_set_new(rootJ, "character_ram", json_string(data_string.c_str()));
+        }
+        return rootJ;
+    }
+
+    /// Load the object's state from a JSON object.
+    void dataFromJson(json_t* rootJ) override {
+        // load mirroring
+        {
+            json_t* json_data = json_object_get(rootJ, "mirroring");
+            if (json_data) mirroring = static_cast<NameTableMirroring>(json_integer_value(json_data));
+        }
+        // load bank_select
+        {
+            json_t* json_data = json_object_get(rootJ, "bank_select");
+            if (json_data) bank_select = json_integer_value(json_data);
+        }
+        // load registers
+        {
+            json_t* json_data = json_object_get(rootJ, "registers");
+            if (json_data) {
+                std::string data_string = json_string_value(json_data);
+                data_string = base64_decode(data_string);
+                if (data_string.size() == sizeof registers)
+                    std::copy(data_string.begin(), data_string.end(), registers);
+            }
+        }
+        // load prg_ram_protect
+        {
+            json_t* json_data = json_object_get(rootJ, "prg_ram_protect");
+            if (json_data) prg_ram_protect = json_integer_value(json_data);
+        }
+        // load irq_latch
+        {
+            json_t* json_data = json_object_get(rootJ, "irq_latch");
+            if (json_data) irq_latch = json_integer_value(json_data);
+        }
+        // load irq_counter
+        {
+            json_t* json_data = json_object_get(rootJ, "irq_counter");
+            if (json_data) irq_counter = json_integer_value(json_data);
+        }
+        // load is_irq_reload
+        {
+            json_t* json_data = json_object_get(rootJ, "is_irq_reload");
+            if (json_data) is_irq_reload = json_boolean_value(json_data);
+        }
+        // load is_irq_enabled
+        {
+            json_t* json_data = json_object_get(rootJ, "is_irq_enabled");
+            if (json_data) is_irq_enabled = json_boolean_value(json_data);
+        }
+        // load is_irq
+        {
+            json_t* json_data = json_object_get(rootJ, "is_irq");
+            if (json_data) is_irq = json_boolean_value(json_data);
+        }
+        // load character_ram
+        {
+            json_t* json_data = json_object_get(rootJ, "character_ram");
+            if (json_data && has_character_ram) {
+                std::string data_string = json_string_value(json_data);
+                data_string = base64_decode(data_string);
+                if (data_string.size() == character_ram.size())
+                    std::copy(data_string.begin(), data_string.end(), character_ram.begin());
+            }
+        }
+        update_banks();
+    }
+#endif  // NES_NO_JSON
+};
+
+}  // namespace NES
+
+#endif  // NES_MAPPERS_MAPPER_MMC3_HPP
@@ -0,0 +1,692 @@
+//  Program:      nes-py
+//  File:         movie.hpp
+//  Description:  Classes for recording and playing back input movies
+//
+//  Copyright (c) 2020 Christian Kauten. All rights reserved.
+//
+
+#ifndef NES_MOVIE_HPP
+#define NES_MOVIE_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "emulator.hpp"
+
+namespace NES {
+
+/// A recording of the inputs to an emulator that plays back exactly.
+///
+/// @details
+/// A movie is a header and an append-only stream of events. Every event is
+/// the CPU cycles since the last event as a LEB128 number, the kind of the
+/// event, and its payload, so a recording is a few bytes per press or
+/// release of a button no matter how long it runs. The stream starts with a
+/// keyframe (a binary state, see Emulator::save_state) and has another one
+/// every KEYFRAME_INTERVAL frames, so seeking loads the nearest keyframe and
+/// fast-forwards less than the interval. States that are saved during the
+/// recording are in the stream too, so the loads of the recording play back
+/// without the states on disk. A stream that was cut off (i.e., by a crash
+/// while recording) reads up to the last whole event.
+///
+/// The header is the magic number, the version, the layout of the binary
+/// states, and the checksum of the ROM of the game.
+///
+class Movie {
+ public:
+    /// the first 4 bytes of a movie ("NESM")
+    static constexpr uint32_t MAGIC = 0x4d53454e;
+    /// the version of the movie format
+    static constexpr uint32_t VERSION = 1;
+    /// the number of bytes in the header of a movie
+    static constexpr std::size_t HEADER_SIZE = 16;
+    /// the number of slots that the events save states to and load them from
+    static constexpr int NUM_SLOTS = 256;
+    /// the default number of frames between keyframes
+    static constexpr uint64_t KEYFRAME_INTERVAL = 600;
+    /// the number of keyframes that a new stream reserves memory for (an
+    /// hour of keyframes at the default interval)
+    static constexpr std::size_t RESERVED_KEYFRAMES = 360;
+    /// the number of bytes that a new stream reserves for its other events
+    static constexpr std::size_t RESERVED_EVENT_BYTES = 1 << 20;
+
+    /// The kinds of events in the stream.
+    enum Event : NES_Byte {
+        /// the buttons of player 1 changed (payload: the buttons)
+        PLAYER1 = 0,
+        /// the buttons of player 2 changed (payload: the buttons)
+        PLAYER2,
+        /// the reset button was pressed
+        RESET,
+        /// a state was saved to a slot (payload: the slot and the state)
+        SAVE,
+        /// the state of a slot was loaded (payload: the slot)
+        LOAD,
+        /// a state from outside of the movie was loaded (payload: the state)
+        LOAD_STATE,
+        /// a keyframe to seek to (payload: the state)
+        KEYFRAME,
+        /// the end of the recording
+        END,
+        /// the number of kinds of events
+        NUM_EVENTS
+    };
+
+    /// An event that was read from the stream.
+    struct Record {
+        /// the cycle of the movie that the event occurs before
+        uint64_t time = 0;
+        /// the kind of the event
+        Event event = END;
+        /// the buttons of a PLAYER event or the slot of a SAVE or LOAD event
+        NES_Byte value = 0;
+        /// the offset of the state of the event (0 for none)
+        std::size_t state = 0;
+        /// the offset of the next event
+        std::size_t next = 0;
+    };
+
+    /// The offsets of the last states that were saved to each slot.
+    typedef std::array<uint32_t, NUM_SLOTS> SlotTable;
+
+    /// A keyframe of the stream.
+    struct Keyframe {
+        /// the cycle of the movie that the keyframe is the state at
+        uint64_t time = 0;
+        /// the offset of the state of the keyframe
+        std::size_t state = 0;
+        /// the offset of the event after the keyframe
+        std::size_t next = 0;
+        /// the slots as they were at the keyframe
+        SlotTable slots = {};
+    };
+
+ private:
+    /// the header and the stream of events
+    std::vector<NES_Byte> data;
+    /// the keyframes of the stream in the order of time
+    std::vector<Keyframe> keyframes;
+    /// the slots as they are at the end of the stream
+    SlotTable slots = {};
+    /// the cycle of the last event
+    uint64_t time = 0;
+    /// whether the stream ends with an END event
+    bool is_ended = false;
+
+    /// @brief Append a plain value to the stream.
+    template<typename T>
+    inline void append(const T& value) {
+        const auto* bytes = reinterpret_cast<const NES_Byte*>(&value);
+        data.insert(data.end(), bytes, bytes + sizeof(T));
+    }
+
+    /// @brief Append a binary state to the stream.
+    ///
+    /// @param state the binary state to append
+    /// @returns the offset of the state
+    ///
+    inline std::size_t append_state(const std::vector<NES_Byte>& state) {
+        const std::size_t offset = data.size();
+        append(static_cast<uint32_t>(state.size()));
+        data.insert(data.end(), state.begin(), state.end());
+        return offset;
+    }
+
+    /// @brief Append the time and kind of an event to the stream.
+    inline void append_event(uint64_t at, Event event) {
+        uint64_t delta = at - time;
+        time = at;
+        // LEB128, 7 bits at a time starting with the least significant
+        while (delta >= 0x80) {
+            data.push_back(static_cast<NES_Byte>(delta | 0x80));
+            delta >>= 7;
+        }
+        data.push_back(static_cast<NES_Byte>(delta));
+        data.push_back(event);
+    }
+
+    /// @brief Read the state at an offset of the stream.
+    ///
+    /// @param offset the offset of the state
+    /// @param size the number of bytes of the state to read into
+    /// @returns true if the whole state is in the stream
+    ///
+    inline bool read_state(std::size_t offset, std::size_t& size) const {
+        uint32_t length = 0;
+        if (offset + sizeof length > data.size()) return false;
+        std::memcpy(&length, &data[offset], sizeof length);
+        size = length;
+        return length <= data.size() - offset - sizeof length;
+    }
+
+ public:
+    /// @brief Initialize a new empty movie.
+    Movie() { }
+
+    /// @brief Return true if the movie has no stream.
+    inline bool is_empty() const { return keyframes.empty(); }
+
+    /// @brief Return the bytes of the movie.
+    inline const std::vector<NES_Byte>& get_data() const { return data; }
+
+    /// @brief Return the checksum of the ROM of the game of the movie.
+    inline uint32_t get_rom_checksum() const {
+        uint32_t checksum = 0;
+        if (data.size() >= HEADER_SIZE) std::memcpy(&checksum, &data[12], sizeof checksum);
+        return checksum;
+    }
+
+    /// @brief Return the number of cycles that the movie runs for.
+    inline uint64_t get_length() const { return time; }
+
+    /// @brief Return true if the recording of the movie stopped.
+    inline bool is_finished() const { return is_ended; }
+
+    /// @brief Return the keyframes of the movie.
+    inline const std::vector<Keyframe>& get_keyframes() const { return keyframes; }
+
+    /// @brief Return the keyframe to seek to for a cycle of the movie.
+    ///
+    /// @param at the cycle of the movie to seek to
+    /// @returns the last keyframe at or before the cycle
+    ///
+    const Keyframe& find_keyframe(uint64_t at) const {
+        auto keyframe = std::upper_bound(keyframes.begin(), keyframes.end(), at,
+            [](uint64_t value, const Keyframe& other) { return value < other.time; });
+        return keyframe == keyframes.begin() ? keyframes.front() : *(keyframe - 1);
+    }
+
+    /// @brief Return a pointer to the bytes of the state at an offset.
+    ///
+    /// @param offset the offset of the state (see Record and Keyframe)
+    /// @param size the number of bytes of the state to read into
+    /// @returns the binary state
+    ///
+    inline const NES_Byte* get_state(std::size_t offset, std::size_t& size) const {
+        uint32_t length = 0;
+        std::memcpy(&length, &data[offset], sizeof length);
+        size = length;
+        return &data[offset + sizeof length];
+    }
+
+    /// @brief Read the event at an offset of the stream.
+    ///
+    /// @param offset the offset of the event
+    /// @param previous the cycle of the event before
+    /// @param record the record to read the event into
+    /// @returns true if the whole event is in the stream
+    ///
+    bool read(std::size_t offset, uint64_t previous, Record& record) const {
+        uint64_t delta = 0;
+        for (int shift = 0; ; shift += 7) {
+            if (offset >= data.size() || shift > 63) return false;
+            const NES_Byte byte = data[offset++];
+            delta |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) break;
+        }
+        if (offset >= data.size() || data[offset] >= NUM_EVENTS) return false;
+        record.time = previous + delta;
+        record.event = static_cast<Event>(data[offset++]);
+        record.value = 0;
+        record.state = 0;
+        switch (record.event) {
+            case PLAYER1:
+            case PLAYER2:
+            case LOAD:
+                if (offset >= data.size()) return false;
+                record.value = data[offset++];
+                break;
+            case SAVE:
+                if (offset >= data.size()) return false;
+                record.value = data[offset++];
+                // fall through
+            case LOAD_STATE:
+            case KEYFRAME: {
+                std::size_t size = 0;
+                if (!read_state(offset, size)) return false;
+                record.state = offset;
+                offset += sizeof(uint32_t) + size;
+                break;
+            }
+            default:
+                break;
+        }
+        record.next = offset;
+        return true;
+    }
+
+    /// @brief Start a new stream.
+    ///
+    /// @param checksum the checksum of the ROM of the game
+    /// @param state the binary state of the emulator at the first cycle
+    /// @details
+    /// The stream and the keyframes reserve memory for an hour of keyframes
+    /// up front, so the events that are appended while recording (on the
+    /// thread that runs the emulator) do not grow them and copy them. Longer
+    /// recordings have no more keyframes (see can_add_keyframe), and grow
+    /// the stream by doubling it, so the copies stay rare.
+    ///
+    void begin(uint32_t checksum, const std::vector<NES_Byte>& state) {
+        data.clear();
+        // a keyframe is its state and at most 16 bytes of time, kind, and size
+        data.reserve(HEADER_SIZE + RESERVED_KEYFRAMES * (state.size() + 16) + RESERVED_EVENT_BYTES);
+        keyframes.clear();
+        keyframes.reserve(RESERVED_KEYFRAMES);
+        slots.fill(0);
+        time = 0;
+        is_ended = false;
+        // the constants are copied, as append takes a reference
+        append(uint32_t(MAGIC));
+        append(uint32_t(VERSION));
+        append(Emulator::get_state_layout());
+        append(checksum);
+        add_keyframe(0, state);
+    }
+
+    /// @brief Append an event without a payload.
+    inline void add_event(uint64_t at, Event event) {
+        append_event(at, event);
+        if (event == END) is_ended = true;
+    }
+
+    /// @brief Append an event with a byte of payload.
+    inline void add_event(uint64_t at, Event event, NES_Byte value) {
+        append_event(at, event);
+        data.push_back(value);
+    }
+
+    /// @brief Append the save of a state to a slot.
+    inline void add_save(uint64_t at, NES_Byte slot, const std::vector<NES_Byte>& state) {
+        append_event(at, SAVE);
+        data.push_back(slot);
+        slots[slot] = append_state(state);
+    }
+
+    /// @brief Append the load of a state from outside of the movie.
+    inline void add_load_state(uint64_t at, const std::vector<NES_Byte>& state) {
+        append_event(at, LOAD_STATE);
+        append_state(state);
+    }
+
+    /// @brief Return true if a keyframe can be appended without growing the
+    /// keyframes, false if the keyframes are full.
+    inline bool can_add_keyframe() const { return keyframes.size() < keyframes.capacity(); }
+
+    /// @brief Append a keyframe.
+    void add_keyframe(uint64_t at, const std::vector<NES_Byte>& state) {
+        append_event(at, KEYFRAME);
+        Keyframe keyframe;
+        keyframe.time = at;
+        keyframe.state = append_state(state);
+        keyframe.next = data.size();
+        keyframe.slots = slots;
+        keyframes.push_back(keyframe);
+    }
+
+    /// @brief Return the offset of the last state saved to a slot (0 for
+    /// none).
+    inline std::size_t get_slot(NES_Byte slot) const { return slots[slot]; }
+
+    /// @brief Set the movie from bytes of the movie format.
+    ///
+    /// @param bytes the bytes to read the movie from
+    /// @returns true if the bytes are a movie, false otherwise (in which
+    /// case the movie is empty)
+    ///
+    bool set_data(std::vector<NES_Byte> bytes) {
+        data.swap(bytes);
+        keyframes.clear();
+        slots.fill(0);
+        time = 0;
+        is_ended = false;
+        uint32_t header[4] = {};
+        if (data.size() < HEADER_SIZE) {
+            data.clear();
+            return false;
+        }
+        std::memcpy(header, data.data(), HEADER_SIZE);
+        if (header[0] != MAGIC || header[1] != VERSION || header[2] != Emulator::get_state_layout()) {
+            data.clear();
+            return false;
+        }
+        // index the keyframes and stop at the end or the first partial or
+        // damaged event
+        std::size_t offset = HEADER_SIZE;
+        Record record;
+        while (!is_ended && read(offset, time, record)) {
+            // a movie starts with a keyframe and only loads saved slots
+            if (keyframes.empty() && record.event != KEYFRAME) break;
+            if (record.event == LOAD && slots[record.value] == 0) break;
+            // the states are checked once here, so playing them back only
+            // checks their headers (see Emulator::load_state)
+            if (record.state != 0) {
+                std::size_t size = 0;
+                const NES_Byte* state = get_state(record.state, size);
+                if (!Emulator::is_state(state, size, header[3])) break;
+            }
+            time = record.time;
+            if (record.event == SAVE) {
+                slots[record.value] = record.state;
+            } else if (record.event == KEYFRAME) {
+                Keyframe keyframe;
+                keyframe.time = record.time;
+                keyframe.state = record.state;
+                keyframe.next = record.next;
+                keyframe.slots = slots;
+                keyframes.push_back(keyframe);
+            } else if (record.event == END) {
+                is_ended = true;
+            }
+            offset = record.next;
+        }
+        data.resize(offset);
+        if (keyframes.empty()) {
+            data.clear();
+            return false;
+        }
+        return true;
+    }
+
+    /// @brief Write the movie to a file.
+    ///
+    /// @param path the path of the file to write
+    /// @returns true if the file was written, false otherwise
+    ///
+    bool save(const std::string& path) const {
+        std::ofstream file(path, std::ios_base::binary | std::ios_base::trunc);
+        if (!file.is_open()) return false;
+        file.write(reinterpret_cast<const char*>(data.data()), data.size());
+        return file.good();
+    }
+
+    /// @brief Read the movie from a file.
+    ///
+    /// @param path the path of the file to read
+    /// @returns true if the file is a movie, false otherwise
+    ///
+    bool load(const std::string& path) {
+        std::ifstream file(path, std::ios_base::binary);
+        if (!file.is_open()) return set_data({});
+        return set_data(std::vector<NES_Byte>(
+            std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()));
+    }
+};
+
+/// A recorder of the inputs to an emulator into a movie.
+///
+/// @details
+/// The owner of the emulator tells the recorder about every input that it
+/// gives the emulator and the cycles that it runs, in the order that they
+/// happen. The inputs are stamped with the cycle of the movie, so they play
+/// back on the same CPU cycle no matter when during a frame they happened.
+///
+class MovieRecorder {
+ private:
+    /// the movie to record to (nullptr when stopped)
+    Movie* movie = nullptr;
+    /// the number of cycles that the recording has run
+    uint64_t time = 0;
+    /// the cycle of the movie to write the next keyframe at
+    uint64_t next_keyframe = 0;
+    /// the number of cycles between keyframes
+    uint64_t interval = Movie::KEYFRAME_INTERVAL * CYCLES_PER_FRAME;
+    /// the last buttons of the players (-1 before the first write)
+    int buttons[2] = {-1, -1};
+    /// a snapshot to stage binary states in
+    Emulator::Snapshot snapshot;
+    /// a buffer for binary states
+    std::vector<NES_Byte> state;
+
+ public:
+    /// @brief Initialize a new stopped recorder.
+    MovieRecorder() { state.reserve(0x10000); }
+
+    /// @brief Set the number of frames between keyframes.
+    inline void set_keyframe_interval(uint64_t frames) {
+        interval = std::max<uint64_t>(frames, 1) * CYCLES_PER_FRAME;
+    }
+
+    /// @brief Return true if the recorder is recording.
+    inline bool is_recording() const { return movie != nullptr; }
+
+    /// @brief Start recording from the present state of an emulator.
+    ///
+    /// @param movie_ the movie to record to, its stream is replaced
+    /// @param emulator the emulator to record the inputs to
+    /// @returns true if the recording started, false if there is no game
+    ///
+    bool start(Movie& movie_, const Emulator& emulator) {
+        if (!emulator.save_state(snapshot, state)) return false;
+        movie = &movie_;
+        movie->begin(emulator.get_rom_checksum(), state);
+        time = 0;
+        next_keyframe = interval;
+        buttons[0] = buttons[1] = -1;
+        return true;
+    }
+
+    /// @brief Stop recording and end the stream of the movie.
+    void stop() {
+        if (movie == nullptr) return;
+        movie->add_event(time, Movie::END);
+        movie = nullptr;
+    }
+
+    /// @brief Record the cycles that the emulator ran.
+    ///
+    /// @param emulator the emulator that ran the cycles
+    /// @param count the number of cycles that the emulator ran
+    ///
+    void advance(const Emulator& emulator, uint64_t count) {
+        if (movie == nullptr) return;
+        time += count;
+        if (time < next_keyframe) return;
+        next_keyframe = time + interval;
+        // the keyframes stop when the memory reserved for them is full
+        if (movie->can_add_keyframe() && emulator.save_state(snapshot, state))
+            movie->add_keyframe(time, state);
+    }
+
+    /// @brief Record the buttons that were written to the controllers.
+    ///
+    /// @param player1 the button bitmap of the player 1 controller
+    /// @param player2 the button bitmap of the player 2 controller
+    ///
+    void set_controllers(NES_Byte player1, NES_Byte player2) {
+        if (movie == nullptr) return;
+        if (buttons[0] != player1) movie->add_event(time, Movie::PLAYER1, player1);
+        if (buttons[1] != player2) movie->add_event(time, Movie::PLAYER2, player2);
+        buttons[0] = player1;
+        buttons[1] = player2;
+    }
+
+    /// @brief Record a press of the reset button.
+    inline void reset() {
+        if (movie != nullptr) movie->add_event(time, Movie::RESET);
+    }
+
+    /// @brief Record the save of a state.
+    ///
+    /// @param emulator the emulator that the state was saved from
+    /// @param slot the slot that the state was saved to
+    ///
+    void save(const Emulator& emulator, NES_Byte slot) {
+        if (movie == nullptr || !emulator.save_state(snapshot, state)) return;
+        movie->add_save(time, slot, state);
+    }
+
+    /// @brief Record the load of a state.
+    ///
+    /// @param emulator the emulator after the state was loaded
+    /// @param slot the slot that the state was loaded from
+    /// @details
+    /// The load refers to the slot if the emulator is in the state that the
+    /// movie saved to it, otherwise the state is copied into the stream.
+    ///
+    void load(const Emulator& emulator, NES_Byte slot) {
+        if (movie == nullptr || !emulator.save_state(snapshot, state)) return;
+        const std::size_t offset = movie->get_slot(slot);
+        if (offset != 0) {
+            std::size_t size = 0;
+            const NES_Byte* saved = movie->get_state(offset, size);
+            if (size == state.size() && std::memcmp(saved, state.data(), size) == 0) {
+                movie->add_event(time, Movie::LOAD, slot);
+                return;
+            }
+        }
+        movie->add_load_state(time, state);
+    }
+};
+
+/// A player of a movie into an emulator.
+class MoviePlayer {
+ private:
+    /// the movie to play (nullptr when stopped)
+    const Movie* movie = nullptr;
+    /// the number of cycles that the movie has played
+    uint64_t time = 0;
+    /// the next event of the movie
+    Movie::Record next;
+    /// whether the next event was read
+    bool has_next = false;
+    /// the number of states that the movie has loaded
+    uint64_t loads = 0;
+    /// the slots of the movie as of the present cycle
+    Movie::SlotTable slots = {};
+    /// a snapshot to stage binary states in
+    Emulator::Snapshot snapshot;
+
+    /// @brief Read the event at an offset into the next event.
+    inline void read_next(std::size_t offset) {
+        has_next = movie->read(offset, next.time, next);
+    }
+
+    /// @brief Load a binary state of the movie into an emulator.
+    inline bool load(Emulator& emulator, std::size_t offset) {
+        std::size_t size = 0;
+        const NES_Byte* state = movie->get_state(offset, size);
+        return emulator.load_state(snapshot, state, size);
+    }
+
+    /// @brief Apply the events of the present cycle to an emulator.
+    void apply(Emulator& emulator) {
+        while (has_next && next.time <= time) {
+            switch (next.event) {
+                case Movie::PLAYER1: emulator.set_controller(0, next.value); break;
+                case Movie::PLAYER2: emulator.set_controller(1, next.value); break;
+                case Movie::RESET: emulator.reset(); break;
+                case Movie::SAVE: slots[next.value] = next.state; break;
+                case Movie::LOAD: load(emulator, slots[next.value]); ++loads; break;
+                case Movie::LOAD_STATE: load(emulator, next.state); ++loads; break;
+                case Movie::END: has_next = false; return;
+                default: break;
+            }
+            read_next(next.next);
+        }
+    }
+
+ public:
+    /// @brief Initialize a new stopped player.
+    MoviePlayer() { }
+
+    /// @brief Return true if the player is playing a movie.
+    inline bool is_playing() const { return movie != nullptr; }
+
+    /// @brief Return the number of cycles that the movie has played.
+    inline uint64_t get_time() const { return time; }
+
+    /// @brief Return the cycle of the next event (the end of the movie if
+    /// there are no more events).
+    inline uint64_t get_next_time() const {
+        if (movie == nullptr) return time;
+        return has_next ? next.time : std::max(time, movie->get_length());
+    }
+
+    /// @brief Return the number of states that the movie has loaded, which
+    /// clear the audio of the emulator.
+    inline uint64_t get_loads() const { return loads; }
+
+    /// @brief Start playing a movie from a cycle.
+    ///
+    /// @param movie_ the movie to play, it must outlive the playback
+    /// @param emulator the emulator to play the movie into
+    /// @param at the cycle of the movie to start at
+    /// @returns true if the movie is playing, false if the movie is empty or
+    /// of a different game
+    ///
+    bool start(const Movie& movie_, Emulator& emulator, uint64_t at = 0) {
+        movie = nullptr;
+        if (movie_.is_empty() || movie_.get_rom_checksum() != emulator.get_rom_checksum()) return false;
+        movie = &movie_;
+        if (seek(emulator, at)) return true;
+        movie = nullptr;
+        return false;
+    }
+
+    /// @brief Stop playing the movie.
+    inline void stop() { movie = nullptr; }
+
+    /// @brief Jump to a cycle of the movie.
+    ///
+    /// @param emulator the emulator that plays the movie
+    /// @param at the cycle of the movie to jump to
+    /// @returns true if the emulator is at the cycle, false if the keyframe
+    /// could not be loaded
+    /// @details
+    /// The emulator loads the last keyframe before the cycle and runs to it
+    /// without rendering frames or keeping audio, so the cost of a seek is
+    /// at most a keyframe interval of emulation regardless of the cycle.
+    ///
+    bool seek(Emulator& emulator, uint64_t at) {
+        if (movie == nullptr) return false;
+        at = std::min(at, movie->get_length());
+        const auto& keyframe = movie->find_keyframe(at);
+        if (!load(emulator, keyframe.state)) return false;
+        time = keyframe.time;
+        slots = keyframe.slots;
+        next.time = keyframe.time;
+        read_next(keyframe.next);
+        while (time < at) {
+            apply(emulator);
+            const uint64_t count = has_next ? std::min(next.time, at) - time : at - time;
+            emulator.fast_forward(count, []() { });
+            time += count;
+        }
+        return true;
+    }
+
+    /// @brief Play cycles of the movie.
+    ///
+    /// @param emulator the emulator that plays the movie
+    /// @param count the number of cycles to play
+    /// @param callback a callback function for when a frame event occurs
+    /// @returns true if the movie is still playing, false if it ended
+    /// @details
+    /// The emulator runs the cycles past the end of the movie on its own.
+    ///
+    template<typename EndOfFrameCallback>
+    bool run(Emulator& emulator, uint64_t count, EndOfFrameCallback callback) {
+        while (count > 0) {
+            // run up to the next event of the movie
+            uint64_t run = count;
+            if (movie != nullptr) {
+                apply(emulator);
+                if (has_next) run = std::min(run, next.time - time);
+            }
+            for (uint64_t i = 0; i < run; i++) emulator.cycle(callback);
+            count -= run;
+            time += run;
+            if (movie != nullptr && !has_next && time >= movie->get_length()) movie = nullptr;
+        }
+        return movie != nullptr;
+    }
+};
+
+}  // namespace NES
+
+#endif  // NES_MOVIE_HPP
@@ -11,7 +11,9 @@
 #include <vector>
 #include <cstdlib>
 #include <string>
+#ifndef NES_NO_JSON
 #include <jansson.h>
+#endif  // NES_NO_JSON
 #include "common.hpp"
 #include "cartridge.hpp"
 
@@ -98,6 +100,42 @@ class PictureBus {
         return palette[address];
     }
 
+    /// Copy the memory of another bus without the mapper. Does not allocate
+    /// once the memory is the same size.
+    ///
+    /// @param other the bus to copy the memory of
+    ///
+    inline void copy_from(const PictureBus& other) {
+        ram = other.ram;
+        name_tables = other.name_tables;
+        palette = other.palette;
+    }
+
+    /// Write the memory of the bus in the binary state format.
+    ///
+    /// @param writer the writer to write the memory with
+    ///
+    void save_state(StateWriter& writer) const {
+        writer.write_block(ram);
+        for (std::size_t offset : name_tables) writer.write(static_cast<uint16_t>(offset));
+        writer.write_block(palette);
+    }
+
+    /// Read the memory of the bus from the binary state format.
+    ///
+    /// @param reader the reader to read the memory with
+    ///
+    void load_state(StateReader& reader) {
+        reader.read_block(ram.data(), ram.size());
+        for (std::size_t& offset : name_tables) {
+            uint16_t value = 0;
+            reader.read(value);
+            // the name tables are in the 2KB of RAM
+            offset = value & 0x400;
+        }
+        reader.read_block(palette.data(), palette.size());
+    }
+
     /// Update the mirroring and name table from the mapper.
     void update_mirroring() {
         switch (mapper->getNameTableMirroring()) {
@@ -125,6 +163,7 @@ class PictureBus {
         }
     }
 
+#ifndef NES_NO_JSON
     /// Convert the object's state to a JSON object.
     json_t* dataToJson() const {
         json_t* rootJ = json_object();
@@ -192,6 +231,7 @@ class PictureBus {
             }
         }
     }
+#endif  // NES_NO_JSON
 };
 
 }  // namespace NES
@@ -5,6 +5,7 @@
 //  Copyright (c) 2019 Christian Kauten. All rights reserved.
 //
 
+#include <algorithm>
 #include <cstring>
 #include "ppu.hpp"
 
@@ -17,6 +18,7 @@ void PPU::reset() {
     is_showing_background = true;
     is_showing_sprites = true;
     is_even_frame = true;
+    is_frame_ready = false;
     is_first_write = true;
     background_page = LOW;
     sprite_page = LOW;
@@ -34,6 +36,9 @@ void PPU::reset() {
     nes_ntsc_setup_t setup;
     setup = nes_ntsc_composite;
     nes_ntsc_init(&ntsc, &setup);
+    is_merging_fields = setup.merge_fields;
+    // filter every scanline of the next frame
+    std::fill(std::begin(ntsc_phases), std::end(ntsc_phases), -1);
 }
 
 void PPU::cycle(PictureBus& bus) {
@@ -62,6 +67,7 @@ void PPU::cycle(PictureBus& bus) {
         }
         case RENDER: {
             if (cycles > 0 && cycles <= SCANLINE_VISIBLE_DOTS) {
+                ++dots;
                 NES_Byte bgColor = 0, sprColor = 0;
                 bool bgOpaque = false, sprOpaque = true;
                 bool spriteForeground = false;
@@ -252,7 +258,6 @@ void PPU::cycle(PictureBus& bus) {
         case VERTICAL_BLANK: {
             if (cycles == 1 && scanline == VISIBLE_SCANLINES + 1) {
                 is_vblank = true;
-                if (is_interrupting) vblank_callback();
             }
 
             if (cycles >= SCANLINE_END_CYCLE) {
@@ -261,17 +266,8 @@ void PPU::cycle(PictureBus& bus) {
             }
 
             if (scanline >= FRAME_END_SCANLINE) {  // end of video frame
-                // render the frame using the NTSC video filter
-                nes_ntsc_blit(
-                    &ntsc,                  // configured NTSC object
-                    *nes_pixels,            // input buffer of NES pixels
-                    SCANLINE_VISIBLE_DOTS,  // width of the NES screen
-                    is_even_frame,          // alternating frame flag
-                    SCANLINE_VISIBLE_DOTS,  // width of the NES screen
-                    VISIBLE_SCANLINES,      // height of the NES screen
-                    *ntsc_screen,           // output buffer to write to
-                    NTSC_PITCH              // number of bytes in an output row
-                );
+                // the frame is filtered by the caller (see render)
+                is_frame_ready = true;
                 // update the PPU state
                 pipeline_state = PRE_RENDER;
                 scanline = 0;
@@ -285,6 +281,34 @@ void PPU::cycle(PictureBus& bus) {
     ++cycles;
 }
 
+void PPU::render() {
+    is_frame_ready = false;
+    // the burst phase alternates between frames unless the filter merges the
+    // fields, in which case it is always 0 (see ntsc/nes_ntsc.txt). the
+    // frame parity has already been flipped for the next frame
+    const int frame_phase = is_merging_fields ? 0 : !is_even_frame;
+    // only filter the scanlines that changed since they were last filtered
+    // with the same burst phase
+    for (int row = 0; row < VISIBLE_SCANLINES; row++) {
+        const int phase = (frame_phase + row) % nes_ntsc_burst_count;
+        if (ntsc_phases[row] == phase &&
+            std::memcmp(nes_pixels[row], ntsc_pixels[row], SCANLINE_VISIBLE_DOTS) == 0)
+            continue;
+        nes_ntsc_blit(
+            &ntsc,                  // configured NTSC object
+            nes_pixels[row],        // input buffer of NES pixels
+            SCANLINE_VISIBLE_DOTS,  // width of the NES screen
+            phase,                  // burst phase of the scanline
+            SCANLINE_VISIBLE_DOTS,  // width of the NES screen
+            1,                      // height of the scanline
+            ntsc_screen[row],       // output buffer to write to
+            NTSC_PITCH              // number of bytes in an output row
+        );
+        std::memcpy(ntsc_pixels[row], nes_pixels[row], SCANLINE_VISIBLE_DOTS);
+        ntsc_phases[row] = phase;
+    }
+}
+
 void PPU::do_DMA(const NES_Byte* page_ptr) {
     std::memcpy(
         sprite_memory.data() + sprite_data_address,
@@ -324,6 +348,34 @@ void PPU::set_mask(NES_Byte mask) {
     is_showing_sprites = mask & 0x10;
 }
 
+int PPU::get_dots_to_a12_edge() const {
+    if (!is_showing_background && !is_showing_sprites) return -1;
+    // the dot of each rendering line that A12 rises on. the background is
+    // fetched from dot 1 to 256 and from 321 to 336 and the sprites from
+    // 257 to 320, so A12 only rises once per line when the two use
+    // different pattern tables (8x16 sprites are assumed to use $1000)
+    const bool is_sprites_high = is_long_sprites || sprite_page == HIGH;
+    int edge;
+    if (background_page == LOW && is_sprites_high)
+        edge = 260;
+    else if (background_page == HIGH && !is_sprites_high)
+        edge = 324;
+    else
+        return -1;
+    // the line of the frame that the PPU is on (the pre-render line is -1)
+    int line = pipeline_state == PRE_RENDER ? -1 : scanline;
+    if (line < VISIBLE_SCANLINES && cycles <= edge) return edge - cycles;
+    // the dots until the start of the next line. the pre-render line of an
+    // odd frame is a dot shorter when rendering
+    int dots_to_edge = SCANLINE_END_CYCLE - cycles + edge;
+    if (line == -1)
+        dots_to_edge -= !is_even_frame && is_showing_background && is_showing_sprites;
+    // the next edge after the last visible line is on the pre-render line
+    if (line >= VISIBLE_SCANLINES - 1)
+        dots_to_edge += (FRAME_END_SCANLINE - 1 - line) * SCANLINE_END_CYCLE;
+    return dots_to_edge;
+}
+
 NES_Byte PPU::get_status() {
     NES_Byte status = is_sprite_zero_hit << 6 | is_vblank << 7;
     // data_address = 0;
@@ -10,9 +10,13 @@
 
 #include "picture_bus.hpp"
 #include "ntsc/nes_ntsc.h"
+#ifndef NES_NO_JSON
 #include <jansson.h>
+#endif  // NES_NO_JSON
+#include <cstring>
 #include <functional>
 #include <string>
+#include <vector>
 
 namespace NES {
 
@@ -34,8 +38,6 @@ static constexpr int FRAME_END_SCANLINE = 261;
 /// The Picture Processing Unit (PPU) for the NES
 class PPU {
  private:
-    /// The callback to fire when entering vertical blanking mode
-    Callback vblank_callback;
     /// The OAM memory (sprites)
     std::vector<NES_Byte> sprite_memory = std::vector<NES_Byte>(64 * 4);
     /// OAM memory (sprites) for the next scanline
@@ -55,6 +57,10 @@ class PPU {
     int scanline;
     /// whether the PPU is on an even frame
     bool is_even_frame;
+    /// whether a frame has finished and has not been rendered yet
+    bool is_frame_ready = false;
+    /// the number of visible dots the PPU has rendered
+    uint64_t dots = 0;
 
     // Status
 
@@ -112,21 +118,222 @@ class PPU {
     NES_Byte nes_pixels[VISIBLE_SCANLINES][SCANLINE_VISIBLE_DOTS];
     /// the NTSC video filter for rendering RGB pixels from NES pixels
     nes_ntsc_t ntsc;
+    /// whether the NTSC filter merges the even and odd fields
+    bool is_merging_fields;
+    /// the NES pixels of each scanline when it was last filtered
+    NES_Byte ntsc_pixels[VISIBLE_SCANLINES][SCANLINE_VISIBLE_DOTS];
+    /// the burst phase each scanline was last filtered with (-1 if never)
+    int ntsc_phases[VISIBLE_SCANLINES];
     /// The RGB pixels rendered by the NTSC video filter
     NES_Pixel ntsc_screen[VISIBLE_SCANLINES][SCANLINE_VISIBLE_DOTS_NTSC];
 
  public:
+    /// The state of the PPU without the video filter and its output. The
+    /// fields mirror the fields of the PPU.
+    struct Snapshot {
+        std::vector<NES_Byte> sprite_memory;
+        std::vector<NES_Byte> scanline_sprites;
+        State pipeline_state;
+        int cycles;
+        int scanline;
+        bool is_even_frame;
+        bool is_frame_ready;
+        bool is_vblank;
+        bool is_sprite_zero_hit;
+        NES_Address data_address;
+        NES_Address temp_address;
+        NES_Byte fine_x_scroll;
+        bool is_first_write;
+        NES_Byte data_buffer;
+        NES_Byte sprite_data_address;
+        bool is_showing_sprites;
+        bool is_showing_background;
+        bool is_hiding_edge_sprites;
+        bool is_hiding_edge_background;
+        bool is_long_sprites;
+        bool is_interrupting;
+        CharacterPage background_page, sprite_page;
+        NES_Address data_address_increment;
+        NES_Byte nes_pixels[VISIBLE_SCANLINES][SCANLINE_VISIBLE_DOTS];
+
+        /// @brief Write the snapshot in the binary state format.
+        ///
+        /// @param writer the writer to write the snapshot with
+        ///
+        void save_state(StateWriter& writer) const {
+            writer.write_block(sprite_memory);
+            writer.write_block(scanline_sprites);
+            writer.write(pipeline_state);
+            writer.write(cycles);
+            writer.write(scanline);
+            writer.write(is_even_frame);
+            writer.write(is_frame_ready);
+            writer.write(is_vblank);
+            writer.write(is_sprite_zero_hit);
+            writer.write(data_address);
+            writer.write(temp_address);
+            writer.write(fine_x_scroll);
+            writer.write(is_first_write);
+            writer.write(data_buffer);
+            writer.write(sprite_data_address);
+            writer.write(is_showing_sprites);
+            writer.write(is_showing_background);
+            writer.write(is_hiding_edge_sprites);
+            writer.write(is_hiding_edge_background);
+            writer.write(is_long_sprites);
+            writer.write(is_interrupting);
+            writer.write(background_page);
+            writer.write(sprite_page);
+            writer.write(data_address_increment);
+            writer.write_block(*nes_pixels, sizeof nes_pixels);
+        }
+
+        /// @brief Read the snapshot from the binary state format.
+        ///
+        /// @param reader the reader to read the snapshot with
+        ///
+        void load_state(StateReader& reader) {
+            reader.read_block(sprite_memory.data(), sprite_memory.size());
+            // the scanline has at most 8 sprites, the rest are dropped
+            reader.read_block(scanline_sprites, 8);
+            for (auto& sprite : scanline_sprites) sprite &= 0x3f;
+            reader.read(pipeline_state);
+            reader.read(cycles);
+            reader.read(scanline);
+            reader.read(is_even_frame);
+            reader.read(is_frame_ready);
+            reader.read(is_vblank);
+            reader.read(is_sprite_zero_hit);
+            reader.read(data_address);
+            reader.read(temp_address);
+            reader.read(fine_x_scroll);
+            reader.read(is_first_write);
+            reader.read(data_buffer);
+            reader.read(sprite_data_address);
+            reader.read(is_showing_sprites);
+            reader.read(is_showing_background);
+            reader.read(is_hiding_edge_sprites);
+            reader.read(is_hiding_edge_background);
+            reader.read(is_long_sprites);
+            reader.read(is_interrupting);
+            reader.read(background_page);
+            reader.read(sprite_page);
+            reader.read(data_address_increment);
+            reader.read_block(*nes_pixels, sizeof nes_pixels);
+        }
+    };
+
     /// Perform a single cycle on the PPU.
     void cycle(PictureBus& bus);
 
     /// Reset the PPU.
     void reset();
 
-    /// Set the interrupt callback for the CPU.
+    /// Return true if a frame has finished and has not been rendered yet.
+    inline bool has_frame() const { return is_frame_ready; }
+
+    /// Render the finished frame to the screen using the NTSC filter.
+    void render();
+
+    /// Return the number of visible dots the PPU has rendered.
+    inline uint64_t get_dots() const { return dots; }
+
+    /// Return the scanline that the PPU is on.
+    inline int get_scanline() const { return scanline; }
+
+    /// Return the dot of the scanline that the PPU is on.
+    inline int get_dot() const { return cycles; }
+
+    /// Return the NES palette indexes of the last frame (before filtering).
+    inline const NES_Byte* get_pixels() const { return *nes_pixels; }
+
+    /// @brief Save the state of the PPU to a snapshot.
+    ///
+    /// @param snapshot the snapshot to save the state to
+    /// @details
+    /// The NTSC filter and its output are not saved, and after the first
+    /// save the snapshot does not allocate memory.
+    ///
+    void save(Snapshot& snapshot) const {
+        snapshot.sprite_memory = sprite_memory;
+        snapshot.scanline_sprites = scanline_sprites;
+        snapshot.pipeline_state = pipeline_state;
+        snapshot.cycles = cycles;
+        snapshot.scanline = scanline;
+        snapshot.is_even_frame = is_even_frame;
+        snapshot.is_frame_ready = is_frame_ready;
+        snapshot.is_vblank = is_vblank;
+        snapshot.is_sprite_zero_hit = is_sprite_zero_hit;
+        snapshot.data_address = data_address;
+        snapshot.temp_address = temp_address;
+        snapshot.fine_x_scroll = fine_x_scroll;
+        snapshot.is_first_write = is_first_write;
+        snapshot.data_buffer = data_buffer;
+        snapshot.sprite_data_address = sprite_data_address;
+        snapshot.is_showing_sprites = is_showing_sprites;
+        snapshot.is_showing_background = is_showing_background;
+        snapshot.is_hiding_edge_sprites = is_hiding_edge_sprites;
+        snapshot.is_hiding_edge_background = is_hiding_edge_background;
+        snapshot.is_long_sprites = is_long_sprites;
+        snapshot.is_interrupting = is_interrupting;
+        snapshot.background_page = background_page;
+        snapshot.sprite_page = sprite_page;
+        snapshot.data_address_increment = data_address_increment;
+        std::memcpy(snapshot.nes_pixels, nes_pixels, sizeof nes_pixels);
+    }
+
+    /// @brief Load the state of the PPU from a snapshot.
+    ///
+    /// @param snapshot the snapshot to load the state from
+    ///
+    void load(const Snapshot& snapshot) {
+        sprite_memory = snapshot.sprite_memory;
+        scanline_sprites = snapshot.scanline_sprites;
+        pipeline_state = snapshot.pipeline_state;
+        cycles = snapshot.cycles;
+        scanline = snapshot.scanline;
+        is_even_frame = snapshot.is_even_frame;
+        is_frame_ready = snapshot.is_frame_ready;
+        is_vblank = snapshot.is_vblank;
+        is_sprite_zero_hit = snapshot.is_sprite_zero_hit;
+        data_address = snapshot.data_address;
+        temp_address = snapshot.temp_address;
+        fine_x_scroll = snapshot.fine_x_scroll;
+        is_first_write = snapshot.is_first_write;
+        data_buffer = snapshot.data_buffer;
+        sprite_data_address = snapshot.sprite_data_address;
+        is_showing_sprites = snapshot.is_showing_sprites;
+        is_showing_background = snapshot.is_showing_background;
+        is_hiding_edge_sprites = snapshot.is_hiding_edge_sprites;
+        is_hiding_edge_background = snapshot.is_hiding_edge_background;
+        is_long_sprites = snapshot.is_long_sprites;
+        is_interrupting = snapshot.is_interrupting;
+        background_page = snapshot.background_page;
+        sprite_page = snapshot.sprite_page;
+        data_address_increment = snapshot.data_address_increment;
+        std::memcpy(nes_pixels, snapshot.nes_pixels, sizeof nes_pixels);
+    }
+
+    /// Drop the finished frame without rendering it.
+    inline void skip_render() { is_frame_ready = false; }
+
+    /// Return the level of the NMI line to the CPU.
+    ///
+    /// @returns true while the PPU is in vertical blank with NMI enabled
+    ///
+    inline bool get_nmi_line() const { return is_vblank && is_interrupting; }
+
+    /// Return the number of dots until the next rising edge of A12 on the
+    /// address bus (i.e., the edge that MMC3 counts scanlines with).
     ///
-    /// @param callback the callback for handling interrupts from the PPU
+    /// @returns the number of calls to cycle before the call with the edge,
+    /// or -1 if the PPU does not raise A12 while its registers are unchanged
+    /// @details
+    /// The PPU does not fetch patterns dot by dot like the hardware does, so
+    /// the edge is predicted from the pattern tables and the rendering flags
+    /// instead of watched for on the bus.
     ///
-    inline void set_interrupt_callback(Callback cb) { vblank_callback = cb; }
+    int get_dots_to_a12_edge() const;
 
     /// TODO: doc
     void do_DMA(const NES_Byte* page_ptr);
@@ -154,6 +361,11 @@ class PPU {
     /// Return the value in the PPU status register.
     NES_Byte get_status();
 
+    /// Return the value in the PPU status register without side effects.
+    inline NES_Byte peek_status() const {
+        return is_sprite_zero_hit << 6 | is_vblank << 7;
+    }
+
     /// TODO: doc
     void set_data_address(NES_Byte address);
 
@@ -193,6 +405,7 @@ class PPU {
     /// Return a pointer to the screen buffer.
     inline NES_Pixel* get_screen_buffer() { return *ntsc_screen; }
 
+#ifndef NES_NO_JSON
     /// Convert the object's state to a JSON object.
     json_t* dataToJson() const {
         json_t* rootJ = json_object();
@@ -356,6 +569,7 @@ class PPU {
             if (json_data) data_address_increment = json_integer_value(json_data);
         }
     }
+#endif  // NES_NO_JSON
 };
 
 }  // namespace NES
@@ -0,0 +1,165 @@
+//  Program:      nes-py
+//  File:         profiler.hpp
+//  Description:  This class measures the time spent in stages of the emulator
+//
+//  Copyright (c) 2020 Christian Kauten. All rights reserved.
+//
+
+#ifndef NES_PROFILER_HPP
+#define NES_PROFILER_HPP
+
+#include <chrono>
+#include "common.hpp"
+#if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+    /// read the time stamp counter instead of the steady clock
+    #define NES_PROFILER_RDTSC
+#endif
+
+namespace NES {
+
+/// A sampling profiler for the stages of the emulator.
+///
+/// @details
+/// Timing every cycle of every unit would cost more than the units do, so
+/// one in every SAMPLE_PERIOD emulator cycles is timed and scaled up to an
+/// estimate of the total. Stages that run once per frame (i.e., the NTSC
+/// filter and the end of frame callback) are timed on every call. Untimed
+/// cycles cost a decrement and a few predictable branches, so the profiler
+/// is always compiled in.
+///
+/// Time is read from the time stamp counter on x86 and from the steady clock
+/// elsewhere. Ticks are converted to seconds using the ratio of ticks to
+/// steady clock time since the profiler was created.
+///
+class Profiler {
+ public:
+    /// The stages of the emulator that are timed
+    enum Stage {
+        CPU_STAGE,
+        PPU_STAGE,
+        APU_STAGE,
+        NTSC_STAGE,
+        SCREEN_STAGE,
+        NUM_STAGES
+    };
+
+    /// The number of emulator cycles per timed cycle
+    static constexpr uint32_t SAMPLE_PERIOD = 64;
+
+ private:
+    /// the clock used to convert ticks to seconds
+    typedef std::chrono::steady_clock Clock;
+
+    /// the estimated ticks spent in each stage
+    uint64_t stage_ticks[NUM_STAGES] = {};
+    /// the number of emulator cycles that have run
+    uint64_t cycles = 0;
+    /// the number of cycles until the next timed cycle
+    uint32_t countdown = SAMPLE_PERIOD;
+    /// whether the current cycle is being timed
+    bool is_sampling = false;
+    /// the tick of the last mark
+    uint64_t last = 0;
+    /// the ticks that reading the clock adds to each measurement
+    uint64_t overhead = calibrate();
+    /// the tick and time that the profiler was created at
+    uint64_t start_ticks = ticks();
+    Clock::time_point start_time = Clock::now();
+
+    /// @brief Return the current tick of the clock.
+    static inline uint64_t ticks() {
+#ifdef NES_PROFILER_RDTSC
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    /// @brief Measure the average cost of reading the clock.
+    ///
+    /// @returns the ticks between two consecutive reads of the clock
+    ///
+    static uint64_t calibrate() {
+        static constexpr int READS = 1024;
+        const uint64_t start = ticks();
+        uint64_t now = start;
+        for (int i = 0; i < READS; i++) now = ticks();
+        return (now - start) / READS;
+    }
+
+    /// @brief Add the ticks since the last mark to a stage.
+    ///
+    /// @param stage the stage to charge the elapsed ticks to
+    /// @param weight the number of calls that the elapsed ticks represent
+    ///
+    inline void charge(Stage stage, uint64_t weight) {
+        const uint64_t now = ticks();
+        const uint64_t elapsed = now - last;
+        if (elapsed > overhead) stage_ticks[stage] += weight * (elapsed - overhead);
+        last = now;
+    }
+
+ public:
+    /// @brief Start an emulator cycle and decide whether to time it.
+    inline void begin() {
+        ++cycles;
+        is_sampling = --countdown == 0;
+        if (!is_sampling) return;
+        countdown = SAMPLE_PERIOD;
+        last = ticks();
+    }
+
+    /// @brief Charge the time since the last mark to a stage if sampling.
+    ///
+    /// @param stage the stage that ran since the last mark
+    ///
+    inline void mark(Stage stage) {
+        if (is_sampling) charge(stage, SAMPLE_PERIOD);
+    }
+
+    /// @brief Start timing a stage that is timed on every call.
+    inline void restart() { last = ticks(); }
+
+    /// @brief Charge the time since the restart to a stage.
+    ///
+    /// @param stage the stage that ran since the restart
+    ///
+    inline void lap(Stage stage) { charge(stage, 1); }
+
+    /// @brief Return the number of emulator cycles that have run.
+    inline uint64_t get_cycles() const { return cycles; }
+
+    /// @brief Return the seconds of wall time since the profiler started.
+    inline double get_wall_seconds() const {
+        return std::chrono::duration<double>(Clock::now() - start_time).count();
+    }
+
+    /// @brief Return the estimated seconds spent in a stage.
+    ///
+    /// @param stage the stage to return the time of
+    /// @returns the time spent in the stage in seconds
+    ///
+    inline double get_seconds(Stage stage) const {
+        const uint64_t elapsed = ticks() - start_ticks;
+        if (elapsed == 0) return 0;
+        return stage_ticks[stage] * get_wall_seconds() / elapsed;
+    }
+
+    /// @brief Return the name of a stage.
+    ///
+    /// @param stage the stage to return the name of
+    /// @returns a short name for the stage
+    ///
+    static inline const char* get_name(Stage stage) {
+        static constexpr const char* NAMES[NUM_STAGES] = {
+            "cpu", "ppu", "apu", "ntsc", "screen"
+        };
+        return NAMES[stage];
+    }
+};
+
+}  // namespace NES
+
+#endif  // NES_PROFILER_HPP
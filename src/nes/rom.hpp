@@ -12,9 +12,12 @@
 #include <string>
 #include <array>
 #include <vector>
+#ifndef NES_NO_JSON
 #include <jansson.h>
 #include "../base64.h"
+#endif  // NES_NO_JSON
 #include "common.hpp"
+#include "state.hpp"
 
 namespace NES {
 
@@ -38,6 +41,8 @@ class ROM {
     std::vector<NES_Byte> chr_rom;
     /// the PRG RAM
     std::vector<NES_Byte> prg_ram;
+    /// the FNV-1a hash of the PRG and CHR ROM
+    uint32_t checksum = 2166136261u;
 
     /// the size of the iNES head in bytes
     static constexpr int HEADER_SIZE = 16;
@@ -191,9 +196,13 @@ class ROM {
         romFile.read(reinterpret_cast<char*>(&prg_rom[0]), PRG_BANK_SIZE * prg_banks);
         // read CHR-ROM 8KB banks
         static constexpr uint64_t CHR_BANK_SIZE = 0x2000;
-        if (!chr_banks) return;
-        chr_rom.resize(CHR_BANK_SIZE * chr_banks);
-        romFile.read(reinterpret_cast<char*>(&chr_rom[0]), CHR_BANK_SIZE * chr_banks);
+        if (chr_banks) {
+            chr_rom.resize(CHR_BANK_SIZE * chr_banks);
+            romFile.read(reinterpret_cast<char*>(&chr_rom[0]), CHR_BANK_SIZE * chr_banks);
+        }
+        // hash the ROM to identify the game regardless of its file
+        for (const auto& memory : {&prg_rom, &chr_rom})
+            for (NES_Byte value : *memory) checksum = (checksum ^ value) * 16777619u;
     }
 
     /// @brief Return the path to the ROM on disk.
@@ -202,6 +211,10 @@ class ROM {
     ///
     inline std::string get_rom_path() const { return rom_path; }
 
+    /// @brief Return the FNV-1a hash of the PRG and CHR ROM, which
+    /// identifies the game regardless of the file it was loaded from.
+    inline uint32_t get_checksum() const { return checksum; }
+
     /// @brief Return the ROM data.
     ///
     /// @return the ROM data of the ROM
@@ -265,6 +278,7 @@ class ROM {
         return flags6.flags.has_persistent_memory;
     }
 
+#ifndef NES_NO_JSON
     /// @brief Convert the object's state to a JSON object.
     ///
     /// @returns a JSON representation of this instance's data
@@ -272,6 +286,7 @@ class ROM {
     json_t* dataToJson() const {
         json_t* rootJ = json_object();
         json_object_set_new(rootJ, "rom_path", json_string(rom_path.c_str()));
+        json_object_set_new(rootJ, "checksum", json_integer(checksum));
         // // encode prg_rom
         // {
         //     auto data_string = base64_encode(&prg_rom[0], prg_rom.size());
@@ -351,15 +366,49 @@ class ROM {
         //     if (json_data) flags11.byte = json_integer_value(json_data);
         // }
     }
+#endif  // NES_NO_JSON
 
     /// An iNES mapper for different NES cartridges.
     class Mapper {
      protected:
         /// The ROM file this mapper interacts with
         ROM& rom;
+        /// the 8KB banks of PRG ROM mapped at $8000, $A000, $C000, and $E000
+        const NES_Byte* prg_banks[4] = {};
+        /// the 1KB banks of CHR memory mapped from $0000 to $1FFF
+        const NES_Byte* chr_banks[8] = {};
+        /// whether the mapper asserts the IRQ line of the CPU
+        bool is_irq = false;
+
+        /// Create a mapper as a copy of another mapper. The banks point into
+        /// the other mapper and must be mapped again by the copy.
+        Mapper(const Mapper& other) : rom(other.rom), is_irq(other.is_irq) { }
+
+        /// @brief Map PRG ROM into consecutive 8KB banks.
+        ///
+        /// @param bank the first 8KB bank to map ($8000 is bank 0)
+        /// @param count the number of 8KB banks to map
+        /// @param offset the offset of the first bank in PRG ROM (wraps
+        /// around the size of the ROM like the unused address lines would)
+        ///
+        inline void map_prg(int bank, int count, std::size_t offset) {
+            const auto& prg = rom.getROM();
+            for (int i = 0; i < count; i++)
+                prg_banks[bank + i] = &prg[(offset + 0x2000 * i) % prg.size()];
+        }
 
-        /// Create a mapper as a copy of another mapper (disabled).
-        Mapper(const Mapper& other) : rom(other.rom) { }
+        /// @brief Map CHR memory into consecutive 1KB banks.
+        ///
+        /// @param bank the first 1KB bank to map ($0000 is bank 0)
+        /// @param count the number of 1KB banks to map
+        /// @param memory the CHR ROM or CHR RAM to map
+        /// @param offset the offset of the first bank in the memory (wraps
+        /// around the size of the memory)
+        ///
+        inline void map_chr(int bank, int count, const std::vector<NES_Byte>& memory, std::size_t offset) {
+            for (int i = 0; i < count; i++)
+                chr_banks[bank + i] = &memory[(offset + 0x400 * i) % memory.size()];
+        }
 
      public:
         /// @brief Create a new mapper with a rom and given type.
@@ -374,12 +423,19 @@ class ROM {
         /// @brief Clone the mapper, i.e., the virtual copy constructor
         virtual Mapper* clone() = 0;
 
+        /// @brief Copy the state of another mapper of the same type and rom
+        /// into this one without allocating.
+        ///
+        /// @param other the mapper to copy the state of
+        ///
+        virtual void copy_from(const Mapper& other) = 0;
+
         /// @brief Return a boolean determining whether this cartridge uses
         /// extended RAM.
         ///
         /// @returns true if the ROM requires extended RAM, false otherwise
         ///
-        inline bool hasExtendedRAM() const { return rom.hasExtendedRAM(); }
+        inline virtual bool hasExtendedRAM() const { return rom.hasExtendedRAM(); }
 
         /// @brief Return the name table mirroring mode.
         ///
@@ -389,12 +445,27 @@ class ROM {
             return rom.getNameTableMirroring();
         }
 
+        /// @brief Return true if the mapper counts the scanlines of the PPU.
+        inline virtual bool has_scanline_counter() const { return false; }
+
+        /// @brief Count a scanline, i.e., a rising edge of A12 on the
+        /// address bus of the PPU.
+        virtual void clock_scanline() { }
+
+        /// @brief Return the level of the IRQ line from the mapper.
+        inline bool is_irq_asserted() const { return is_irq; }
+
         /// Read a byte from the PRG RAM.
         ///
         /// @param address the 16-bit address of the byte to read
         /// @returns the byte located at the given address in PRG RAM
+        /// @details
+        /// Reads go through the banks that the mapper maps when its registers
+        /// change, so they do not call into the mapper.
         ///
-        virtual NES_Byte readPRG(NES_Address address) = 0;
+        inline NES_Byte readPRG(NES_Address address) const {
+            return prg_banks[(address >> 13) & 0x3][address & 0x1fff];
+        }
 
         /// Write a byte to an address in the PRG RAM.
         ///
@@ -408,7 +479,9 @@ class ROM {
         /// @param address the 16-bit address of the byte to read
         /// @returns the byte located at the given address in CHR RAM
         ///
-        virtual NES_Byte readCHR(NES_Address address) = 0;
+        inline NES_Byte readCHR(NES_Address address) const {
+            return chr_banks[(address >> 10) & 0x7][address & 0x3ff];
+        }
 
         /// Write a byte to an address in the CHR RAM.
         ///
@@ -417,6 +490,22 @@ class ROM {
         ///
         virtual void writeCHR(NES_Address address, NES_Byte value) = 0;
 
+        /// @brief Write the state of the mapper in the binary state format.
+        ///
+        /// @param writer the writer to write the state with
+        ///
+        virtual void save_state(StateWriter& writer) const = 0;
+
+        /// @brief Read the state of the mapper from the binary state format.
+        ///
+        /// @param reader the reader to read the state with
+        /// @details
+        /// The mapper may be left in a partial state if the reader fails,
+        /// so states are read into the mapper of a snapshot.
+        ///
+        virtual void load_state(StateReader& reader) = 0;
+
+#ifndef NES_NO_JSON
         /// @brief Convert the object's state to a JSON object.
         ///
         /// @returns a JSON representation of this instance's data
@@ -428,6 +517,7 @@ class ROM {
         /// @param rootJ the serialized JSON data to load into this object
         ///
         virtual void dataFromJson(json_t* rootJ) = 0;
+#endif  // NES_NO_JSON
     };
 };
 
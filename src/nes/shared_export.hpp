@@ -0,0 +1,302 @@
+//  Program:      nes-py
+//  File:         shared_export.hpp
+//  Description:  This class exports the frames, RAM, and audio of the
+//                emulator through shared memory
+//
+//  Copyright (c) 2020 Christian Kauten. All rights reserved.
+//
+
+#ifndef NES_SHARED_EXPORT_HPP
+#define NES_SHARED_EXPORT_HPP
+
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+#if defined(_WIN32)
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+#include "common.hpp"
+#include "ppu.hpp"
+#include "apu.hpp"
+
+namespace NES {
+
+/// An export of the frames, work RAM, and audio of the emulator to other
+/// processes through a block of shared memory.
+///
+/// @details
+/// The block starts with a Header and holds the palette indexes of the last
+/// frame, the 2KB of work RAM at the end of that frame, and a ring of the
+/// samples of every channel. Readers map the block by name (a POSIX shared
+/// memory object, or a named file mapping on Windows) and read it in place:
+///
+/// -   the frame and the RAM are guarded by a seqlock: read `sequence`, and
+///     if it is odd try again; copy the frame and RAM; read `sequence`
+///     again, and if it changed, the copy is torn, so try again.
+/// -   the ring holds `audio_capacity` samples with the NUM_CHANNELS
+///     channels of each sample interleaved. `audio_head` counts the samples
+///     written; sample `n` is at `n % audio_capacity` until `audio_head`
+///     passes `n + audio_capacity`, after which it is overwritten.
+///
+/// The writer (the thread that runs the emulator) never allocates, locks,
+/// or waits; opening and closing the block (which do) are on another thread.
+/// When the export is closed, writing is a single atomic load.
+///
+class SharedExport {
+ public:
+    /// the version of the layout of the block
+    static constexpr uint32_t VERSION = 1;
+    /// the width of the frames in pixels
+    static constexpr int WIDTH = SCANLINE_VISIBLE_DOTS;
+    /// the height of the frames in pixels
+    static constexpr int HEIGHT = VISIBLE_SCANLINES;
+    /// the number of bytes in a frame of palette indexes
+    static constexpr std::size_t FRAME_BYTES = WIDTH * HEIGHT;
+    /// the number of bytes of work RAM
+    static constexpr std::size_t RAM_BYTES = 0x800;
+    /// the number of channels of audio
+    static constexpr std::size_t NUM_CHANNELS = APU::NUM_CHANNELS;
+    /// the number of samples of every channel in the ring (a power of 2)
+    static constexpr std::size_t AUDIO_CAPACITY = 1 << 15;
+
+    static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "the seqlock must be lock-free across processes");
+
+    /// The header at the start of the block.
+    struct Header {
+        /// the magic bytes "RACKNES\0"
+        char magic[8];
+        /// the version of the layout
+        uint32_t version;
+        /// the number of bytes in the header
+        uint32_t header_size;
+        /// the width and height of the frame
+        uint32_t width;
+        uint32_t height;
+        /// the number of bytes of RAM
+        uint32_t ram_size;
+        /// the number of channels of audio
+        uint32_t num_channels;
+        /// the number of samples in the ring of audio
+        uint32_t audio_capacity;
+        /// the sample rate of the audio
+        uint32_t sample_rate;
+        /// the offsets of the frame, the RAM, and the ring of audio from the
+        /// start of the block
+        uint64_t frame_offset;
+        uint64_t ram_offset;
+        uint64_t audio_offset;
+        /// the seqlock of the frame and the RAM (odd while they are written)
+        std::atomic<uint64_t> sequence;
+        /// the number of frames written
+        uint64_t frame;
+        /// the number of samples written to the ring
+        std::atomic<uint64_t> audio_head;
+    };
+
+    /// the offset of the frame in the block
+    static constexpr std::size_t FRAME_OFFSET = 256;
+    /// the offset of the RAM in the block
+    static constexpr std::size_t RAM_OFFSET = FRAME_OFFSET + FRAME_BYTES;
+    /// the offset of the ring of audio in the block
+    static constexpr std::size_t AUDIO_OFFSET = RAM_OFFSET + RAM_BYTES;
+    /// the number of bytes in the block
+    static constexpr std::size_t SIZE = AUDIO_OFFSET + AUDIO_CAPACITY * NUM_CHANNELS * sizeof(int16_t);
+
+    static_assert(sizeof(Header) <= FRAME_OFFSET, "the header fits before the frame");
+
+ private:
+    /// the mapped block (nullptr if closed)
+    NES_Byte* memory = nullptr;
+    /// the header of the block
+    Header* header = nullptr;
+    /// the name of the block
+    std::string name;
+#if defined(_WIN32)
+    /// the handle of the file mapping
+    HANDLE mapping = nullptr;
+#endif
+    /// whether the writer may write to the block
+    std::atomic<bool> is_sharing{false};
+    /// whether the writer is writing to the block
+    std::atomic<bool> is_writing{false};
+
+    /// @brief Create and map the block.
+    bool map() {
+#if defined(_WIN32)
+        mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, SIZE, name.c_str());
+        if (mapping == nullptr) return false;
+        memory = static_cast<NES_Byte*>(MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, SIZE));
+        return memory != nullptr;
+#else
+        const int file = shm_open(name.c_str(), O_RDWR | O_CREAT, 0600);
+        if (file < 0) return false;
+        void* address = MAP_FAILED;
+        if (ftruncate(file, SIZE) == 0)
+            address = mmap(nullptr, SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+        // the mapping keeps the object alive without the descriptor
+        ::close(file);
+        if (address == MAP_FAILED) return false;
+        memory = static_cast<NES_Byte*>(address);
+        return true;
+#endif
+    }
+
+    /// @brief Unmap the block and remove its name.
+    void unmap() {
+#if defined(_WIN32)
+        if (memory != nullptr) UnmapViewOfFile(memory);
+        if (mapping != nullptr) CloseHandle(mapping);
+        mapping = nullptr;
+#else
+        if (memory != nullptr) munmap(memory, SIZE);
+        if (!name.empty()) shm_unlink(name.c_str());
+#endif
+        memory = nullptr;
+        header = nullptr;
+    }
+
+    /// @brief Claim the block for a write.
+    ///
+    /// @returns true if the block is open, false otherwise
+    /// @details
+    /// The stores and loads of the flags are sequentially consistent, so
+    /// either close sees the write and waits for it, or the write sees that
+    /// the block is closing and does not touch it.
+    ///
+    inline bool begin_write() {
+        if (!is_sharing.load(std::memory_order_relaxed)) return false;
+        is_writing.store(true);
+        if (is_sharing.load()) return true;
+        is_writing.store(false, std::memory_order_release);
+        return false;
+    }
+
+    /// @brief Release the block after a write.
+    inline void end_write() { is_writing.store(false, std::memory_order_release); }
+
+ public:
+    /// @brief Return the default name of the block of an instance.
+    ///
+    /// @param id a number that identifies the instance (i.e., a module ID)
+    ///
+    static std::string get_default_name(int64_t id) {
+#if defined(_WIN32)
+        return "Local\\RackNES-" + std::to_string(id);
+#else
+        return "/RackNES-" + std::to_string(id);
+#endif
+    }
+
+    /// @brief Initialize a new closed export.
+    SharedExport() { }
+
+    /// @brief Close the block.
+    ~SharedExport() { close(); }
+
+    SharedExport(const SharedExport&) = delete;
+    SharedExport& operator=(const SharedExport&) = delete;
+
+    /// @brief Return true if the block is open.
+    inline bool is_active() const {
+        return is_sharing.load(std::memory_order_relaxed);
+    }
+
+    /// @brief Return the name of the open block.
+    inline const std::string& get_name() const { return name; }
+
+    /// @brief Create the block and start sharing.
+    ///
+    /// @param name_ the name of the block
+    /// @param sample_rate the sample rate of the audio
+    /// @returns true if the block is shared, false if it could not be
+    /// created
+    ///
+    bool open(const std::string& name_, uint32_t sample_rate) {
+        close();
+        name = name_;
+        if (!map()) {
+            NES_DEBUG("failed to map shared memory " << name);
+            unmap();
+            name.clear();
+            return false;
+        }
+        std::memset(memory, 0, SIZE);
+        header = new (memory) Header();
+        // the magic bytes at the start of the block
+        const char magic[8] = {'R', 'A', 'C', 'K', 'N', 'E', 'S', '\0'};
+        std::memcpy(header->magic, magic, sizeof magic);
+        header->version = VERSION;
+        header->header_size = sizeof(Header);
+        header->width = WIDTH;
+        header->height = HEIGHT;
+        header->ram_size = RAM_BYTES;
+        header->num_channels = NUM_CHANNELS;
+        header->audio_capacity = AUDIO_CAPACITY;
+        header->sample_rate = sample_rate;
+        header->frame_offset = FRAME_OFFSET;
+        header->ram_offset = RAM_OFFSET;
+        header->audio_offset = AUDIO_OFFSET;
+        is_sharing = true;
+        return true;
+    }
+
+    /// @brief Stop sharing and remove the block.
+    void close() {
+        is_sharing.store(false);
+        // a write is at most a frame of memory, so the wait is short
+        while (is_writing.load()) std::this_thread::yield();
+        unmap();
+        name.clear();
+    }
+
+    /// @brief Set the sample rate of the audio in the header.
+    inline void set_sample_rate(uint32_t sample_rate) {
+        if (!begin_write()) return;
+        header->sample_rate = sample_rate;
+        end_write();
+    }
+
+    /// @brief Write a frame and the RAM at the end of it.
+    ///
+    /// @param pixels the palette indexes of the frame (i.e., PPU::get_pixels)
+    /// @param ram the 2KB of work RAM
+    ///
+    inline void write_frame(const NES_Byte* pixels, const NES_Byte* ram) {
+        if (!begin_write()) return;
+        const uint64_t sequence = header->sequence.load(std::memory_order_relaxed);
+        header->sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(memory + FRAME_OFFSET, pixels, FRAME_BYTES);
+        std::memcpy(memory + RAM_OFFSET, ram, RAM_BYTES);
+        header->frame++;
+        header->sequence.store(sequence + 2, std::memory_order_release);
+        end_write();
+    }
+
+    /// @brief Write a sample of every channel to the ring.
+    ///
+    /// @param sample the samples of the NUM_CHANNELS channels
+    ///
+    inline void write_sample(const int16_t* sample) {
+        if (!begin_write()) return;
+        const uint64_t head = header->audio_head.load(std::memory_order_relaxed);
+        auto ring = reinterpret_cast<int16_t*>(memory + AUDIO_OFFSET);
+        std::memcpy(ring + (head & (AUDIO_CAPACITY - 1)) * NUM_CHANNELS, sample, sizeof(int16_t) * NUM_CHANNELS);
+        header->audio_head.store(head + 1, std::memory_order_release);
+        end_write();
+    }
+};
+
+}  // namespace NES
+
+#endif  // NES_SHARED_EXPORT_HPP
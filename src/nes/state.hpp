@@ -0,0 +1,211 @@
+//  Program:      nes-py
+//  File:         state.hpp
+//  Description:  Classes for writing and reading binary save states
+//
+//  Copyright (c) 2020 Christian Kauten. All rights reserved.
+//
+
+#ifndef NES_STATE_HPP
+#define NES_STATE_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+#include "common.hpp"
+
+namespace NES {
+
+/// A writer of the binary save state format.
+///
+/// @details
+/// Plain values are written as their bytes in memory, so a state is only
+/// read by a build of the emulator with the same layout (see
+/// Emulator::save_state for the header that checks it). Blocks of memory are
+/// written with PackBits run-length encoding, which shrinks the mostly
+/// empty RAM and the flat colors of the screen to a fraction of their size.
+/// The writer appends to a buffer that it does not own, so writing into a
+/// buffer with enough capacity does not allocate.
+///
+class StateWriter {
+ private:
+    /// the buffer to append to
+    std::vector<NES_Byte>& buffer;
+
+    /// @brief Append bytes to the buffer.
+    inline void append(const void* data, std::size_t size) {
+        const auto* bytes = static_cast<const NES_Byte*>(data);
+        buffer.insert(buffer.end(), bytes, bytes + size);
+    }
+
+ public:
+    /// @brief Initialize a new writer.
+    ///
+    /// @param buffer_ the buffer to write to, it is cleared first
+    ///
+    explicit StateWriter(std::vector<NES_Byte>& buffer_) : buffer(buffer_) {
+        buffer.clear();
+    }
+
+    /// @brief Write a plain value.
+    ///
+    /// @param value the value to write the bytes of
+    ///
+    template<typename T>
+    inline void write(const T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "values are written as bytes");
+        append(&value, sizeof(T));
+    }
+
+    /// @brief Write a block of memory with run-length encoding.
+    ///
+    /// @param data the memory to write
+    /// @param size the number of bytes of memory
+    /// @details
+    /// The block is its size followed by PackBits packets: a header n in
+    /// [0, 127] followed by n + 1 literal bytes, or a header n in [129, 255]
+    /// followed by one byte to repeat 257 - n times.
+    ///
+    void write_block(const NES_Byte* data, std::size_t size) {
+        write(static_cast<uint32_t>(size));
+        std::size_t index = 0;
+        while (index < size) {
+            // measure the run of the byte at the index
+            std::size_t run = 1;
+            while (index + run < size && run < 128 && data[index + run] == data[index]) ++run;
+            if (run >= 3) {
+                buffer.push_back(static_cast<NES_Byte>(257 - run));
+                buffer.push_back(data[index]);
+                index += run;
+                continue;
+            }
+            // take literals until the next run of 3 or more
+            std::size_t literal = 0;
+            while (index + literal < size && literal < 128) {
+                const std::size_t next = index + literal;
+                if (next + 2 < size && data[next] == data[next + 1] && data[next] == data[next + 2]) break;
+                ++literal;
+            }
+            buffer.push_back(static_cast<NES_Byte>(literal - 1));
+            append(data + index, literal);
+            index += literal;
+        }
+    }
+
+    /// @brief Write a vector of memory with run-length encoding.
+    inline void write_block(const std::vector<NES_Byte>& data) {
+        write_block(data.data(), data.size());
+    }
+};
+
+/// A reader of the binary save state format.
+///
+/// @details
+/// A read past the end of the data or of a block with the wrong size fails
+/// the reader instead of reading out of bounds. The values read after a
+/// failure are left as they were, so the caller checks is_ok at the end and
+/// throws away whatever it read into.
+///
+class StateReader {
+ private:
+    /// the data to read from
+    const NES_Byte* data;
+    /// the number of bytes of data
+    std::size_t size;
+    /// the offset of the next byte to read
+    std::size_t offset = 0;
+    /// whether every read so far succeeded
+    bool ok = true;
+
+    /// @brief Return true if there are the given number of bytes left.
+    inline bool has(std::size_t count) {
+        if (ok && size - offset >= count) return true;
+        ok = false;
+        return false;
+    }
+
+ public:
+    /// @brief Initialize a new reader.
+    ///
+    /// @param data_ the data to read from
+    /// @param size_ the number of bytes of data
+    ///
+    StateReader(const NES_Byte* data_, std::size_t size_) : data(data_), size(size_) { }
+
+    /// @brief Return true if every read so far succeeded.
+    inline bool is_ok() const { return ok; }
+
+    /// @brief Return true if every byte of the data has been read.
+    inline bool is_done() const { return ok && offset == size; }
+
+    /// @brief Read a plain value.
+    ///
+    /// @param value the value to read the bytes of
+    ///
+    template<typename T>
+    inline void read(T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "values are read as bytes");
+        if (!has(sizeof(T))) return;
+        std::memcpy(&value, data + offset, sizeof(T));
+        offset += sizeof(T);
+    }
+
+    /// @brief Read a block of memory that was written with write_block.
+    ///
+    /// @param block the memory to read into
+    /// @param expected the number of bytes of memory, the read fails if the
+    /// block is a different size
+    ///
+    void read_block(NES_Byte* block, std::size_t expected) {
+        uint32_t length = 0;
+        read(length);
+        if (!ok || length != expected) {
+            ok = false;
+            return;
+        }
+        std::size_t index = 0;
+        while (index < length) {
+            if (!has(1)) return;
+            const NES_Byte header = data[offset++];
+            if (header < 128) {  // literal bytes
+                const std::size_t count = header + 1;
+                if (index + count > length || !has(count)) {
+                    ok = false;
+                    return;
+                }
+                std::memcpy(block + index, data + offset, count);
+                offset += count;
+                index += count;
+            } else if (header > 128) {  // a repeated byte
+                const std::size_t count = 257 - header;
+                if (index + count > length || !has(1)) {
+                    ok = false;
+                    return;
+                }
+                std::memset(block + index, data[offset++], count);
+                index += count;
+            }
+        }
+    }
+
+    /// @brief Read a block of memory into a vector.
+    ///
+    /// @param block the vector to read into, it is resized to the block
+    /// @param limit the largest size of block to accept
+    ///
+    void read_block(std::vector<NES_Byte>& block, std::size_t limit) {
+        uint32_t length = 0;
+        if (!has(sizeof length)) return;
+        std::memcpy(&length, data + offset, sizeof length);
+        if (length > limit) {
+            ok = false;
+            return;
+        }
+        block.resize(length);
+        read_block(block.data(), length);
+    }
+};
+
+}  // namespace NES
+
+#endif  // NES_STATE_HPP
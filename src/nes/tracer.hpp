@@ -0,0 +1,223 @@
+//  Program:      nes-py
+//  File:         tracer.hpp
+//  Description:  This class records a timeline of the emulator for Chrome
+//                tracing / Perfetto
+//
+//  Copyright (c) 2020 Christian Kauten. All rights reserved.
+//
+
+#ifndef NES_TRACER_HPP
+#define NES_TRACER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "common.hpp"
+
+namespace NES {
+
+/// A recorder of a timeline of events in the Chrome trace event format.
+///
+/// @details
+/// Events are pushed by a single producer (the thread that runs the
+/// emulator) into a fixed-size lock-free ring. A background thread drains
+/// the ring into a JSON file that chrome://tracing and ui.perfetto.dev can
+/// open. Pushing never allocates, locks, or touches the disk; if the writer
+/// falls behind, events are dropped and counted. When the tracer is not
+/// recording, pushing is a single relaxed atomic load.
+///
+class Tracer {
+ public:
+    /// The tracks that events are drawn on in the timeline
+    enum Track : uint32_t {
+        /// blocks of samples processed by the host
+        HOST_TRACK = 1,
+        /// emulated frames
+        FRAME_TRACK,
+        /// work inside of the emulator (i.e., NTSC filter, loads and saves)
+        EMULATOR_TRACK,
+    };
+
+    /// the number of events the ring can hold (a power of 2)
+    static constexpr std::size_t CAPACITY = 1 << 14;
+
+    /// @brief Return the current time in nanoseconds for an event.
+    static inline uint64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+ private:
+    /// A span of time on a track of the timeline.
+    struct Event {
+        /// the name of the event (a string with static storage duration)
+        const char* name;
+        /// the track to draw the event on
+        Track track;
+        /// the start time of the event in nanoseconds
+        uint64_t start;
+        /// the duration of the event in nanoseconds
+        uint64_t duration;
+    };
+
+    /// the ring of events
+    Event events[CAPACITY];
+    /// the index of the next event to write (owned by the producer)
+    std::atomic<std::size_t> head{0};
+    /// the index of the next event to read (owned by the writer thread)
+    std::atomic<std::size_t> tail{0};
+    /// the number of events dropped because the ring was full
+    std::atomic<uint64_t> dropped{0};
+    /// whether events are being recorded
+    std::atomic<bool> is_recording{false};
+
+    /// the background thread that writes events to disk
+    std::thread writer;
+    /// a lock for waking the writer thread
+    std::mutex mutex;
+    /// a condition for waking the writer thread
+    std::condition_variable condition;
+    /// whether the writer thread should stop
+    bool is_stopping = false;
+    /// the file that the trace is written to
+    std::FILE* file = nullptr;
+    /// whether an event has been written to the file yet
+    bool is_first = true;
+    /// the time that the recording started at
+    uint64_t origin = 0;
+
+    /// @brief Write the events in the ring to the file.
+    void drain() {
+        std::size_t index = tail.load(std::memory_order_relaxed);
+        const std::size_t end = head.load(std::memory_order_acquire);
+        for (; index != end; index++) {
+            const Event& event = events[index & (CAPACITY - 1)];
+            // events from before the recording started are skipped
+            if (event.start < origin) continue;
+            std::fprintf(file, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                is_first ? "" : ",", event.name, static_cast<unsigned>(event.track),
+                (event.start - origin) * 1e-3, event.duration * 1e-3);
+            is_first = false;
+        }
+        tail.store(index, std::memory_order_release);
+    }
+
+    /// @brief Write the name of a track to the file.
+    ///
+    /// @param track the track to name
+    /// @param name the name of the track
+    ///
+    void name_track(Track track, const char* name) {
+        std::fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+            is_first ? "" : ",", static_cast<unsigned>(track), name);
+        is_first = false;
+    }
+
+    /// @brief Drain the ring periodically until the tracer stops.
+    void run() {
+        // the period that the ring is drained at
+        const std::chrono::milliseconds period(100);
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!is_stopping) {
+            condition.wait_for(lock, period);
+            drain();
+        }
+        // the events from before the tracer stopped
+        drain();
+    }
+
+ public:
+    /// @brief Initialize a new tracer.
+    Tracer() { }
+
+    /// @brief Stop recording and close the trace file.
+    ~Tracer() { stop(); }
+
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+    /// @brief Return true if the tracer is recording events.
+    inline bool is_active() const {
+        return is_recording.load(std::memory_order_relaxed);
+    }
+
+    /// @brief Return the number of events dropped in the recording.
+    inline uint64_t get_dropped() const { return dropped.load(); }
+
+    /// @brief Record a span of time on a track of the timeline.
+    ///
+    /// @param name the name of the event (must have static storage duration)
+    /// @param track the track to draw the event on
+    /// @param start the start time of the event from now()
+    /// @param end the end time of the event from now()
+    ///
+    inline void record(const char* name, Track track, uint64_t start, uint64_t end) {
+        if (!is_active()) return;
+        const std::size_t index = head.load(std::memory_order_relaxed);
+        if (index - tail.load(std::memory_order_acquire) >= CAPACITY) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        events[index & (CAPACITY - 1)] = {name, track, start, end - start};
+        head.store(index + 1, std::memory_order_release);
+    }
+
+    /// @brief Record a span of time that ends now.
+    ///
+    /// @param name the name of the event (must have static storage duration)
+    /// @param track the track to draw the event on
+    /// @param start the start time of the event from now()
+    ///
+    inline void record(const char* name, Track track, uint64_t start) {
+        record(name, track, start, now());
+    }
+
+    /// @brief Start recording to a trace file.
+    ///
+    /// @param path the path of the JSON file to write the trace to
+    /// @returns true if the recording started, false if the file could not
+    /// be opened
+    ///
+    bool start(const std::string& path) {
+        stop();
+        file = std::fopen(path.c_str(), "w");
+        if (file == nullptr) return false;
+        std::fputs("[", file);
+        is_first = true;
+        name_track(HOST_TRACK, "host process()");
+        name_track(FRAME_TRACK, "frames");
+        name_track(EMULATOR_TRACK, "emulator");
+        origin = now();
+        dropped = 0;
+        is_stopping = false;
+        writer = std::thread(&Tracer::run, this);
+        is_recording = true;
+        return true;
+    }
+
+    /// @brief Stop recording and finish the trace file.
+    void stop() {
+        is_recording = false;
+        if (writer.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                is_stopping = true;
+            }
+            condition.notify_one();
+            writer.join();
+        }
+        if (file != nullptr) {
+            std::fputs("\n]\n", file);
+            std::fclose(file);
+            file = nullptr;
+        }
+    }
+};
+
+}  // namespace NES
+
+#endif  // NES_TRACER_HPP
@@ -0,0 +1,144 @@
+// A bank of preloaded games that the engine switches between.
+// Copyright 2020 Christian Kauten
+//
+// Author: Christian Kauten (kautenja@auburn.edu)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef RACKNES_ROM_BANK_HPP_
+#define RACKNES_ROM_BANK_HPP_
+
+#include <mutex>
+#include "nes/emulator.hpp"
+
+/// A bank of emulators with preloaded games.
+///
+/// @details
+/// Every slot of the bank holds a whole emulator, so a game that is not
+/// running keeps its state as it was and switching games is a change of
+/// pointer without any I/O or setup (the ROM, the battery, and the NTSC
+/// filter of each emulator are set up when it is loaded).
+///
+/// Emulators are created and loaded on the UI thread and handed to the
+/// engine, which installs them the next time it updates the bank. The
+/// engine only ever tries the lock of the bank, and the emulators that it
+/// replaces are handed back and deleted on the UI thread, so the engine
+/// never allocates, frees, or waits.
+///
+struct ROMBank {
+    /// the number of slots in the bank
+    static constexpr int NUM_SLOTS = 8;
+
+ private:
+    /// the emulators in the slots (owned by the engine, nullptr if empty)
+    NES::Emulator* slots[NUM_SLOTS] = {};
+    /// the emulators waiting to be installed in the slots
+    NES::Emulator* incoming[NUM_SLOTS] = {};
+    /// whether the slots have an emulator (or nothing) waiting
+    bool is_incoming[NUM_SLOTS] = {};
+    /// the emulators that the engine replaced, to delete on the UI thread
+    NES::Emulator* retired[NUM_SLOTS] = {};
+    /// a lock for the handoff between the UI thread and the engine
+    std::mutex mutex;
+
+    /// @brief Delete the retired emulators (with the lock held).
+    void collect() {
+        for (auto& emulator : retired) {
+            delete emulator;
+            emulator = nullptr;
+        }
+    }
+
+ public:
+    /// @brief Initialize a new empty bank.
+    ROMBank() { }
+
+    /// @brief Delete the emulators in the bank.
+    ~ROMBank() {
+        collect();
+        for (int i = 0; i < NUM_SLOTS; i++) {
+            delete slots[i];
+            delete incoming[i];
+        }
+    }
+
+    ROMBank(const ROMBank&) = delete;
+    ROMBank& operator=(const ROMBank&) = delete;
+
+    /// @brief Put an emulator in a slot while the engine is not running
+    /// (i.e., when the module is created).
+    ///
+    /// @param slot the index of the slot
+    /// @param emulator the emulator to own in the slot
+    ///
+    void install(int slot, NES::Emulator* emulator) {
+        delete slots[slot];
+        slots[slot] = emulator;
+    }
+
+    /// @brief Hand an emulator to the engine from the UI thread.
+    ///
+    /// @param slot the index of the slot to put the emulator in
+    /// @param emulator the emulator to own in the slot, or nullptr to empty
+    /// the slot
+    ///
+    void load(int slot, NES::Emulator* emulator) {
+        std::lock_guard<std::mutex> lock(mutex);
+        collect();
+        // replace an emulator that the engine has not picked up yet
+        delete incoming[slot];
+        incoming[slot] = emulator;
+        is_incoming[slot] = true;
+    }
+
+    /// @brief Delete the emulators that the engine replaced from the UI
+    /// thread.
+    void collect_retired() {
+        std::lock_guard<std::mutex> lock(mutex);
+        collect();
+    }
+
+    /// @brief Install the emulators from the UI thread on the engine.
+    ///
+    /// @param active the slot that is running, which is never emptied
+    /// @returns a mask of the slots that changed
+    ///
+    unsigned update(int active) {
+        std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+        if (!lock.owns_lock()) return 0;
+        unsigned changed = 0;
+        for (int i = 0; i < NUM_SLOTS; i++) {
+            if (i == active && is_incoming[i] && incoming[i] == nullptr)
+                is_incoming[i] = false;
+            // wait for the UI thread to delete the last emulator replaced
+            if (!is_incoming[i] || retired[i] != nullptr) continue;
+            retired[i] = slots[i];
+            slots[i] = incoming[i];
+            incoming[i] = nullptr;
+            is_incoming[i] = false;
+            changed |= 1u << i;
+        }
+        return changed;
+    }
+
+    /// @brief Return the emulator in a slot (nullptr if it is empty).
+    ///
+    /// @param slot the index of the slot
+    /// @details
+    /// The emulators belong to the engine, the UI thread may only read
+    /// them the way it reads the running emulator.
+    ///
+    inline NES::Emulator* get(int slot) const { return slots[slot]; }
+};
+
+#endif  // RACKNES_ROM_BANK_HPP_
@@ -0,0 +1,361 @@
+// A library of named save states on disk for a game.
+// Copyright 2020 Christian Kauten
+//
+// Author: Christian Kauten (kautenja@auburn.edu)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef RACKNES_STATE_LIBRARY_HPP_
+#define RACKNES_STATE_LIBRARY_HPP_
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <jansson.h>
+#include "rack.hpp"
+#include "nes/emulator.hpp"
+
+/// A library of numbered slots of binary save states for a game.
+///
+/// @details
+/// Every slot keeps its state in memory, so the engine thread saves and
+/// loads states without touching the disk. A background thread reads the
+/// states of the game from its directory when the library opens (the small
+/// index of the names first), and writes the slots that the engine saves
+/// to. The engine thread only ever tries the lock of the library; when the
+/// background thread holds it (only while it swaps buffers, never during
+/// I/O) the engine tries again on its next call instead of waiting.
+///
+/// The directory holds an index.json with the names of the slots and a
+/// slot-NN.state for every slot with a state.
+///
+struct StateLibrary {
+    /// the number of slots in the library
+    static constexpr int NUM_SLOTS = 32;
+    /// the capacity to reserve in the buffers of states so that the engine
+    /// does not allocate when it saves
+    static constexpr std::size_t STATE_CAPACITY = 0x10000;
+
+    /// The result of trying to read a slot from the engine thread.
+    enum Status {
+        /// the background thread has the lock, try again later
+        BUSY,
+        /// the slot has no state
+        EMPTY,
+        /// the state was read
+        READ
+    };
+
+ private:
+    /// A slot of the library.
+    struct Slot {
+        /// the name of the slot (empty for the default name)
+        std::string name;
+        /// the binary state in the slot (empty if there is none)
+        std::vector<uint8_t> data;
+        /// whether the state has changed since it was written to disk
+        bool is_dirty = false;
+    };
+
+    /// the slots of the library
+    Slot slots[NUM_SLOTS];
+    /// the directory that the slots are written to (empty for none)
+    std::string directory;
+    /// the directory that the library is opening
+    std::string next_directory;
+    /// the checksum of the ROM of the game that the library is opening
+    uint32_t next_checksum = 0;
+    /// the number of times the library has been opened
+    uint64_t generation = 0;
+    /// the generation that the slots were read for
+    uint64_t loaded_generation = 0;
+    /// whether the names of the slots changed since the index was written
+    bool is_index_dirty = false;
+
+    /// the states that the background thread reads from disk
+    std::vector<uint8_t> incoming[NUM_SLOTS];
+    /// the buffer that the background thread writes states from
+    std::vector<uint8_t> outgoing;
+
+    /// the background thread for reading and writing states
+    std::thread worker;
+    /// a lock for the slots and the requests to the background thread
+    std::mutex mutex;
+    /// a condition for waking the background thread
+    std::condition_variable condition;
+    /// whether the background thread should stop
+    bool is_stopping = false;
+
+    /// @brief Return the path of the file of a slot in a directory.
+    static std::string get_slot_path(const std::string& directory, int slot) {
+        char name[32];
+        std::snprintf(name, sizeof name, "slot-%02d.state", slot + 1);
+        return rack::system::join(directory, name);
+    }
+
+    /// @brief Return the path of the index in a directory.
+    static std::string get_index_path(const std::string& directory) {
+        return rack::system::join(directory, "index.json");
+    }
+
+    /// @brief Write data to a file by replacing it with a temporary file, so
+    /// a crash never leaves a partial file behind.
+    static void write_file(const std::string& path, const void* data, std::size_t size) {
+        rack::system::createDirectories(rack::system::getDirectory(path));
+        const std::string temporary = path + ".tmp";
+        // Rack opens paths as UTF-8 on every platform
+        std::FILE* file = std::fopen(temporary.c_str(), "wb");
+        if (file == nullptr) return;
+        const bool is_written = std::fwrite(data, 1, size, file) == size;
+        if (std::fclose(file) != 0 || !is_written) return;
+        rack::system::rename(temporary, path);
+    }
+
+    /// @brief Read a whole file into a buffer.
+    ///
+    /// @param path the path of the file to read
+    /// @param data the buffer to read the file into (cleared first)
+    ///
+    static void read_file(const std::string& path, std::vector<uint8_t>& data) {
+        data.clear();
+        std::FILE* file = std::fopen(path.c_str(), "rb");
+        if (file == nullptr) return;
+        uint8_t block[4096];
+        for (std::size_t count; (count = std::fread(block, 1, sizeof block, file)) > 0; )
+            data.insert(data.end(), block, block + count);
+        std::fclose(file);
+    }
+
+    /// @brief Return true if there is work for the background thread.
+    inline bool has_work() const {
+        if (is_stopping || is_index_dirty || loaded_generation != generation) return true;
+        for (const auto& slot : slots)
+            if (slot.is_dirty) return true;
+        return false;
+    }
+
+    /// @brief Write the dirty slots and the index to the directory.
+    ///
+    /// @param lock the held lock of the library, which is released while
+    /// the files are written
+    ///
+    void flush(std::unique_lock<std::mutex>& lock) {
+        for (int i = 0; i < NUM_SLOTS; i++) {
+            if (!slots[i].is_dirty) continue;
+            slots[i].is_dirty = false;
+            if (directory.empty()) continue;
+            outgoing = slots[i].data;
+            const auto path = get_slot_path(directory, i);
+            lock.unlock();
+            if (outgoing.empty()) {
+                rack::system::remove(path);
+            } else {
+                write_file(path, outgoing.data(), outgoing.size());
+            }
+            lock.lock();
+        }
+        if (!is_index_dirty) return;
+        is_index_dirty = false;
+        if (directory.empty()) return;
+        json_t* names = json_array();
+        for (const auto& slot : slots) json_array_append_new(names, json_string(slot.name.c_str()));
+        json_t* rootJ = json_object();
+        json_object_set_new(rootJ, "names", names);
+        const auto path = get_index_path(directory);
+        lock.unlock();
+        char* text = json_dumps(rootJ, JSON_INDENT(2));
+        json_decref(rootJ);
+        if (text != nullptr) {
+            write_file(path, text, std::strlen(text));
+            free(text);
+        }
+        lock.lock();
+    }
+
+    /// @brief Read the index and the states of the directory that the
+    /// library is opening into the slots.
+    ///
+    /// @param lock the held lock of the library, which is released while
+    /// the files are read
+    ///
+    void preload(std::unique_lock<std::mutex>& lock) {
+        const uint64_t opening = generation;
+        const std::string path = next_directory;
+        const uint32_t checksum = next_checksum;
+        lock.unlock();
+        // the index is small, so it is read first and the names show up in
+        // the menu before the states finish loading
+        std::string names[NUM_SLOTS];
+        if (!path.empty()) {
+            json_t* rootJ = json_load_file(get_index_path(path).c_str(), 0, nullptr);
+            json_t* array = rootJ ? json_object_get(rootJ, "names") : nullptr;
+            for (int i = 0; array && i < NUM_SLOTS && i < static_cast<int>(json_array_size(array)); i++) {
+                const char* name = json_string_value(json_array_get(array, i));
+                if (name != nullptr) names[i] = name;
+            }
+            if (rootJ) json_decref(rootJ);
+        }
+        lock.lock();
+        if (opening != generation) return;
+        for (int i = 0; i < NUM_SLOTS; i++) slots[i].name = names[i];
+        lock.unlock();
+        // preload every state, dropping the ones that are damaged or of a
+        // different game
+        for (int i = 0; i < NUM_SLOTS; i++) {
+            auto& data = incoming[i];
+            data.clear();
+            data.reserve(STATE_CAPACITY);
+            if (path.empty()) continue;
+            read_file(get_slot_path(path, i), data);
+            if (!NES::Emulator::is_state(data.data(), data.size(), checksum)) data.clear();
+        }
+        lock.lock();
+        if (opening != generation) return;
+        for (int i = 0; i < NUM_SLOTS; i++) {
+            slots[i].data.swap(incoming[i]);
+            slots[i].is_dirty = false;
+        }
+        directory = path;
+        loaded_generation = opening;
+    }
+
+    /// @brief Serve the requests to the background thread until it stops.
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            condition.wait(lock, [&]() { return has_work(); });
+            // states saved before the library opens a new directory still
+            // belong to the old one
+            flush(lock);
+            if (is_stopping) break;
+            if (loaded_generation != generation) preload(lock);
+        }
+    }
+
+ public:
+    /// @brief Initialize a new library without a directory.
+    StateLibrary() {
+        for (auto& slot : slots) slot.data.reserve(STATE_CAPACITY);
+        worker = std::thread(&StateLibrary::run, this);
+    }
+
+    /// @brief Write the dirty slots and stop the background thread.
+    ~StateLibrary() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            is_stopping = true;
+        }
+        condition.notify_one();
+        worker.join();
+    }
+
+    StateLibrary(const StateLibrary&) = delete;
+    StateLibrary& operator=(const StateLibrary&) = delete;
+
+    /// @brief Open the directory of a game and preload its states.
+    ///
+    /// @param path the directory of the states of the game, or an empty
+    /// string to close the library
+    /// @param checksum the checksum of the ROM of the game
+    /// @details
+    /// This returns immediately. Until the background thread has read the
+    /// directory, saves and loads report that the library is busy.
+    ///
+    void open(const std::string& path, uint32_t checksum) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            next_directory = path;
+            next_checksum = checksum;
+            ++generation;
+        }
+        condition.notify_one();
+    }
+
+    /// @brief Try to put a state into a slot from the engine thread.
+    ///
+    /// @param slot the index of the slot to save to
+    /// @param buffer the binary state, which is swapped with the old state
+    /// of the slot so nothing is copied or allocated
+    /// @returns true if the state was saved, false if the library is busy
+    ///
+    bool save(int slot, std::vector<uint8_t>& buffer) {
+        std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+        if (!lock.owns_lock() || loaded_generation != generation) return false;
+        slots[slot].data.swap(buffer);
+        slots[slot].is_dirty = true;
+        lock.unlock();
+        condition.notify_one();
+        return true;
+    }
+
+    /// @brief Try to read the state of a slot from the engine thread.
+    ///
+    /// @param slot the index of the slot to read
+    /// @param callback a callback that is passed the data and size of the
+    /// state while the library is locked
+    /// @returns the status of the read
+    ///
+    template<typename Callback>
+    Status read(int slot, Callback callback) {
+        std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+        if (!lock.owns_lock() || loaded_generation != generation) return BUSY;
+        const auto& data = slots[slot].data;
+        if (data.empty()) return EMPTY;
+        callback(data.data(), data.size());
+        return READ;
+    }
+
+    /// @brief Remove the state of a slot.
+    void clear(int slot) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            slots[slot].data.clear();
+            slots[slot].is_dirty = true;
+        }
+        condition.notify_one();
+    }
+
+    /// @brief Return true if a slot has a state.
+    bool has_state(int slot) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return !slots[slot].data.empty();
+    }
+
+    /// @brief Return the name of a slot (empty for the default name).
+    std::string get_name(int slot) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return slots[slot].name;
+    }
+
+    /// @brief Set the name of a slot.
+    ///
+    /// @param slot the index of the slot to name
+    /// @param name the new name, or an empty string for the default name
+    ///
+    void set_name(int slot, const std::string& name) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            slots[slot].name = name;
+            is_index_dirty = true;
+        }
+        condition.notify_one();
+    }
+};
+
+#endif  // RACKNES_STATE_LIBRARY_HPP_
@@ -19,17 +19,39 @@
 #define RACKNES_WIDGETS_DISPLAY_HPP_
 
 #include "rack.hpp"
+#include "display_buffer.hpp"
 
 /// A widget that displays a 32-bit RGBA pixel buffer.
 struct Display : rack::TransparentWidget {
  private:
     /// the size of the internal pixel buffer to render
     const rack::Vec image_size;
-    /// a pointer to the pixels to render. A pixel is represented as 4 bytes
+    /// a pointer to the frames to render. A pixel is represented as 4 bytes
     /// in RGBA order
-    const uint8_t* pixels;
+    DisplayBuffer* buffer;
     /// a pointer to the image to draw the display to
     int screen = -1;
+    /// the generation of the frame in the image
+    uint64_t generation = 0;
+
+    /// @brief Upload the rows of the frame that changed to the image.
+    ///
+    /// @param vg the NanoVG context that owns the image
+    ///
+    void upload(NVGcontext* vg) {
+        const int first_row = buffer->get_first_row();
+        const int last_row = buffer->get_last_row();
+        if (first_row == 0 && last_row == image_size.y) {
+            nvgUpdateImage(vg, screen, buffer->get_pixels());
+            return;
+        }
+        // NanoVG only updates whole images, so update the rows through the
+        // texture of the image. NanoVG leaves texture 0 bound after updates
+        glBindTexture(GL_TEXTURE_2D, nvglImageHandleGL2(vg, screen));
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, first_row, image_size.x, last_row - first_row,
+            GL_RGBA, GL_UNSIGNED_BYTE, buffer->get_pixels() + first_row * 4 * static_cast<int>(image_size.x));
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
 
  public:
     /// whether the screen is turned on
@@ -38,8 +60,8 @@ struct Display : rack::TransparentWidget {
     /// @brief Initialize a new display widget.
     ///
     /// @param position the position of the screen on the module
-    /// @param pixels_ the pixels on the display to render. A pixel is
-    /// represented as 4 bytes in RGBA order
+    /// @param buffer_ the frames on the display to render (nullptr if there
+    /// are none). A pixel is represented as 4 bytes in RGBA order
     /// @param image_size_ the size of the input image
     /// @param render_size the output size of the display to render. NanoSVG
     /// will provide interpolation logic between the image_size_ and the
@@ -47,11 +69,11 @@ struct Display : rack::TransparentWidget {
     ///
     explicit Display(
         rack::Vec position,
-        const uint8_t* pixels_,
+        DisplayBuffer* buffer_,
         rack::Vec image_size_,
         rack::Vec render_size
     ) :
-        TransparentWidget(), image_size(image_size_), pixels(pixels_) {
+        TransparentWidget(), image_size(image_size_), buffer(buffer_) {
         setPosition(position);
         setSize(render_size);
     }
@@ -75,14 +97,18 @@ struct Display : rack::TransparentWidget {
             // don't do anything if the screen is not on
             if (!is_on) return;
             // return if the pixels aren't set for the screen yet
-            if (pixels == nullptr) return;
+            if (buffer == nullptr) return;
             // -------------------------------------------------------------------
             // create / update the image container
             // -------------------------------------------------------------------
-            if (screen == -1)  // check if the screen has been initialized yet
-                screen = nvgCreateImageRGBA(args.vg, image_size.x, image_size.y, imageFlags, pixels);
-            else  // update the screen with the pixel data
-                nvgUpdateImage(args.vg, screen, pixels);
+            buffer->acquire();
+            if (screen == -1) {  // check if the screen has been initialized yet
+                screen = nvgCreateImageRGBA(args.vg, image_size.x, image_size.y, imageFlags, buffer->get_pixels());
+                generation = buffer->get_generation();
+            } else if (generation != buffer->get_generation()) {  // new frame
+                upload(args.vg);
+                generation = buffer->get_generation();
+            }
             // -------------------------------------------------------------------
             // draw the screen
             // -------------------------------------------------------------------
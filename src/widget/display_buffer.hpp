@@ -0,0 +1,157 @@
+// A buffer that hands frames of pixels from the engine to the UI.
+// Copyright 2020 Christian Kauten
+//
+// Author: Christian Kauten (kautenja@auburn.edu)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef RACKNES_WIDGETS_DISPLAY_BUFFER_HPP_
+#define RACKNES_WIDGETS_DISPLAY_BUFFER_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/// A lock-free triple buffer of frames from one producer to one consumer.
+///
+/// @details
+/// The producer (the engine thread) writes frames into a back buffer and
+/// publishes them by swapping the back buffer with the middle one. The
+/// consumer (the UI thread) takes the latest published frame by swapping its
+/// front buffer with the middle one. Neither side waits for the other and
+/// the consumer never sees a partially written frame.
+///
+/// Every published frame has a generation and the range of rows that differ
+/// from the last frame the consumer took, so the consumer only uploads the
+/// rows that changed. Frames that do not change anything are not published.
+///
+struct DisplayBuffer {
+ private:
+    /// the bits of the middle state that hold the index of the buffer
+    static constexpr uint8_t INDEX_MASK = 0x3;
+    /// the bit of the middle state that is set when a frame is published
+    static constexpr uint8_t FRESH = 0x4;
+
+    /// A frame of pixels and the rows that changed since the last frame.
+    struct Frame {
+        /// the pixels of the frame
+        std::vector<uint8_t> pixels;
+        /// the number of frames published up to and including this one
+        uint64_t generation = 0;
+        /// the first row that changed
+        int first_row = 0;
+        /// the row after the last row that changed
+        int last_row = 0;
+    };
+
+    /// the number of bytes in a row of pixels
+    const std::size_t pitch;
+    /// the number of rows of pixels
+    const int rows;
+    /// the three buffers of frames
+    Frame frames[3];
+    /// the index of the middle buffer and whether it is fresh
+    std::atomic<uint8_t> middle{1};
+    /// the index of the buffer the producer writes to
+    uint8_t back = 0;
+    /// the index of the buffer the producer published last
+    uint8_t published = 2;
+    /// the index of the buffer the consumer reads from
+    uint8_t front = 2;
+    /// the generation of the last published frame
+    uint64_t generation = 0;
+
+    /// @brief Publish the back buffer.
+    ///
+    /// @param first_row the first row that changed since the last frame
+    /// @param last_row the row after the last row that changed
+    ///
+    void publish(int first_row, int last_row) {
+        // the consumer has not taken the last frame, so it still needs the
+        // rows that the last frame changed too
+        if (middle.load(std::memory_order_acquire) & FRESH) {
+            first_row = std::min(first_row, frames[published].first_row);
+            last_row = std::max(last_row, frames[published].last_row);
+        }
+        Frame& frame = frames[back];
+        frame.generation = ++generation;
+        frame.first_row = first_row;
+        frame.last_row = last_row;
+        published = back;
+        back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+ public:
+    /// @brief Initialize a new display buffer.
+    ///
+    /// @param pitch_ the number of bytes in a row of pixels
+    /// @param rows_ the number of rows of pixels
+    ///
+    DisplayBuffer(std::size_t pitch_, int rows_) : pitch(pitch_), rows(rows_) {
+        for (auto& frame : frames) frame.pixels.resize(pitch * rows);
+    }
+
+    DisplayBuffer(const DisplayBuffer&) = delete;
+    DisplayBuffer& operator=(const DisplayBuffer&) = delete;
+
+    /// @brief Write a frame from the producer.
+    ///
+    /// @param pixels the pixels of the frame with the pitch of the buffer
+    ///
+    void write(const uint8_t* pixels) {
+        const uint8_t* last = frames[published].pixels.data();
+        int first_row = rows;
+        int last_row = 0;
+        for (int row = 0; row < rows; row++) {
+            if (std::memcmp(pixels + row * pitch, last + row * pitch, pitch) == 0) continue;
+            first_row = std::min(first_row, row);
+            last_row = row + 1;
+        }
+        if (first_row >= last_row) return;
+        std::memcpy(frames[back].pixels.data(), pixels, pitch * rows);
+        publish(first_row, last_row);
+    }
+
+    /// @brief Clear the frame to black from the producer.
+    void clear() {
+        std::memset(frames[back].pixels.data(), 0, pitch * rows);
+        publish(0, rows);
+    }
+
+    /// @brief Take the latest frame for the consumer.
+    ///
+    /// @returns true if there was a new frame, false otherwise
+    ///
+    bool acquire() {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH)) return false;
+        front = middle.exchange(front, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+
+    /// @brief Return the pixels of the consumer's frame.
+    inline const uint8_t* get_pixels() const { return frames[front].pixels.data(); }
+
+    /// @brief Return the generation of the consumer's frame.
+    inline uint64_t get_generation() const { return frames[front].generation; }
+
+    /// @brief Return the first row that changed in the consumer's frame.
+    inline int get_first_row() const { return frames[front].first_row; }
+
+    /// @brief Return the row after the last row that changed in the consumer's
+    /// frame.
+    inline int get_last_row() const { return frames[front].last_row; }
+};
+
+#endif  // RACKNES_WIDGETS_DISPLAY_BUFFER_HPP_
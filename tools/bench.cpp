@@ -0,0 +1,254 @@
+// A headless benchmark of the NES emulator core.
+// Copyright 2020 Christian Kauten
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Usage: bench [-n FRAMES] [-s SCRIPT] [-r SAMPLE_RATE] [-k BATCH [-j JOBS]]
+//              [-f FORKS [-l LENGTH] [-j JOBS]] ROM
+//
+// The emulator is driven the same way the module drives it: the cycles for
+// one host sample are run, then a sample is read from every channel. The
+// script sets the controllers at given frames (see input_script.hpp).
+//
+// With -k, a batch of BATCH emulators is stepped frame by frame on JOBS
+// threads instead (see nes/emulator_batch.hpp), the way an agent steps its
+// environments, and the throughput is reported in frames per second per
+// thread.
+//
+// With -f, the emulator is forked into FORKS emulators at every frame and
+// each fork runs a branch of LENGTH frames with its own controllers on JOBS
+// threads (see nes/fork_pool.hpp), the way a patch explores the futures of a
+// game, and the time per fork and per run is reported.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include "nes/emulator.hpp"
+#include "nes/emulator_batch.hpp"
+#include "nes/fork_pool.hpp"
+#include "input_script.hpp"
+
+/// @brief Print the usage of the benchmark.
+static void usage() {
+    std::fprintf(stderr, "usage: bench [-n FRAMES] [-s SCRIPT] [-r SAMPLE_RATE] [-k BATCH [-j JOBS]]\n"
+                         "             [-f FORKS [-l LENGTH] [-j JOBS]] ROM\n");
+}
+
+/// @brief Benchmark a batch of emulators.
+///
+/// @param rom the path to the ROM
+/// @param frames the number of frames to step the batch
+/// @param inputs the inputs of the script, applied to every emulator
+/// @param size the number of emulators in the batch
+/// @param jobs the number of threads to step the batch on (0 for one per
+/// core)
+/// @returns the exit code of the benchmark
+///
+static int bench_batch(const std::string& rom, uint64_t frames, const std::vector<Input>& inputs, std::size_t size, unsigned jobs) {
+    NES::EmulatorBatch batch(size, jobs);
+    if (!batch.load_game(rom)) {
+        std::fprintf(stderr, "failed to load ROM %s\n", rom.c_str());
+        return 1;
+    }
+    // the arrays of the agent that the batch writes to
+    std::vector<NES::NES_Byte> controllers(2 * size);
+    std::vector<NES::NES_Byte> screens(size * NES::EmulatorBatch::SCREEN_BYTES);
+    std::vector<NES::NES_Byte> rams(size * NES::EmulatorBatch::RAM_BYTES);
+    std::size_t input = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (uint64_t frame = 0; frame < frames; frame++) {
+        for (; input < inputs.size() && inputs[input].frame <= frame; input++) {
+            for (std::size_t i = 0; i < size; i++) {
+                controllers[2 * i] = inputs[input].player1;
+                controllers[2 * i + 1] = inputs[input].player2;
+            }
+        }
+        batch.step(controllers.data(), screens.data(), rams.data());
+    }
+    const double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    const double total = static_cast<double>(frames) * size;
+    // the checksum of the last step, printed so it is not optimized away
+    uint64_t checksum = 0;
+    for (auto value : screens) checksum += value;
+    for (auto value : rams) checksum += value;
+    std::printf("rom              %s\n", rom.c_str());
+    std::printf("batch            %zu emulators on %zu threads\n", size, batch.get_num_threads());
+    std::printf("steps            %llu\n", static_cast<unsigned long long>(frames));
+    std::printf("wall time        %.3f s\n", seconds);
+    std::printf("frames/sec       %.1f (%.1f per thread)\n", total / seconds, total / seconds / batch.get_num_threads());
+    std::printf("checksum         %llu\n", static_cast<unsigned long long>(checksum));
+    return 0;
+}
+
+/// @brief Benchmark a pool of forks.
+///
+/// @param rom the path to the ROM
+/// @param frames the number of frames to run the source emulator
+/// @param inputs the inputs of the script, applied to the source emulator
+/// @param size the number of forks in the pool
+/// @param length the number of frames in the branch of each fork
+/// @param jobs the number of threads to run the forks on (0 for one per
+/// core)
+/// @returns the exit code of the benchmark
+///
+static int bench_forks(const std::string& rom, uint64_t frames, const std::vector<Input>& inputs, std::size_t size, std::size_t length, unsigned jobs) {
+    std::unique_ptr<NES::Emulator> source(new NES::Emulator());
+    NES::ForkPool pool(size, jobs);
+    if (!source->load_game(rom, false) || !pool.load_game(rom)) {
+        std::fprintf(stderr, "failed to load ROM %s\n", rom.c_str());
+        return 1;
+    }
+    // every fork holds its own button for the whole branch
+    std::vector<NES::NES_Byte> controllers(2 * size * length);
+    for (std::size_t i = 0; i < size; i++)
+        std::fill_n(&controllers[2 * i * length], 2 * length, static_cast<NES::NES_Byte>(1 << (i % 8)));
+    double fork_seconds = 0;
+    double run_seconds = 0;
+    uint64_t futures = 0;
+    std::vector<uint64_t> hashes(size);
+    std::size_t input = 0;
+    for (uint64_t frame = 0; frame < frames; frame++) {
+        for (; input < inputs.size() && inputs[input].frame <= frame; input++)
+            source->set_controllers(inputs[input].player1, inputs[input].player2);
+        source->fast_forward(NES::CYCLES_PER_FRAME, []() { });
+        // a run without frames costs the forks alone
+        auto start = std::chrono::steady_clock::now();
+        pool.run(*source, 0);
+        fork_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        start = std::chrono::steady_clock::now();
+        pool.run(*source, length, controllers.data());
+        run_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        // the number of distinct screens that the branches end on
+        for (std::size_t i = 0; i < size; i++) hashes[i] = pool.get_outcome(i).screen_hash;
+        std::sort(hashes.begin(), hashes.end());
+        futures += std::unique(hashes.begin(), hashes.end()) - hashes.begin();
+    }
+    const double forks = static_cast<double>(frames) * size;
+    std::printf("rom              %s\n", rom.c_str());
+    std::printf("forks            %zu emulators on %zu threads\n", size, pool.get_num_threads());
+    std::printf("runs             %llu of %zu frames\n", static_cast<unsigned long long>(frames), length);
+    std::printf("fork time        %.2f us per fork\n", fork_seconds / forks * 1e6);
+    std::printf("run time         %.3f ms per run\n", run_seconds / frames * 1e3);
+    std::printf("frames/sec       %.1f\n", forks * length / run_seconds);
+    std::printf("futures          %.2f distinct screens per run\n", static_cast<double>(futures) / frames);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    uint64_t frames = 600;
+    uint32_t sample_rate = NES::APU::SAMPLE_RATE;
+    std::size_t batch = 0;
+    std::size_t forks = 0;
+    std::size_t length = 60;
+    unsigned jobs = 0;
+    std::string script;
+    std::string rom;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "-n" && i + 1 < argc) {
+            frames = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "-s" && i + 1 < argc) {
+            script = argv[++i];
+        } else if (arg == "-r" && i + 1 < argc) {
+            sample_rate = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "-k" && i + 1 < argc) {
+            batch = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "-f" && i + 1 < argc) {
+            forks = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "-l" && i + 1 < argc) {
+            length = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "-j" && i + 1 < argc) {
+            jobs = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg[0] != '-' && rom.empty()) {
+            rom = arg;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (rom.empty() || frames == 0 || sample_rate == 0) {
+        usage();
+        return 1;
+    }
+    std::vector<Input> inputs;
+    if (!script.empty() && !load_script(script, inputs)) {
+        std::fprintf(stderr, "failed to load input script %s\n", script.c_str());
+        return 1;
+    }
+    if (batch > 0) return bench_batch(rom, frames, inputs, batch, jobs);
+    if (forks > 0) return bench_forks(rom, frames, inputs, forks, length, jobs);
+    // the emulator is large, keep it off of the stack
+    auto emulator = new NES::Emulator;
+    if (!emulator->load_game(rom)) {
+        std::fprintf(stderr, "failed to load ROM %s\n", rom.c_str());
+        return 1;
+    }
+    emulator->set_sample_rate(sample_rate);
+    // the screen buffer that frames are copied to, as the module does
+    std::vector<NES::NES_Pixel> screen(NES::Emulator::PIXELS);
+    // the sum of the audio output, printed so it is not optimized away
+    float checksum = 0.f;
+    // the frame the benchmark is on and the next input to apply
+    uint64_t frame = 0;
+    std::size_t input = 0;
+    auto apply_inputs = [&]() {
+        for (; input < inputs.size() && inputs[input].frame <= frame; input++)
+            emulator->set_controllers(inputs[input].player1, inputs[input].player2);
+    };
+    apply_inputs();
+    const std::size_t cycles_per_sample = NES::CLOCK_RATE / sample_rate;
+    const uint64_t instructions = emulator->get_instructions();
+    const auto start = std::chrono::steady_clock::now();
+    while (frame < frames) {
+        for (std::size_t i = 0; i < cycles_per_sample; i++) {
+            emulator->cycle([&]() {
+                std::memcpy(&screen[0], emulator->get_screen_buffer(), NES::Emulator::SCREEN_BYTES);
+                ++frame;
+                apply_inputs();
+            });
+        }
+        for (std::size_t channel = 0; channel < NES::APU::NUM_CHANNELS; channel++)
+            checksum += emulator->get_audio_voltage(channel);
+    }
+    const double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    const double executed = emulator->get_instructions() - instructions;
+    // the emulated time is measured in cycles so it accounts for the frames
+    // that the clock runs past the last frame of the benchmark
+    const double emulated = static_cast<double>(frames) * NES::CYCLES_PER_FRAME / NES::CLOCK_RATE;
+    std::printf("rom              %s\n", rom.c_str());
+    std::printf("frames           %llu (%.2f s emulated)\n", static_cast<unsigned long long>(frames), emulated);
+    std::printf("wall time        %.3f s\n", seconds);
+    std::printf("frames/sec       %.1f (%.2fx real-time)\n", frames / seconds, emulated / seconds);
+    std::printf("instructions/sec %.2f M (%.0f instructions)\n", executed / seconds * 1e-6, executed);
+    std::printf("audio checksum   %f\n", checksum);
+    // the time per stage from the profiler of the emulator
+    const auto profile = emulator->get_profile();
+    double profiled = 0;
+    std::printf("\n%-16s %10s %8s\n", "stage", "seconds", "share");
+    for (int i = 0; i < NES::Profiler::NUM_STAGES; i++) {
+        const auto stage = static_cast<NES::Profiler::Stage>(i);
+        profiled += profile.seconds[i];
+        std::printf("%-16s %10.3f %7.1f%%\n", NES::Profiler::get_name(stage), profile.seconds[i], 100 * profile.seconds[i] / seconds);
+    }
+    const double other = std::max(0.0, seconds - profiled);
+    std::printf("%-16s %10.3f %7.1f%%\n", "other", other, 100 * other / seconds);
+    delete emulator;
+    return 0;
+}
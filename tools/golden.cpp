@@ -0,0 +1,362 @@
+// A golden trace harness that verifies the behavior of the NES emulator core.
+// Copyright 2020 Christian Kauten
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Usage: golden [-n FRAMES] [-s SCRIPT] [-r SAMPLE_RATE] [-i INSTRUCTIONS]
+//               [-p START] [-t] [-c REFERENCE] [-o OUTPUT] ROM
+//
+// The core is built with NES_TRACE so the CPU reports its state before each
+// instruction. A golden trace is a text file of:
+//
+//   C000  A:00 X:00 Y:00 P:24 SP:FD PPU:  0, 21 CYC:7   state of the CPU
+//   FRAME 0 0123456789abcdef                             hash of nes_pixels
+//   AUDIO 0 0123456789abcdef                             hash of the samples
+//
+// Instruction lines use the fields of the nestest log, so nestest.log is a
+// reference too (run it with -p C000 -t -n 1). -o writes the trace of a run
+// and -c compares a run against a reference, stopping at the first
+// divergence of the instructions, frames, or audio. -t ignores the PPU dot
+// and CPU cycle of instructions for logs of other emulators. Instructions
+// that idle loop fast-forwarding skips are not traced. The script sets the
+// controllers at given frames (see input_script.hpp).
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "nes/emulator.hpp"
+#include "input_script.hpp"
+
+/// The state of the CPU before an instruction executes.
+struct State {
+    /// the registers of the CPU
+    NES::NES_Address pc = 0;
+    NES::NES_Byte a = 0, x = 0, y = 0, p = 0, sp = 0;
+    /// the position of the PPU
+    int scanline = 0, dot = 0;
+    /// the cycle of the CPU
+    long long cycle = 0;
+    /// whether the state has a PPU position and CPU cycle
+    bool has_ppu = false, has_cycle = false;
+};
+
+/// @brief Format the state of the CPU as a line of a trace.
+///
+/// @param state the state to format
+/// @returns the state in the nestest log format (without disassembly)
+///
+static std::string format_state(const State& state) {
+    char line[96];
+    std::snprintf(line, sizeof line, "%04X  A:%02X X:%02X Y:%02X P:%02X SP:%02X PPU:%3d,%3d CYC:%lld",
+        state.pc, state.a, state.x, state.y, state.p, state.sp,
+        state.scanline, state.dot, state.cycle);
+    return line;
+}
+
+/// @brief Parse the state of the CPU from a line of a trace.
+///
+/// @param line the line in the nestest log format to parse
+/// @param state the state to parse the line into
+/// @returns true if the line has a program counter and registers
+///
+static bool parse_state(const std::string& line, State& state) {
+    unsigned pc, a, x, y, p, sp;
+    if (line.size() < 4 || std::sscanf(line.c_str(), "%4x", &pc) != 1) return false;
+    auto field = [&](const char* key, unsigned& value) {
+        const auto index = line.find(key);
+        return index != std::string::npos && std::sscanf(line.c_str() + index + std::strlen(key), "%x", &value) == 1;
+    };
+    if (!field(" A:", a) || !field(" X:", x) || !field(" Y:", y) || !field(" P:", p) || !field(" SP:", sp))
+        return false;
+    state.pc = pc;
+    state.a = a;
+    state.x = x;
+    state.y = y;
+    state.p = p;
+    state.sp = sp;
+    const auto ppu = line.find(" PPU:");
+    state.has_ppu = ppu != std::string::npos &&
+        std::sscanf(line.c_str() + ppu + 5, "%d,%d", &state.scanline, &state.dot) == 2;
+    const auto cycle = line.find(" CYC:");
+    state.has_cycle = cycle != std::string::npos &&
+        std::sscanf(line.c_str() + cycle + 5, "%lld", &state.cycle) == 1;
+    return true;
+}
+
+/// @brief Hash a buffer using 64-bit FNV-1a.
+///
+/// @param hash the hash to continue from
+/// @param data the buffer to hash
+/// @param size the number of bytes in the buffer
+/// @returns the hash of the buffer
+///
+static uint64_t fnv1a(uint64_t hash, const void* data, std::size_t size) {
+    auto bytes = static_cast<const uint8_t*>(data);
+    for (std::size_t i = 0; i < size; i++) hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    return hash;
+}
+
+/// the initial value of an FNV-1a hash
+static constexpr uint64_t FNV_OFFSET = 0xcbf29ce484222325ull;
+
+/// A trace of a run of the emulator that is written and compared.
+struct Harness {
+    /// the emulator that is being traced
+    NES::Emulator* emulator = nullptr;
+    /// the file to write the trace to (optional)
+    std::FILE* output = nullptr;
+    /// the maximal number of instructions to trace
+    uint64_t instruction_limit = 20000;
+    /// whether to ignore the PPU dot and CPU cycle of instructions
+    bool ignore_timing = false;
+
+    /// the reference trace
+    std::vector<State> instructions;
+    std::vector<uint64_t> frames;
+    std::vector<uint64_t> audio;
+
+    /// the number of instructions and frames traced so far
+    uint64_t instruction = 0;
+    uint64_t frame = 0;
+    /// the hash of the audio samples of the current frame
+    uint64_t audio_hash = FNV_OFFSET;
+    /// the line of the last instruction traced
+    std::string last_line;
+    /// whether the run diverged from the reference
+    bool is_diverged = false;
+
+    /// @brief Load a reference trace from disk.
+    ///
+    /// @param path the path of the trace to load
+    /// @returns true if the trace loaded, false otherwise
+    ///
+    bool load(const std::string& path) {
+        std::ifstream file(path);
+        if (!file.is_open()) return false;
+        std::string line;
+        while (std::getline(file, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.empty() || line[0] == '#') continue;
+            unsigned long long index, hash;
+            State state;
+            if (std::sscanf(line.c_str(), "FRAME %llu %llx", &index, &hash) == 2) {
+                frames.push_back(hash);
+            } else if (std::sscanf(line.c_str(), "AUDIO %llu %llx", &index, &hash) == 2) {
+                audio.push_back(hash);
+            } else if (parse_state(line, state)) {
+                instructions.push_back(state);
+            } else {
+                std::fprintf(stderr, "unrecognized line in %s: %s\n", path.c_str(), line.c_str());
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /// @brief Report the first divergence from the reference.
+    ///
+    /// @param what a description of the divergence
+    /// @param expected the expected value
+    /// @param actual the actual value
+    ///
+    void diverge(const std::string& what, const std::string& expected, const std::string& actual) {
+        is_diverged = true;
+        std::printf("first divergence at %s (frame %llu, instruction %llu)\n",
+            what.c_str(), static_cast<unsigned long long>(frame), static_cast<unsigned long long>(instruction));
+        if (!last_line.empty()) std::printf("  previous  %s\n", last_line.c_str());
+        std::printf("  expected  %s\n", expected.c_str());
+        std::printf("  actual    %s\n", actual.c_str());
+    }
+
+    /// @brief Trace the state of the CPU before an instruction.
+    ///
+    /// @param cpu the CPU that is about to execute an instruction
+    ///
+    void on_instruction(const NES::CPU& cpu) {
+        if (is_diverged || instruction >= instruction_limit) return;
+        State state;
+        state.pc = cpu.get_PC();
+        state.a = cpu.get_A();
+        state.x = cpu.get_X();
+        state.y = cpu.get_Y();
+        // the break flag is not a register on the 6502, bit 5 is always set
+        state.p = (cpu.get_flags() & ~0x10) | 0x20;
+        state.sp = cpu.get_SP();
+        state.scanline = emulator->get_ppu().get_scanline();
+        state.dot = emulator->get_ppu().get_dot();
+        // the cycle counter includes the first cycle of the instruction
+        state.cycle = cpu.get_cycles() - 1;
+        state.has_ppu = state.has_cycle = true;
+        const std::string line = format_state(state);
+        if (output != nullptr) std::fprintf(output, "%s\n", line.c_str());
+        if (instruction < instructions.size()) {
+            const State& expected = instructions[instruction];
+            bool is_equal = expected.pc == state.pc && expected.a == state.a &&
+                expected.x == state.x && expected.y == state.y &&
+                expected.p == state.p && expected.sp == state.sp;
+            if (!ignore_timing && expected.has_ppu)
+                is_equal &= expected.scanline == state.scanline && expected.dot == state.dot;
+            if (!ignore_timing && expected.has_cycle)
+                is_equal &= expected.cycle == state.cycle;
+            if (!is_equal) diverge("instruction", format_state(expected), line);
+        }
+        last_line = line;
+        ++instruction;
+    }
+
+    /// @brief Add a sample from every channel to the audio of the frame.
+    void on_sample() {
+        for (std::size_t channel = 0; channel < NES::APU::NUM_CHANNELS; channel++) {
+            const int16_t sample = emulator->get_audio_sample(channel);
+            audio_hash = fnv1a(audio_hash, &sample, sizeof sample);
+        }
+    }
+
+    /// @brief Trace the pixels and audio of a frame.
+    void on_frame() {
+        if (is_diverged) return;
+        const uint64_t pixels = fnv1a(FNV_OFFSET, emulator->get_ppu().get_pixels(),
+            NES::VISIBLE_SCANLINES * NES::SCANLINE_VISIBLE_DOTS);
+        const auto index = static_cast<unsigned long long>(frame);
+        if (output != nullptr) {
+            std::fprintf(output, "FRAME %llu %016llx\n", index, static_cast<unsigned long long>(pixels));
+            std::fprintf(output, "AUDIO %llu %016llx\n", index, static_cast<unsigned long long>(audio_hash));
+        }
+        char expected[32], actual[32];
+        if (frame < frames.size() && frames[frame] != pixels) {
+            std::snprintf(expected, sizeof expected, "%016llx", static_cast<unsigned long long>(frames[frame]));
+            std::snprintf(actual, sizeof actual, "%016llx", static_cast<unsigned long long>(pixels));
+            diverge("pixels", expected, actual);
+        } else if (frame < audio.size() && audio[frame] != audio_hash) {
+            std::snprintf(expected, sizeof expected, "%016llx", static_cast<unsigned long long>(audio[frame]));
+            std::snprintf(actual, sizeof actual, "%016llx", static_cast<unsigned long long>(audio_hash));
+            diverge("audio", expected, actual);
+        }
+        audio_hash = FNV_OFFSET;
+        ++frame;
+    }
+};
+
+/// the harness that the CPU reports instructions to
+static Harness* harness = nullptr;
+
+void NES::trace_instruction(const NES::CPU& cpu) {
+    if (harness != nullptr) harness->on_instruction(cpu);
+}
+
+/// @brief Print the usage of the harness.
+static void usage() {
+    std::fprintf(stderr, "usage: golden [-n FRAMES] [-s SCRIPT] [-r SAMPLE_RATE] [-i INSTRUCTIONS]\n"
+                         "              [-p START] [-t] [-c REFERENCE] [-o OUTPUT] ROM\n");
+}
+
+int main(int argc, char** argv) {
+    uint64_t frames = 600;
+    uint32_t sample_rate = NES::APU::SAMPLE_RATE;
+    long start = -1;
+    std::string script, reference, output, rom;
+    Harness trace;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "-n" && i + 1 < argc) {
+            frames = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "-s" && i + 1 < argc) {
+            script = argv[++i];
+        } else if (arg == "-r" && i + 1 < argc) {
+            sample_rate = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "-i" && i + 1 < argc) {
+            trace.instruction_limit = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "-p" && i + 1 < argc) {
+            start = std::strtol(argv[++i], nullptr, 16);
+        } else if (arg == "-t") {
+            trace.ignore_timing = true;
+        } else if (arg == "-c" && i + 1 < argc) {
+            reference = argv[++i];
+        } else if (arg == "-o" && i + 1 < argc) {
+            output = argv[++i];
+        } else if (arg[0] != '-' && rom.empty()) {
+            rom = arg;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (rom.empty() || frames == 0 || sample_rate == 0) {
+        usage();
+        return 1;
+    }
+    std::vector<Input> inputs;
+    if (!script.empty() && !load_script(script, inputs)) {
+        std::fprintf(stderr, "failed to load input script %s\n", script.c_str());
+        return 1;
+    }
+    if (!reference.empty() && !trace.load(reference)) {
+        std::fprintf(stderr, "failed to load reference trace %s\n", reference.c_str());
+        return 1;
+    }
+    // the emulator is large, keep it off of the stack
+    auto emulator = new NES::Emulator;
+    if (!emulator->load_game(rom)) {
+        std::fprintf(stderr, "failed to load ROM %s\n", rom.c_str());
+        return 1;
+    }
+    emulator->set_sample_rate(sample_rate);
+    if (start >= 0) emulator->reset(static_cast<NES::NES_Address>(start));
+    if (!output.empty()) {
+        trace.output = std::fopen(output.c_str(), "w");
+        if (trace.output == nullptr) {
+            std::fprintf(stderr, "failed to open %s\n", output.c_str());
+            return 1;
+        }
+        std::fprintf(trace.output, "# golden trace of %s\n", rom.c_str());
+    }
+    trace.emulator = emulator;
+    harness = &trace;
+    std::size_t input = 0;
+    auto apply_inputs = [&]() {
+        for (; input < inputs.size() && inputs[input].frame <= trace.frame; input++)
+            emulator->set_controllers(inputs[input].player1, inputs[input].player2);
+    };
+    apply_inputs();
+    const std::size_t cycles_per_sample = NES::CLOCK_RATE / sample_rate;
+    while (trace.frame < frames && !trace.is_diverged) {
+        for (std::size_t i = 0; i < cycles_per_sample; i++) {
+            emulator->cycle([&]() {
+                trace.on_frame();
+                apply_inputs();
+            });
+        }
+        trace.on_sample();
+    }
+    harness = nullptr;
+    if (trace.output != nullptr) std::fclose(trace.output);
+    const auto compared = [](uint64_t traced, std::size_t expected) {
+        return static_cast<unsigned long long>(std::min<uint64_t>(traced, expected));
+    };
+    std::printf("rom              %s\n", rom.c_str());
+    std::printf("frames           %llu\n", static_cast<unsigned long long>(trace.frame));
+    std::printf("instructions     %llu traced\n", static_cast<unsigned long long>(trace.instruction));
+    if (!reference.empty()) {
+        std::printf("compared         %llu instructions, %llu frames, %llu audio blocks\n",
+            compared(trace.instruction, trace.instructions.size()),
+            compared(trace.frame, trace.frames.size()),
+            compared(trace.frame, trace.audio.size()));
+        std::printf("result           %s\n", trace.is_diverged ? "DIVERGED" : "match");
+    }
+    delete emulator;
+    return trace.is_diverged ? 1 : 0;
+}
@@ -0,0 +1,67 @@
+// Scripted controller input for the headless tools.
+// Copyright 2020 Christian Kauten
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// A script is a text file of lines "FRAME PLAYER1 PLAYER2" that set the
+// controller bytes (i.e., 0x08 is Start) from the given frame onward. Lines
+// starting with # are comments.
+//
+
+#ifndef TOOLS_INPUT_SCRIPT_HPP
+#define TOOLS_INPUT_SCRIPT_HPP
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "nes/emulator.hpp"
+
+/// A change of the controller state at a frame of a script.
+struct Input {
+    /// the frame to write the controllers at
+    uint64_t frame;
+    /// the button bitmap for player 1
+    NES::NES_Byte player1;
+    /// the button bitmap for player 2
+    NES::NES_Byte player2;
+};
+
+/// @brief Load an input script from disk.
+///
+/// @param path the path to the script to load
+/// @param inputs the vector to load the inputs into
+/// @returns true if the script loaded, false otherwise
+///
+inline bool load_script(const std::string& path, std::vector<Input>& inputs) {
+    std::ifstream file(path);
+    if (!file.is_open()) return false;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream stream(line);
+        std::string frame, player1, player2;
+        if (!(stream >> frame >> player1 >> player2)) return false;
+        inputs.push_back({
+            std::strtoull(frame.c_str(), nullptr, 0),
+            static_cast<NES::NES_Byte>(std::strtoul(player1.c_str(), nullptr, 0)),
+            static_cast<NES::NES_Byte>(std::strtoul(player2.c_str(), nullptr, 0))
+        });
+    }
+    std::stable_sort(inputs.begin(), inputs.end(),
+        [](const Input& a, const Input& b) { return a.frame < b.frame; });
+    return true;
+}
+
+#endif  // TOOLS_INPUT_SCRIPT_HPP
@@ -0,0 +1,326 @@
+// Microbenchmarks of the hot paths in the NES emulator core.
+// Copyright 2020 Christian Kauten
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Usage: microbench [-b BASELINE] [-t PERCENT] [FILTER]
+//
+// Every benchmark runs a fixed number of iterations REPEATS times over fixed
+// inputs (a synthetic cartridge generated at startup) and reports the median
+// time per unit as tab-separated values:
+//
+//     name    iterations    unit    ns
+//
+// With -b, the results are compared against a baseline file in the same
+// format and two columns are added: the baseline time and the change in
+// percent. With -t, the exit status is 1 if any benchmark is slower than its
+// baseline by more than the given percent. If a FILTER is given, only the
+// benchmarks whose name contains it run.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "nes/emulator.hpp"
+
+/// the number of times to repeat each benchmark, the median is reported
+static constexpr int REPEATS = 7;
+
+/// @brief Return a pseudo-random byte sequence that is the same every run.
+///
+/// @param size the number of bytes to generate
+/// @param seed the seed of the sequence
+/// @returns a vector of the given number of bytes
+///
+static std::vector<NES::NES_Byte> fixed_bytes(std::size_t size, uint32_t seed) {
+    std::vector<NES::NES_Byte> bytes(size);
+    for (auto& byte : bytes) {
+        // xorshift32
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        byte = seed >> 24;
+    }
+    return bytes;
+}
+
+/// @brief Write the synthetic NROM cartridge that the benchmarks run on.
+///
+/// @param path the path to write the iNES file to
+/// @returns true if the file was written, false otherwise
+/// @details
+/// the program at $C000 is a loop over a mix of addressing modes, ALU
+/// operations, branches, and a subroutine call that is never idle. the CHR
+/// ROM is filled with fixed noise so every tile renders detail
+///
+static bool write_cartridge(const std::string& path) {
+    static constexpr NES::NES_Byte PROGRAM[] = {
+        0xA2, 0x00,        // C000: LDX #$00
+        0xA0, 0x00,        // C002: LDY #$00
+        0xA9, 0x37,        // C004: LDA #$37
+        0x65, 0x10,        // C006: ADC $10
+        0x85, 0x11,        // C008: STA $11
+        0x95, 0x20,        // C00A: STA $20,X
+        0xBD, 0x00, 0x03,  // C00C: LDA $0300,X
+        0x49, 0x5A,        // C00F: EOR #$5A
+        0x9D, 0x00, 0x03,  // C011: STA $0300,X
+        0x0A,              // C014: ASL A
+        0x2A,              // C015: ROL A
+        0xC8,              // C016: INY
+        0xB1, 0x30,        // C017: LDA ($30),Y
+        0x29, 0x0F,        // C019: AND #$0F
+        0xC9, 0x07,        // C01B: CMP #$07
+        0x90, 0x01,        // C01D: BCC $C020
+        0xE8,              // C01F: INX
+        0xE8,              // C020: INX
+        0x20, 0x28, 0xC0,  // C021: JSR $C028
+        0x4C, 0x04, 0xC0,  // C024: JMP $C004
+        0xEA,              // C027: NOP
+        0x48,              // C028: PHA
+        0x68,              // C029: PLA
+        0x60,              // C02A: RTS
+    };
+    std::vector<NES::NES_Byte> prg(0x4000, 0xEA);
+    std::copy(std::begin(PROGRAM), std::end(PROGRAM), prg.begin());
+    // NMI, RESET, and IRQ vectors (the 16K bank is mirrored at $C000)
+    const NES::NES_Byte vectors[] = {0x00, 0xC0, 0x00, 0xC0, 0x00, 0xC0};
+    std::copy(std::begin(vectors), std::end(vectors), prg.end() - 6);
+    const auto chr = fixed_bytes(0x2000, 0x2C02);
+    const NES::NES_Byte header[16] = {'N', 'E', 'S', 0x1A, 1, 1};
+    std::ofstream file(path, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(header), sizeof header);
+    file.write(reinterpret_cast<const char*>(prg.data()), prg.size());
+    file.write(reinterpret_cast<const char*>(chr.data()), chr.size());
+    return static_cast<bool>(file);
+}
+
+/// A benchmark of one of the hot paths.
+struct Benchmark {
+    /// the name of the benchmark
+    const char* name;
+    /// the number of units per repeat
+    uint64_t iterations;
+    /// the unit of work that one iteration is
+    const char* unit;
+    /// run the given number of iterations
+    std::function<void(uint64_t)> run;
+};
+
+/// A result of a benchmark in a results file.
+struct Result {
+    /// the number of units per repeat
+    uint64_t iterations;
+    /// the unit of work that one iteration is
+    std::string unit;
+    /// the median nanoseconds per unit
+    double ns;
+};
+
+/// @brief Load a results file.
+///
+/// @param path the path of the TSV file to load
+/// @param results the map of benchmark names to results to load into
+/// @returns true if the file loaded, false otherwise
+///
+static bool load_results(const std::string& path, std::map<std::string, Result>& results) {
+    std::ifstream file(path);
+    if (!file.is_open()) return false;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream stream(line);
+        std::string name;
+        Result result;
+        if (stream >> name >> result.iterations >> result.unit >> result.ns)
+            results[name] = result;
+    }
+    return true;
+}
+
+/// @brief Time a benchmark.
+///
+/// @param benchmark the benchmark to time
+/// @returns the median nanoseconds per iteration over REPEATS repeats
+///
+static double measure(const Benchmark& benchmark) {
+    // warm up the caches and branch predictors
+    benchmark.run(std::max<uint64_t>(1, benchmark.iterations / 10));
+    std::vector<double> times;
+    for (int i = 0; i < REPEATS; i++) {
+        const auto start = std::chrono::steady_clock::now();
+        benchmark.run(benchmark.iterations);
+        const std::chrono::duration<double, std::nano> elapsed =
+            std::chrono::steady_clock::now() - start;
+        times.push_back(elapsed.count() / benchmark.iterations);
+    }
+    std::sort(times.begin(), times.end());
+    return times[REPEATS / 2];
+}
+
+int main(int argc, char** argv) {
+    std::string baseline_path;
+    double threshold = -1;
+    std::string filter;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "-b" && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (arg == "-t" && i + 1 < argc) {
+            threshold = std::atof(argv[++i]);
+        } else if (arg[0] != '-' && filter.empty()) {
+            filter = arg;
+        } else {
+            std::fprintf(stderr, "usage: microbench [-b BASELINE] [-t PERCENT] [FILTER]\n");
+            return 1;
+        }
+    }
+    std::map<std::string, Result> baseline;
+    if (!baseline_path.empty() && !load_results(baseline_path, baseline)) {
+        std::fprintf(stderr, "failed to load baseline %s\n", baseline_path.c_str());
+        return 1;
+    }
+    // the cartridge is written to the temporary directory
+    const char* temp = std::getenv("TMPDIR");
+    if (temp == nullptr) temp = std::getenv("TEMP");
+    const std::string rom = std::string(temp != nullptr ? temp : "/tmp") + "/racknes-microbench.nes";
+    if (!write_cartridge(rom)) {
+        std::fprintf(stderr, "failed to write cartridge %s\n", rom.c_str());
+        return 1;
+    }
+    auto cartridge = NES::Cartridge::create(rom, [](){});
+
+    // CPU: the synthetic program on a bare main bus
+    NES::MainBus cpu_bus;
+    cpu_bus.set_mapper(cartridge->get_mapper());
+    NES::CPU cpu;
+    cpu.reset(cpu_bus);
+
+    // PPU: one frame of the noise tiles with background and sprites on
+    NES::PictureBus picture_bus;
+    picture_bus.set_mapper(cartridge->get_mapper());
+    const auto name_tables = fixed_bytes(0x800, 0x2000);
+    for (NES::NES_Address i = 0; i < name_tables.size(); i++)
+        picture_bus.write(0x2000 + i, name_tables[i]);
+    for (NES::NES_Address i = 0; i < 0x20; i++)
+        picture_bus.write(0x3F00 + i, (7 * i) & 0x3F);
+    auto ppu = new NES::PPU;
+    ppu->reset();
+    ppu->control(0x10);
+    ppu->set_mask(0x1E);
+    // 64 sprites spread across the screen
+    ppu->set_OAM_address(0);
+    for (int i = 0; i < 64; i++) {
+        ppu->set_OAM_data(16 + 3 * i);
+        ppu->set_OAM_data(i);
+        ppu->set_OAM_data(i & 0x23);
+        ppu->set_OAM_data(4 * i);
+    }
+
+    // APU: all five channels playing, registers changed every block
+    auto apu = new NES::APU;
+    apu->set_dmc_reader([](void*, cpu_addr_t address) -> int { return address & 0xFF; }, nullptr);
+    apu->reset();
+    const NES::NES_Byte apu_registers[][2] = {
+        {0x17, 0x40}, {0x15, 0x1F},
+        {0x00, 0xBF}, {0x02, 0xFD}, {0x03, 0x00},
+        {0x04, 0x7F}, {0x06, 0x54}, {0x07, 0x01},
+        {0x08, 0xFF}, {0x0A, 0x20}, {0x0B, 0x01},
+        {0x0C, 0x3F}, {0x0E, 0x04}, {0x0F, 0x00},
+        {0x10, 0x0F}, {0x12, 0x00}, {0x13, 0xFF},
+    };
+    for (const auto& reg : apu_registers) apu->write(0x4000 + reg[0], reg[1]);
+
+    // NTSC: a frame of fixed palette indexes
+    auto ntsc = new nes_ntsc_t;
+    nes_ntsc_setup_t setup = nes_ntsc_composite;
+    nes_ntsc_init(ntsc, &setup);
+    auto pixels = fixed_bytes(NES::VISIBLE_SCANLINES * NES::SCANLINE_VISIBLE_DOTS, 0x4E53);
+    for (auto& pixel : pixels) pixel &= 0x3F;
+    std::vector<NES::NES_Pixel> screen(NES::Emulator::PIXELS);
+
+#ifndef NES_NO_JSON
+    // JSON: an emulator that has run a few frames of the program
+    auto emulator = new NES::Emulator;
+    emulator->load_game(rom);
+    for (int frames = 0; frames < 10;) emulator->cycle([&]() { frames++; });
+#endif
+
+    const std::vector<Benchmark> benchmarks = {
+        {"cpu_cycle", 1 << 22, "cycle", [&](uint64_t n) {
+            for (uint64_t i = 0; i < n; i++) cpu.cycle(cpu_bus);
+        }},
+        {"ppu_frame", 60, "frame", [&](uint64_t n) {
+            static constexpr uint64_t DOTS = NES::SCANLINE_CYCLE_LENGTH * (NES::FRAME_END_SCANLINE + 1);
+            for (uint64_t i = 0; i < n * DOTS; i++) ppu->cycle(picture_bus);
+        }},
+        {"apu_block", 600, "block", [&](uint64_t n) {
+            for (uint64_t i = 0; i < n; i++) {
+                // sweep the pulse periods so the synthesizers keep working
+                apu->write(0x4002, i);
+                apu->write(0x4006, i >> 1);
+                apu->cycle(NES::CYCLES_PER_FRAME);
+                for (std::size_t channel = 0; channel < NES::APU::NUM_CHANNELS; channel++)
+                    apu->get_sample(channel);
+            }
+        }},
+        {"ntsc_blit", 120, "frame", [&](uint64_t n) {
+            for (uint64_t i = 0; i < n; i++) {
+                nes_ntsc_blit(ntsc, pixels.data(), NES::SCANLINE_VISIBLE_DOTS, i & 1,
+                    NES::SCANLINE_VISIBLE_DOTS, NES::VISIBLE_SCANLINES,
+                    screen.data(), NES::NTSC_PITCH);
+            }
+        }},
+#ifndef NES_NO_JSON
+        {"json_round_trip", 20, "trip", [&](uint64_t n) {
+            for (uint64_t i = 0; i < n; i++) {
+                json_t* rootJ = emulator->dataToJson();
+                emulator->dataFromJson(rootJ);
+                json_decref(rootJ);
+            }
+        }},
+#endif
+    };
+
+    bool is_regression = false;
+    std::printf("# name\titerations\tunit\tns%s\n", baseline.empty() ? "" : "\tbaseline\tchange");
+    for (const auto& benchmark : benchmarks) {
+        if (!filter.empty() && std::string(benchmark.name).find(filter) == std::string::npos)
+            continue;
+        const double ns = measure(benchmark);
+        std::printf("%s\t%llu\t%s\t%.3f", benchmark.name,
+            static_cast<unsigned long long>(benchmark.iterations), benchmark.unit, ns);
+        const auto result = baseline.find(benchmark.name);
+        if (result != baseline.end()) {
+            const double change = 100 * (ns / result->second.ns - 1);
+            std::printf("\t%.3f\t%+.1f%%", result->second.ns, change);
+            if (threshold >= 0 && change > threshold) is_regression = true;
+        }
+        std::printf("\n");
+        std::fflush(stdout);
+    }
+
+#ifndef NES_NO_JSON
+    delete emulator;
+#endif
+    delete ntsc;
+    delete apu;
+    delete ppu;
+    delete cartridge;
+    std::remove(rom.c_str());
+    return is_regression;
+}
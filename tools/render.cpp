@@ -0,0 +1,385 @@
+// An offline renderer of input movies to audio stems and video.
+// Copyright 2020 Christian Kauten
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Usage: render [-r SAMPLE_RATE] [-j JOBS] [-o PREFIX] [-v] ROM MOVIE
+//
+// The movie (see nes/movie.hpp) is played into the emulator as fast as the
+// machine allows and every sample of the APU is written to 32-bit float WAV
+// stems: PREFIX-square1.wav, PREFIX-square2.wav, PREFIX-triangle.wav,
+// PREFIX-noise.wav, PREFIX-dmc.wav, and their sum in PREFIX-mix.wav. -v also
+// writes the screen at 60.0988 frames per second to PREFIX.rgba as raw
+// frames, i.e., for ffmpeg:
+//
+//   ffmpeg -f rawvideo -pix_fmt rgba -s 602x240 -r 60.0988 -i PREFIX.rgba
+//
+// The movie is split at every few keyframes into segments that render on
+// JOBS threads. A segment starts from the keyframe before it and plays up to
+// its start without writing, so the audio filters of the segment settle into
+// the state that one long render would have at the start of the segment.
+// Every segment writes its samples and frames straight to their offsets in
+// the files in blocks. The DMC fetches its samples from memory when the APU
+// catches up with the CPU, so the audio depends slightly on where the render
+// stops to read samples; the segments are fixed by the movie rather than
+// JOBS so the output is the same for any number of jobs.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "nes/movie.hpp"
+
+/// the number of stems (the channels of the APU and the mix)
+static constexpr std::size_t NUM_STEMS = NES::APU::NUM_CHANNELS + 1;
+/// the names of the stems
+static constexpr const char* STEM_NAMES[NUM_STEMS] = {
+    "square1", "square2", "triangle", "noise", "dmc", "mix"
+};
+/// the number of bytes in the header of a WAV file
+static constexpr std::size_t WAV_HEADER_SIZE = 58;
+/// the number of samples in the blocks that are written to the stems
+static constexpr std::size_t BLOCK_SIZE = 4096;
+/// the number of keyframes in a segment of the movie
+static constexpr std::size_t SEGMENT_KEYFRAMES = 4;
+
+/// @brief Print the usage of the renderer.
+static void usage() {
+    std::fprintf(stderr, "usage: render [-r SAMPLE_RATE] [-j JOBS] [-o PREFIX] [-v] ROM MOVIE\n");
+}
+
+/// @brief Write the header of a mono 32-bit float WAV file.
+///
+/// @param file the file to write the header to
+/// @param sample_rate the sample rate of the file
+/// @param samples the number of samples in the file
+///
+static void write_wav_header(std::ostream& file, uint32_t sample_rate, uint64_t samples) {
+    auto u16 = [&](uint16_t value) { file.write(reinterpret_cast<const char*>(&value), sizeof value); };
+    auto u32 = [&](uint32_t value) { file.write(reinterpret_cast<const char*>(&value), sizeof value); };
+    const uint32_t bytes = samples * sizeof(float);
+    file.seekp(0);
+    file.write("RIFF", 4);
+    u32(WAV_HEADER_SIZE - 8 + bytes);
+    file.write("WAVE", 4);
+    file.write("fmt ", 4);
+    u32(18);
+    u16(3);  // IEEE float
+    u16(1);
+    u32(sample_rate);
+    u32(sample_rate * sizeof(float));
+    u16(sizeof(float));
+    u16(32);
+    u16(0);
+    file.write("fact", 4);
+    u32(4);
+    u32(samples);
+    file.write("data", 4);
+    u32(bytes);
+}
+
+/// A part of the movie that renders on its own.
+struct Segment {
+    /// the cycle of the movie that the segment starts at
+    uint64_t start = 0;
+    /// the cycle of the movie that the segment ends at
+    uint64_t end = 0;
+    /// the cycle of the keyframe that the segment plays from
+    uint64_t preroll = 0;
+    /// the cycle that the audio was last cleared at before the preroll
+    uint64_t clear = 0;
+    /// the index of the first sample of the segment (set by the render)
+    uint64_t first_sample = 0;
+    /// the index of the sample after the segment (set by the render)
+    uint64_t end_sample = 0;
+    /// whether the segment rendered
+    bool is_done = false;
+};
+
+/// The settings of a render.
+struct Render {
+    /// the path to the ROM
+    std::string rom;
+    /// the movie to render
+    NES::Movie movie;
+    /// the sample rate of the stems
+    uint32_t sample_rate = 48000;
+    /// the prefix of the paths of the outputs
+    std::string prefix = "render";
+    /// whether the video is written
+    bool is_video = false;
+
+    /// @brief Return the path of a stem.
+    inline std::string get_stem_path(std::size_t stem) const {
+        return prefix + "-" + STEM_NAMES[stem] + ".wav";
+    }
+
+    /// @brief Return the path of the video.
+    inline std::string get_video_path() const { return prefix + ".rgba"; }
+};
+
+/// A block of samples of a stem that is written to its offset in the file.
+struct StemWriter {
+    /// the file of the stem
+    std::fstream file;
+    /// the samples that have not been written
+    std::vector<float> block;
+    /// the index of the first sample of the block
+    uint64_t start = 0;
+
+    /// @brief Write the block to the file.
+    void flush() {
+        if (block.empty()) return;
+        file.seekp(WAV_HEADER_SIZE + start * sizeof(float));
+        file.write(reinterpret_cast<const char*>(block.data()), block.size() * sizeof(float));
+        start += block.size();
+        block.clear();
+    }
+
+    /// @brief Add a sample to the block.
+    ///
+    /// @param index the index of the sample in the stem
+    /// @param value the value of the sample
+    ///
+    inline void write(uint64_t index, float value) {
+        if (block.empty()) start = index;
+        block.push_back(value);
+        if (block.size() == BLOCK_SIZE) flush();
+    }
+};
+
+/// @brief Render a segment of a movie.
+///
+/// @param render the settings of the render
+/// @param segment the segment to render
+/// @returns true if the segment rendered, false otherwise
+///
+static bool render_segment(const Render& render, Segment& segment) {
+    // the emulator is large, keep it off of the stack. The segments play
+    // states into their own emulators at once, so they leave the save file
+    // of a game with a battery alone
+    std::unique_ptr<NES::Emulator> emulator(new NES::Emulator());
+    if (!emulator->load_game(render.rom, false)) return false;
+    emulator->set_sample_rate(render.sample_rate);
+    NES::MoviePlayer player;
+    if (!player.start(render.movie, *emulator, segment.preroll)) return false;
+    // line the samples up with a render that ran from the last clear
+    emulator->set_audio_phase(segment.preroll - segment.clear);
+    uint64_t sample = emulator->get_audio_sample_count(segment.clear) +
+        emulator->get_audio_sample_count(segment.preroll - segment.clear);
+
+    StemWriter stems[NUM_STEMS];
+    for (std::size_t i = 0; i < NUM_STEMS; i++) {
+        stems[i].file.open(render.get_stem_path(i), std::ios_base::in | std::ios_base::out | std::ios_base::binary);
+        stems[i].block.reserve(BLOCK_SIZE);
+        if (!stems[i].file.is_open()) return false;
+    }
+    std::fstream video;
+    if (render.is_video) {
+        video.open(render.get_video_path(), std::ios_base::in | std::ios_base::out | std::ios_base::binary);
+        if (!video.is_open()) return false;
+    }
+
+    int16_t samples[NES::APU::NUM_CHANNELS][BLOCK_SIZE];
+    int16_t last[NES::APU::NUM_CHANNELS] = {};
+    // write a sample of every stem (or drop it before the segment starts)
+    uint64_t time = segment.preroll;
+    auto write_sample = [&](const int16_t* values) {
+        if (time > segment.start) {
+            float mix = 0.f;
+            for (std::size_t channel = 0; channel < NES::APU::NUM_CHANNELS; channel++) {
+                const float value = values[channel] / 32768.f;
+                stems[channel].write(sample, value);
+                mix += value;
+            }
+            stems[NES::APU::NUM_CHANNELS].write(sample, mix);
+        }
+        ++sample;
+    };
+    // read the samples that the emulator finished
+    auto drain = [&]() {
+        while (true) {
+            std::size_t count = 0;
+            for (std::size_t channel = 0; channel < NES::APU::NUM_CHANNELS; channel++)
+                count = emulator->read_audio_samples(channel, samples[channel], BLOCK_SIZE);
+            if (count == 0) return;
+            for (std::size_t i = 0; i < count; i++) {
+                for (std::size_t channel = 0; channel < NES::APU::NUM_CHANNELS; channel++)
+                    last[channel] = samples[channel][i];
+                write_sample(last);
+            }
+        }
+    };
+
+    while (true) {
+        drain();
+        if (time == segment.start) segment.first_sample = sample;
+        if (time == segment.end) break;
+        // write the screen at the frames of the video in the segment
+        const uint64_t frame = (time + NES::CYCLES_PER_FRAME - 1) / NES::CYCLES_PER_FRAME;
+        const uint64_t frame_time = frame * NES::CYCLES_PER_FRAME;
+        if (render.is_video && frame_time == time && time >= segment.start) {
+            video.seekp(frame * NES::Emulator::SCREEN_BYTES);
+            video.write(reinterpret_cast<const char*>(emulator->get_screen_buffer()), NES::Emulator::SCREEN_BYTES);
+        }
+        // run to the next frame of the video, event, or end of the segment
+        uint64_t stop = std::min(segment.end, frame_time > time ? frame_time : frame_time + NES::CYCLES_PER_FRAME);
+        if (time < segment.start) stop = std::min(stop, segment.start);
+        const uint64_t event = player.get_next_time();
+        if (event > time) stop = std::min(stop, event);
+        const uint64_t loads = player.get_loads();
+        player.run(*emulator, stop - time, []() { });
+        // a load clears the audio at the cycle it happens on, the samples
+        // that it cuts off hold the last value
+        if (player.get_loads() != loads) {
+            const uint64_t cleared = emulator->get_audio_sample_count(time);
+            while (sample < cleared) write_sample(last);
+        }
+        time = stop;
+    }
+    segment.end_sample = sample;
+    for (auto& stem : stems) stem.flush();
+    for (auto& stem : stems)
+        if (!stem.file.good()) return false;
+    return !render.is_video || video.good();
+}
+
+int main(int argc, char** argv) {
+    Render render;
+    unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+    std::string movie;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "-r" && i + 1 < argc) {
+            render.sample_rate = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "-j" && i + 1 < argc) {
+            jobs = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "-o" && i + 1 < argc) {
+            render.prefix = argv[++i];
+        } else if (arg == "-v") {
+            render.is_video = true;
+        } else if (arg[0] != '-' && render.rom.empty()) {
+            render.rom = arg;
+        } else if (arg[0] != '-' && movie.empty()) {
+            movie = arg;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (render.rom.empty() || movie.empty() || render.sample_rate == 0 || jobs == 0) {
+        usage();
+        return 1;
+    }
+    if (!render.movie.load(movie)) {
+        std::fprintf(stderr, "failed to load movie %s\n", movie.c_str());
+        return 1;
+    }
+    {  // check the game before starting the threads
+        std::unique_ptr<NES::Emulator> emulator(new NES::Emulator());
+        if (!emulator->load_game(render.rom, false)) {
+            std::fprintf(stderr, "failed to load ROM %s\n", render.rom.c_str());
+            return 1;
+        }
+        if (emulator->get_rom_checksum() != render.movie.get_rom_checksum()) {
+            std::fprintf(stderr, "movie %s is of a different game\n", movie.c_str());
+            return 1;
+        }
+    }
+
+    // split the keyframes into segments
+    const auto& keyframes = render.movie.get_keyframes();
+    const std::size_t count = (keyframes.size() + SEGMENT_KEYFRAMES - 1) / SEGMENT_KEYFRAMES;
+    std::vector<Segment> segments(count);
+    for (std::size_t i = 0; i < count; i++) {
+        const std::size_t first = i * SEGMENT_KEYFRAMES;
+        const std::size_t last = first + SEGMENT_KEYFRAMES;
+        segments[i].start = keyframes[first].time;
+        segments[i].end = last < keyframes.size() ? keyframes[last].time : render.movie.get_length();
+        segments[i].preroll = keyframes[first > 0 ? first - 1 : 0].time;
+    }
+    // find the last load before the keyframe of every segment
+    {
+        NES::Movie::Record record;
+        std::size_t offset = NES::Movie::HEADER_SIZE;
+        uint64_t clear = 0;
+        std::size_t segment = 0;
+        for (std::size_t keyframe = 0; keyframe < keyframes.size() && segment < count; ) {
+            if (offset == keyframes[keyframe].next) {
+                while (segment < count && segments[segment].preroll == keyframes[keyframe].time)
+                    segments[segment++].clear = clear;
+                keyframe++;
+                continue;
+            }
+            render.movie.read(offset, record.time, record);
+            if (record.event == NES::Movie::LOAD || record.event == NES::Movie::LOAD_STATE)
+                clear = record.time;
+            offset = record.next;
+        }
+    }
+
+    // create the files and leave the headers for when the lengths are known
+    for (std::size_t i = 0; i < NUM_STEMS; i++) {
+        std::ofstream file(render.get_stem_path(i), std::ios_base::binary | std::ios_base::trunc);
+        write_wav_header(file, render.sample_rate, 0);
+        if (!file.good()) {
+            std::fprintf(stderr, "failed to write %s\n", render.get_stem_path(i).c_str());
+            return 1;
+        }
+    }
+    if (render.is_video) {
+        std::ofstream file(render.get_video_path(), std::ios_base::binary | std::ios_base::trunc);
+        if (!file.is_open()) {
+            std::fprintf(stderr, "failed to write %s\n", render.get_video_path().c_str());
+            return 1;
+        }
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    std::atomic<std::size_t> next{0};
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < std::min<std::size_t>(jobs, count); i++) {
+        threads.emplace_back([&]() {
+            for (std::size_t index = next++; index < count; index = next++)
+                segments[index].is_done = render_segment(render, segments[index]);
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    const double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    for (const auto& segment : segments) {
+        if (!segment.is_done) {
+            std::fprintf(stderr, "failed to render the movie\n");
+            return 1;
+        }
+    }
+
+    const uint64_t samples = segments.back().end_sample;
+    for (std::size_t i = 0; i < NUM_STEMS; i++) {
+        std::fstream file(render.get_stem_path(i), std::ios_base::in | std::ios_base::out | std::ios_base::binary);
+        write_wav_header(file, render.sample_rate, samples);
+    }
+    const double emulated = static_cast<double>(render.movie.get_length()) / NES::CLOCK_RATE;
+    std::printf("movie            %s\n", movie.c_str());
+    std::printf("length           %.2f s (%llu samples)\n", emulated, static_cast<unsigned long long>(samples));
+    std::printf("segments         %zu\n", count);
+    std::printf("wall time        %.3f s (%.1fx real-time)\n", seconds, emulated / seconds);
+    return 0;
+}
@@ -0,0 +1,106 @@
+# Headless tools that build the NES core without the Rack SDK.
+#
+#   make bench                         build build/tools/bench
+#   make bench ROM=game.nes            build and run the benchmark on a ROM
+#   make bench ROM=game.nes FRAMES=3600 SCRIPT=inputs.txt
+#   make bench ROM=game.nes BATCH=64 [JOBS=8]
+#                                      benchmark a batch of emulators
+#   make bench ROM=game.nes FORKS=16 [LENGTH=60] [JOBS=8]
+#                                      benchmark a pool of forks
+#   make microbench [FILTER=cpu]       run the microbenchmarks against the
+#                                      baseline in tools/microbench.tsv
+#   make microbench-baseline           overwrite the baseline
+#   make golden ROM=game.nes GOLDEN=game.golden
+#                                      compare a run against a golden trace
+#   make golden-record ROM=game.nes GOLDEN=game.golden
+#                                      record the golden trace of a run
+#   make render ROM=game.nes MOVIE=game.nesm [JOBS=8] [PREFIX=out] [VIDEO=1]
+#                                      render a movie to WAV stems (and video)
+#
+# The core is built with jansson when pkg-config can find it, otherwise it is
+# built with NES_NO_JSON and without the JSON serialization of its state.
+
+TOOLS_FLAGS := -O3 -DNDEBUG -Wall -Wextra -Isrc -MMD -MP
+TOOLS_CORE := $(wildcard src/nes/*.cpp) $(wildcard src/nes/mappers/*.cpp) $(wildcard src/nes/apu/*.cpp) $(wildcard src/nes/ntsc/*.c)
+
+TOOLS_JANSSON ?= $(shell pkg-config --exists jansson 2>/dev/null && echo 1)
+ifeq ($(TOOLS_JANSSON),1)
+JANSSON_CFLAGS ?= $(shell pkg-config --cflags jansson)
+JANSSON_LIBS ?= $(shell pkg-config --libs jansson)
+TOOLS_BUILD := build/tools
+TOOLS_FLAGS += $(JANSSON_CFLAGS)
+TOOLS_LDFLAGS += $(JANSSON_LIBS)
+TOOLS_CORE += src/base64.cpp
+else
+TOOLS_BUILD := build/tools-nojson
+TOOLS_FLAGS += -DNES_NO_JSON
+endif
+
+TOOLS_CORE_OBJECTS := $(patsubst %, $(TOOLS_BUILD)/%.o, $(TOOLS_CORE))
+
+$(TOOLS_BUILD)/%.cpp.o: %.cpp
+	@mkdir -p $(@D)
+	$(CXX) -std=c++11 $(TOOLS_FLAGS) -c $< -o $@
+
+$(TOOLS_BUILD)/%.c.o: %.c
+	@mkdir -p $(@D)
+	$(CC) $(TOOLS_FLAGS) -c $< -o $@
+
+# the golden trace harness needs the core built with the CPU trace hook
+TOOLS_TRACE_BUILD := $(TOOLS_BUILD)-trace
+TOOLS_TRACE_OBJECTS := $(patsubst %, $(TOOLS_TRACE_BUILD)/%.o, $(TOOLS_CORE))
+
+$(TOOLS_TRACE_BUILD)/%.cpp.o: %.cpp
+	@mkdir -p $(@D)
+	$(CXX) -std=c++11 $(TOOLS_FLAGS) -DNES_TRACE -c $< -o $@
+
+$(TOOLS_TRACE_BUILD)/%.c.o: %.c
+	@mkdir -p $(@D)
+	$(CC) $(TOOLS_FLAGS) -DNES_TRACE -c $< -o $@
+
+$(TOOLS_BUILD)/bench: $(TOOLS_BUILD)/tools/bench.cpp.o $(TOOLS_CORE_OBJECTS)
+	$(CXX) $^ $(TOOLS_LDFLAGS) -pthread -o $@
+
+$(TOOLS_BUILD)/microbench: $(TOOLS_BUILD)/tools/microbench.cpp.o $(TOOLS_CORE_OBJECTS)
+	$(CXX) $^ $(TOOLS_LDFLAGS) -o $@
+
+$(TOOLS_TRACE_BUILD)/golden: $(TOOLS_TRACE_BUILD)/tools/golden.cpp.o $(TOOLS_TRACE_OBJECTS)
+	$(CXX) $^ $(TOOLS_LDFLAGS) -o $@
+
+$(TOOLS_BUILD)/render: $(TOOLS_BUILD)/tools/render.cpp.o $(TOOLS_CORE_OBJECTS)
+	$(CXX) $^ $(TOOLS_LDFLAGS) -pthread -o $@
+
+FRAMES ?= 600
+
+bench: $(TOOLS_BUILD)/bench
+ifdef ROM
+	$< -n $(FRAMES) $(if $(SCRIPT),-s $(SCRIPT)) $(if $(BATCH),-k $(BATCH) $(if $(JOBS),-j $(JOBS))) \
+		$(if $(FORKS),-f $(FORKS) $(if $(LENGTH),-l $(LENGTH)) $(if $(JOBS),-j $(JOBS))) $(ROM)
+endif
+
+MICROBENCH_BASELINE := tools/microbench.tsv
+
+microbench: $(TOOLS_BUILD)/microbench
+	$< $(if $(wildcard $(MICROBENCH_BASELINE)),-b $(MICROBENCH_BASELINE)) $(FILTER)
+
+microbench-baseline: $(TOOLS_BUILD)/microbench
+	$< > $(MICROBENCH_BASELINE)
+
+GOLDEN_FLAGS = -n $(FRAMES) $(if $(SCRIPT),-s $(SCRIPT)) $(if $(START),-p $(START))
+
+golden: $(TOOLS_TRACE_BUILD)/golden
+ifdef ROM
+	$< $(GOLDEN_FLAGS) $(if $(GOLDEN),-c $(GOLDEN)) $(ROM)
+endif
+
+golden-record: $(TOOLS_TRACE_BUILD)/golden
+	$< $(GOLDEN_FLAGS) -o $(GOLDEN) $(ROM)
+
+render: $(TOOLS_BUILD)/render
+ifdef MOVIE
+	$< $(if $(JOBS),-j $(JOBS)) $(if $(PREFIX),-o $(PREFIX)) $(if $(VIDEO),-v) $(ROM) $(MOVIE)
+endif
+
+.PHONY: bench microbench microbench-baseline golden golden-record render
+
+-include $(shell find $(TOOLS_BUILD) $(TOOLS_TRACE_BUILD) -name '*.d' 2>/dev/null)